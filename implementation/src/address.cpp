@@ -60,6 +60,8 @@ const char * ZMQAddress::get_conn_str(const ZMQAddress &myself, addr_type_t at)
             return get_local_str();
         else if (at == PULL)
             return get_local_pull_str();
+        else if (at == QUERY_REQUEST)
+            return get_local_query_str();
     } else {
         if (at == PUBLISH)
             return get_remote_pub_str();
@@ -67,6 +69,8 @@ const char * ZMQAddress::get_conn_str(const ZMQAddress &myself, addr_type_t at)
             return get_remote_str();
         else if (at == PULL)
             return get_remote_pull_str();
+        else if (at == QUERY_REQUEST)
+            return get_remote_query_str();
     }
     throw std::runtime_error("Unknown address type");
 }
@@ -105,6 +109,14 @@ void ZMQAddress::precompute_strings_() {
     std::ostringstream local_pull_addr_os;
     local_pull_addr_os << "inproc://" << (localnum_+PULL_OFFSET);
     local_pull_addr_ = local_pull_addr_os.str();
+
+    std::ostringstream remote_query_addr_os;
+    remote_query_addr_os << "tcp://" << ip << ":" << (port+QUERY_OFFSET);
+    remote_query_addr_ = remote_query_addr_os.str();
+
+    std::ostringstream local_query_addr_os;
+    local_query_addr_os << "inproc://" << (localnum_+QUERY_OFFSET);
+    local_query_addr_ = local_query_addr_os.str();
 }
 
 bool ZMQAddress::is_zero() const {
@@ -24,7 +24,8 @@ namespace elga {
     typedef enum addr_type {
         REQUEST,
         PUBLISH,
-        PULL
+        PULL,
+        QUERY_REQUEST
     } addr_type_t;
 
     /** Keep track of ZMQ addresses (local and remote) */
@@ -45,6 +46,11 @@ namespace elga {
             /** Pre-compute and store the local pull addr */
             std::string local_pull_addr_;
 
+            /** Pre-compute and store the remote query addr */
+            std::string remote_query_addr_;
+            /** Pre-compute and store the local query addr */
+            std::string local_query_addr_;
+
             /** Store the IP address and local number */
             uint32_t addr_;
             localnum_t localnum_;
@@ -60,6 +66,7 @@ namespace elga {
             ZMQAddress() : remote_addr_(), local_addr_(), remote_pub_addr_(),
                     local_pub_addr_(),
                     remote_pull_addr_(), local_pull_addr_(),
+                    remote_query_addr_(), local_query_addr_(),
                     addr_(0), localnum_(0) { }
 
             /** Support swapping */
@@ -70,6 +77,8 @@ namespace elga {
                 std::swap(local_pub_addr_, that.local_pub_addr_);
                 std::swap(remote_pull_addr_, that.remote_pull_addr_);
                 std::swap(local_pull_addr_, that.local_pull_addr_);
+                std::swap(remote_query_addr_, that.remote_query_addr_);
+                std::swap(local_query_addr_, that.local_query_addr_);
                 std::swap(addr_, that.addr_);
                 std::swap(localnum_, that.localnum_);
             }
@@ -88,6 +97,10 @@ namespace elga {
             const char *get_remote_pull_str() const { return remote_pull_addr_.c_str(); }
             /** Retrieve the local pull connection string */
             const char *get_local_pull_str() const { return local_pull_addr_.c_str(); }
+            /** Retrieve the remote query connection string */
+            const char *get_remote_query_str() const { return remote_query_addr_.c_str(); }
+            /** Retrieve the local query connection string */
+            const char *get_local_query_str() const { return local_query_addr_.c_str(); }
 
             /** Return the address */
             uint32_t get_addr() const { return addr_; }
@@ -13,9 +13,16 @@
 #include "agent.hpp"
 
 #include "pack.hpp"
+#include "aggregate.hpp"
 
+#include <cmath>
+#include <cstring>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <numeric>
+
+#include <unistd.h>
 
 #include "absl/container/flat_hash_map.h"
 
@@ -26,7 +33,11 @@ std::mutex elga::p_mutex {};
 namespace elga::agent {
 
     void print_usage() {
+        #ifdef CONFIG_CHECKPOINT
+        std::cout << "Usage: agent [help] ip-address [restore]" << std::endl;
+        #else
         std::cout << "Usage: agent [help] ip-address" << std::endl;
+        #endif
     }
 
     int print_help() {
@@ -36,7 +47,11 @@ namespace elga::agent {
             "it in memory while managing the algorithm execution on it.\n"
             "Options:\n"
             "    help : display this help message"
-            "    ip-address : (required) the IP address to listen on\n" <<
+            "    ip-address : (required) the IP address to listen on\n"
+            #ifdef CONFIG_CHECKPOINT
+            "    restore : load the graph from this agent's last checkpoint\n"
+            #endif
+            <<
             std::endl;
         return 0;
     }
@@ -57,6 +72,15 @@ namespace elga::agent {
         // Create the agent
         elga::Agent agent(addr, directory_master);
 
+        #ifdef CONFIG_CHECKPOINT
+        // Restore before registering, so we join with our saved virtual
+        // agent count
+        if (argc > 2 && std::string(argv[2]) == "restore") {
+            if (!agent.restore())
+                std::cerr << "[ElGA : Agent] no checkpoint to restore" << std::endl;
+        }
+        #endif
+
         // Register ourselves
         agent.register_dir();
 
@@ -105,19 +129,165 @@ uint64_t Agent::get_owner(update_t& u) {
     return find_agent(u.e, u.et, true, 0, dummy);
 }
 
+void Agent::add_neighbor(VertexStorage &vs, edge_type et, const edge_t &e) {
+    if (et == IN) {
+        vs.in_neighbors.push_back(e.src);
+        #ifdef CONFIG_EDGE_WEIGHTS
+        vs.in_weights.push_back(e.weight);
+        #endif
+        #ifdef CONFIG_EDGE_TIMESTAMPS
+        vs.in_timestamps.push_back(e.timestamp);
+        #endif
+        #ifdef CONFIG_EDGE_WINDOW
+        expiry_.insert(e.src, e.dst, e.timestamp);
+        #endif
+    } else {
+        vs.out_neighbors.push_back(e.dst);
+        #ifdef CONFIG_EDGE_WEIGHTS
+        vs.out_weights.push_back(e.weight);
+        #endif
+        #ifdef CONFIG_EDGE_TIMESTAMPS
+        vs.out_timestamps.push_back(e.timestamp);
+        #endif
+    }
+}
+
+template <typename T>
+static inline void swap_pop(std::vector<T> &v, size_t idx) {
+    v[idx] = v.back();
+    v.pop_back();
+}
+
+void Agent::remove_neighbor(VertexStorage &vs, edge_type et, size_t idx) {
+    if (et == IN) {
+        if (idx >= vs.in_neighbors.size()) return;
+        #ifdef CONFIG_EDGE_WINDOW
+        expiry_.erase(vs.in_neighbors[idx], vs.vertex, vs.in_timestamps[idx]);
+        #endif
+        swap_pop(vs.in_neighbors, idx);
+        #ifdef CONFIG_EDGE_WEIGHTS
+        swap_pop(vs.in_weights, idx);
+        #endif
+        #ifdef CONFIG_EDGE_TIMESTAMPS
+        swap_pop(vs.in_timestamps, idx);
+        #endif
+    } else {
+        if (idx >= vs.out_neighbors.size()) return;
+        swap_pop(vs.out_neighbors, idx);
+        #ifdef CONFIG_EDGE_WEIGHTS
+        swap_pop(vs.out_weights, idx);
+        #endif
+        #ifdef CONFIG_EDGE_TIMESTAMPS
+        swap_pop(vs.out_timestamps, idx);
+        #endif
+    }
+}
+
+edge_t Agent::stored_edge(const VertexStorage &vs, edge_type et, size_t idx) {
+    edge_t e;
+    if (et == IN) {
+        e.src = vs.in_neighbors[idx];
+        e.dst = vs.vertex;
+        #ifdef CONFIG_EDGE_WEIGHTS
+        e.weight = vs.in_weights[idx];
+        #endif
+        #ifdef CONFIG_EDGE_TIMESTAMPS
+        e.timestamp = vs.in_timestamps[idx];
+        #endif
+    } else {
+        e.src = vs.vertex;
+        e.dst = vs.out_neighbors[idx];
+        #ifdef CONFIG_EDGE_WEIGHTS
+        e.weight = vs.out_weights[idx];
+        #endif
+        #ifdef CONFIG_EDGE_TIMESTAMPS
+        e.timestamp = vs.out_timestamps[idx];
+        #endif
+    }
+    return e;
+}
+
+size_t Agent::remove_multi_edges(VertexStorage &vs) {
+    auto &in = vs.in_neighbors;
+    #ifndef CONFIG_EDGE_ATTRS
+    std::sort(in.begin(), in.end());
+    auto last_in = std::unique(in.begin(), in.end());
+    size_t removed = in.end() - last_in;
+    in.erase(last_in, in.end());
+    return removed;
+    #else
+    // Sort a permutation instead, so the attributes follow their
+    // neighbors, and keep the most recently inserted copy of each edge
+    std::vector<size_t> perm(in.size());
+    std::iota(perm.begin(), perm.end(), 0);
+    std::stable_sort(perm.begin(), perm.end(), [&](size_t a, size_t b) {
+            return in[a] < in[b];
+        });
+    std::vector<size_t> keep;
+    keep.reserve(perm.size());
+    for (size_t i = 0; i < perm.size(); ++i)
+        if (i+1 == perm.size() || in[perm[i+1]] != in[perm[i]])
+            keep.push_back(perm[i]);
+    size_t removed = in.size() - keep.size();
+    #ifdef CONFIG_EDGE_WINDOW
+    for (size_t i = 0; i < perm.size(); ++i)
+        if (i+1 < perm.size() && in[perm[i+1]] == in[perm[i]])
+            expiry_.erase(in[perm[i]], vs.vertex, vs.in_timestamps[perm[i]]);
+    #endif
+
+    auto gather = [&](auto &values) {
+        std::remove_reference_t<decltype(values)> kept;
+        kept.reserve(keep.size());
+        for (size_t i : keep)
+            kept.push_back(values[i]);
+        values.swap(kept);
+    };
+    gather(vs.in_neighbors);
+    #ifdef CONFIG_EDGE_WEIGHTS
+    gather(vs.in_weights);
+    #endif
+    #ifdef CONFIG_EDGE_TIMESTAMPS
+    gather(vs.in_timestamps);
+    #endif
+    return removed;
+    #endif
+}
+
 void Agent::change_edge(update_t u, bool count_deg) {
+    #ifdef CONFIG_LIVE_MIGRATION
+    if (!ready_) {
+        unrouted_.push_back({u, count_deg});
+        return;
+    }
+    #endif
     // Ensure this edge is destined for us; if not, prep it for later moves
     uint64_t owner = get_owner(u);
     if (owner != addr_ser) {
         debug_agent_(addr_ser, "got ", u.e.src, "->", u.e.dst, " me=", addr_ser, " owner=", owner);
-        moves[owner].push_back(u);
+        queue_move(moves, owner, u);
         return;
     }
 
     vertex_t v_mine = (u.et == IN) ? u.e.dst : u.e.src;
     vertex_t v_theirs = (u.et == IN) ? u.e.src : u.e.dst;
 
-    #ifdef CONFIG_WCC
+    #ifdef CONFIG_LIVE_MIGRATION
+    if (ring_held()) {
+        // The edge is ours until the handoff, but if it already belongs
+        // elsewhere in the newest ring, the copies made there must see
+        // this change too; the edge itself is dropped at the handoff
+        bool newest = route_newest_;
+        route_newest_ = true;
+        uint64_t new_owner = get_owner(u);
+        route_newest_ = newest;
+        if (new_owner != addr_ser) {
+            queue_move(copies_, new_owner, u);
+            handoff_out_.insert(v_mine);
+        }
+    }
+    #endif
+
+    #if defined(CONFIG_WCC) || defined(CONFIG_ASYNC)
     tmap[v_theirs].push_back(v_mine);
     #endif
 
@@ -139,16 +309,24 @@ void Agent::change_edge(update_t u, bool count_deg) {
         if (vs.in_neighbors.size() == 0 && vs.out_neighbors.size() == 0) {
             nV_++;
             update_nV_set_.insert(v_mine);
+            index_vertex(v_mine);
         }
-        neighbors.push_back(v_theirs);
+        add_neighbor(vs, u.et, u.e);
         if (u.et == IN) {
             update_nE_++;
             nE_++;
         }
+        #ifdef CONFIG_EDGE_WINDOW
+        max_timestamp_ = std::max(max_timestamp_, u.e.timestamp);
+        #endif
         #ifdef CONFIG_CS
         // Update the sketch
         if (count_deg) {
+            #ifdef CONFIG_HUB_LIST
+            int64_t deg_est = hubs_.count(v_mine);
+            #else
             int32_t deg_est = cms.query_count(v_mine);
+            #endif
             if (deg_est >= REP_THRESH) {
                 // We want to push our sketch up
                 push_sketch_ = true;
@@ -159,33 +337,47 @@ void Agent::change_edge(update_t u, bool count_deg) {
         if (vs.out_neighbors.size() == 0 && vs.in_neighbors.size() == 0) {
             nV_--;
             update_nV_ -= 1.0/vs.replicas.size();
+            unindex_vertex(v_mine);
             graph_.erase(v_mine);
         }
-        if (neighbors.size() == 1)
-            neighbors.clear();
-        else {
-            std::iter_swap(std::find(neighbors.begin(), neighbors.end(), v_theirs),
-                    neighbors.end()-1);
-            neighbors.pop_back();
-        }
+        auto n_it = std::find(neighbors.begin(), neighbors.end(), v_theirs);
+        remove_neighbor(vs, u.et, n_it - neighbors.begin());
 
         if (u.et == IN) {
             update_nE_--;
             nE_--;
         }
     }
+
+    if (stats_) stats_->nE.store(nE_, std::memory_order_relaxed);
 }
 
 void Agent::pre_poll() {
     #ifdef CONFIG_AUTOSCALE
     if (dead) return;
     #endif
+    #ifdef CONFIG_LIVE_MIGRATION
+    if (ready_ && unrouted_.size() > 0) {
+        std::vector<std::pair<update_t, bool>> unrouted;
+        std::swap(unrouted, unrouted_);
+        for (auto & [u, count_deg] : unrouted)
+            change_edge(u, count_deg);
+    }
+    #endif
     // This implements a BSP-like processing:
     // 1) for every active vertex, or those with active neighbors, process
     // in the algorithm
     // 2) send updates to each out-agent, even if the updates are empty
     // 3) wait for in-agent number of updates
     // 4) join the global barrier
+    #ifdef CONFIG_PIPELINE_BATCHES
+    // Overlap the next batch's edge exchange with this computation
+    if (state_ == PROCESS && update_set_.size() > 0)
+        stage_updates();
+    // Every staged edge must be held before the barrier can release
+    if (state_ == JOIN_BARRIER && staged_acks_needed_ > 0)
+        return;
+    #endif
     if (state_ == PROCESS) {
         // Process each vertex, and send out all out-agent updates
         process_vertices();
@@ -194,16 +386,32 @@ void Agent::pre_poll() {
         char msg[sizeof(msg_type_t)+sizeof(size_t)];
         char *msg_ptr = msg;
         pack_msg(msg_ptr, READY_SYNC);
+        #ifdef CONFIG_ASYNC
+        // Each wave counts the agents that received vertex messages
+        // since the last one; a wave of zero is termination
+        pack_single(msg_ptr, (size_t)(vn_dirty_ ? 1 : 0));
+        vn_dirty_ = false;
+        #else
         pack_single(msg_ptr, (size_t)(num_dormant_));
+        #endif
 
         d_req_.send(msg, sizeof(msg));
 
         state_ = WAIT_FOR_SYNC;
+        #ifdef CONFIG_VA_BALANCE
+        busy_timer_.retock();
+        #endif
 
         debug_agent_(addr_ser, "WAIT-S  |");
     } else if (state_ == WAIT_FOR_SYNC) {
         // Do nothing, a sync will be explicitly handled with a different
         // message or later
+        #ifdef CONFIG_ASYNC
+        // Asynchronously, keep processing arrivals while the termination
+        // wave completes
+        if (active_.size() > 0)
+            process_vertices();
+        #endif
     }
 }
 
@@ -211,6 +419,11 @@ bool Agent::shutdown() {
     if (state_ == NO_PROCESS) state_ = IDLE;
     info_agent_(addr_ser, "LEAVE   |");
 
+    #ifdef CONFIG_CHECKPOINT
+    // Leave the last checkpoint complete on disk
+    reap_checkpoint(true);
+    #endif
+
     if (nE_ == 0 && update_acks_needed_ == 0) {
         info_agent_(addr_ser, "SHUTDOWN|");
         return false;
@@ -229,7 +442,18 @@ void Agent::push_sketch() {
     // We want to send our local sketch up to the directory, then reset
     info_agent_(addr_ser, "SEND SK |");
 
+    #ifdef CONFIG_HUB_LIST
+    std::vector<char> hubs_ser;
+    if (push_sketch_) hubs_ser = hubs_.serialize();
+    size_t cms_size = hubs_ser.size();
+    #elif defined(CONFIG_COMPACT_SKETCH)
+    // Only the nonzero counters are sent
+    std::vector<char> cms_ser;
+    if (push_sketch_) cms.serialize(cms_ser);
+    size_t cms_size = cms_ser.size();
+    #else
     size_t cms_size = CountMinSketch::size();
+    #endif
     size_t msg_size = sizeof(msg_type_t);
     if (push_sketch_) msg_size += cms_size;
 
@@ -239,15 +463,25 @@ void Agent::push_sketch() {
     pack_msg(data, CS_UPDATE);
 
     if (push_sketch_) {
+        #ifdef CONFIG_HUB_LIST
+        memcpy(data, hubs_ser.data(), cms_size);
+        #elif defined(CONFIG_COMPACT_SKETCH)
+        memcpy(data, cms_ser.data(), cms_size);
+        #else
         const char* cms_ser = cms.serialize();
         memcpy(data, cms_ser, cms_size);
+        #endif
     }
 
     d_req_.send(msg, msg_size);
 
     delete [] msg;
 
+    #ifdef CONFIG_HUB_LIST
+    if (push_sketch_) hubs_.clear();
+    #else
     if (push_sketch_) cms.clear();
+    #endif
 
     push_sketch_ = false;
     state_ = WAIT_FOR_LB;
@@ -255,6 +489,43 @@ void Agent::push_sketch() {
 
 #endif
 
+void Agent::move_lost_edges(vertex_t v, VertexStorage &lv,
+        size_t &lost_edges, size_t &lost_out_edges, bool copy) {
+    #ifdef CONFIG_LIVE_MIGRATION
+    move_queue_t &q = copy ? copies_ : moves;
+    #else
+    move_queue_t &q = moves;
+    #endif
+    for (edge_type et : {OUT, IN}) {
+        auto &neighbors = (et == OUT) ? lv.out_neighbors : lv.in_neighbors;
+        // Lost edges are swapped out, so only advance past kept ones
+        for (size_t idx = 0; idx < neighbors.size();) {
+            bool dummy;
+            edge_t e = stored_edge(lv, et, idx);
+            uint64_t cur_agent = find_agent(e, et, true, 0, dummy);
+            if (cur_agent == addr_ser) {
+                ++idx;
+                continue;
+            }
+            debug_agent_(addr_ser, "MOVE EDG | ", e.src, "->", e.dst);
+            update_t u;
+            u.e = e;
+            u.et = et;
+            u.insert = true;
+            queue_move(q, cur_agent, u);
+            ++((et == OUT) ? lost_out_edges : lost_edges);
+            #ifdef CONFIG_LIVE_MIGRATION
+            if (copy) {
+                handoff_out_.insert(v);
+                ++idx;
+                continue;
+            }
+            #endif
+            remove_neighbor(lv, et, idx);
+        }
+    }
+}
+
 void Agent::handle_directory_update() {
     if (state_ == WAIT_FOR_LB_SYNC) {
         info_agent_(addr_ser, "DIR UPD | [----]");
@@ -283,58 +554,130 @@ void Agent::handle_directory_update() {
     timer::Timer du_t {"directory-update"};
     size_t lost_edges = 0;
     size_t lost_out_edges = 0;
+    size_t scanned = 0;
     absl::flat_hash_set<vertex_t> v_to_remove;
     du_t.tick();
-    for (auto & [v_o, lv_o] : graph_) {
-        auto &v = v_o;
-        auto &lv = lv_o;
-        lv.out_neighbors.erase(std::remove_if(lv.out_neighbors.begin(),
-                lv.out_neighbors.end(), [&](vertex_t n) {
-                    bool dummy;
-                    edge_t e;
-                    e.src = v;
-                    e.dst = n;
-                    uint64_t cur_agent = find_agent(e, OUT, true, 0, dummy);
-                    if (cur_agent != addr_ser) {
-                        debug_agent_(addr_ser, "MOVE EDG | ", v, "->", n);
-                        update_t u;
-                        u.e = e;
-                        u.et = OUT;
-                        u.insert = true;
-                        moves[cur_agent].push_back(u);
-                        ++lost_out_edges;
-                        return true;
-                    }
-                    return false;
-                }), lv.out_neighbors.end());
-        lv.in_neighbors.erase(std::remove_if(lv.in_neighbors.begin(),
-                lv.in_neighbors.end(), [&](vertex_t n) {
-                    bool dummy;
-                    edge_t e;
-                    e.src = n;
-                    e.dst = v;
-                    uint64_t cur_agent = find_agent(e, IN, true, 0, dummy);
-                    if (cur_agent != addr_ser) {
-                        debug_agent_(addr_ser, "MOVE EDG | ", v, "<-", n);
-                        update_t u;
-                        u.e = e;
-                        u.et = IN;
-                        u.insert = true;
-                        moves[cur_agent].push_back(u);
-                        ++lost_edges;
-                        return true;
+    #ifdef CONFIG_LIVE_MIGRATION
+    // Mid-batch, lost edges are copied and kept: the batch finishes on
+    // the ring it started with, and the handoff is at its end
+    bool copy = ring_held();
+    route_newest_ = true;
+    #else
+    bool copy = false;
+    #endif
+    std::vector<hash_range_t> owned = ch_.owned_ranges(addr_ser);
+    if (!owned_ranges_known_) {
+        // Without a previous ring, every edge must be checked
+        for (auto & [v, lv] : graph_) {
+            move_lost_edges(v, lv, lost_edges, lost_out_edges, copy);
+            if (lv.out_neighbors.size() == 0 && lv.in_neighbors.size() == 0)
+                v_to_remove.insert(v);
+            #ifdef CONFIG_CS
+            else if (count_agent_reps(v) > 0)
+                replicated_.insert(v);
+            #endif
+        }
+        scanned = graph_.size();
+        #ifdef CONFIG_CS
+        replicated_version_ = rm_version_;
+        #endif
+    } else {
+        // Only vertices hashing into ranges we lost can have moved, and
+        // all of their edges move to the new owner
+        std::vector<vertex_t> lost_vertices;
+        for (auto [lo, hi] : subtract_ranges(owned_ranges_, owned)) {
+            for (auto it = by_hash_.lower_bound({lo, 0}); it != by_hash_.end() && it->first <= hi; ++it)
+                lost_vertices.push_back(it->second);
+        }
+        #ifdef CONFIG_CS
+        // Edges of replicated vertices are placed per edge, so those that
+        // are or were replicated are re-resolved wherever they hash; which
+        // vertices are replicated only changes with the replication map
+        absl::flat_hash_set<vertex_t> per_edge(replicated_);
+        if (replicated_version_ != rm_version_) {
+            replicated_.clear();
+            #ifdef CONFIG_HUB_LIST
+            // Only listed hubs can be replicated
+            for (auto &h : rm_.hubs())
+                if (graph_.count(h.v) > 0 && count_agent_reps(h.v) > 0)
+                    replicated_.insert(h.v);
+            #else
+            // A sketch cannot list its heavy keys, so check every vertex
+            for (auto & [v, lv] : graph_)
+                if (count_agent_reps(v) > 0)
+                    replicated_.insert(v);
+            #endif
+            per_edge.insert(replicated_.begin(), replicated_.end());
+            replicated_version_ = rm_version_;
+        }
+        for (vertex_t v : lost_vertices) per_edge.erase(v);
+        lost_vertices.insert(lost_vertices.end(), per_edge.begin(), per_edge.end());
+        #endif
+        for (vertex_t v : lost_vertices) {
+            auto lv_it = graph_.find(v);
+            if (lv_it == graph_.end()) continue;
+            VertexStorage &lv = lv_it->second;
+            if (count_agent_reps(v) > 0) {
+                move_lost_edges(v, lv, lost_edges, lost_out_edges, copy);
+            } else {
+                edge_t e;
+                e.src = v;
+                e.dst = v;
+                bool dummy;
+                uint64_t owner = find_agent(e, OUT, true, 0, dummy);
+                if (owner != addr_ser) {
+                    lost_out_edges += lv.out_neighbors.size();
+                    lost_edges += lv.in_neighbors.size();
+                    #ifdef CONFIG_LIVE_MIGRATION
+                    if (copy) {
+                        queue_move(copies_, owner, VertexStorage(lv));
+                        handoff_out_.insert(v);
+                        continue;
                     }
-                    return false;
-                }), lv.in_neighbors.end());
-        if (lv.out_neighbors.size() == 0 && lv.in_neighbors.size() == 0)
-            v_to_remove.insert(v);
+                    #endif
+                    // The whole vertex moves, so hand over its storage
+                    #ifdef CONFIG_EDGE_WINDOW
+                    for (size_t idx = 0; idx < lv.in_neighbors.size(); ++idx)
+                        expiry_.erase(lv.in_neighbors[idx], v, lv.in_timestamps[idx]);
+                    #endif
+                    queue_move(moves, owner, std::move(lv));
+                    lv.out_neighbors.clear();
+                    lv.in_neighbors.clear();
+                }
+            }
+            if (lv.out_neighbors.size() == 0 && lv.in_neighbors.size() == 0)
+                v_to_remove.insert(v);
+        }
+        scanned = lost_vertices.size();
+    }
+    owned_ranges_ = std::move(owned);
+    owned_ranges_known_ = true;
+    #ifdef CONFIG_LIVE_MIGRATION
+    route_newest_ = false;
+    if (copy) {
+        info_agent_(addr_ser, "EDGE CP | ", lost_out_edges, " + ", lost_edges, " from ", scanned);
+        const uint8_t flag_copy_edges = 0x4;
+        std::vector<uint64_t> agents;
+        for (auto & [agent, q] : copies_.blocks)
+            agents.push_back(agent);
+        for (uint64_t agent : agents)
+            send_move_chunks(copies_, agent, flag_copy_edges);
+        du_t.tock();
+        info_agent_(addr_ser, "DIR UPD | ", du_t);
+        return;
     }
+    #endif
     nE_ -= lost_edges;
-    info_agent_(addr_ser, "EDGE RM | ", lost_out_edges, " + ", lost_edges);
+    info_agent_(addr_ser, "EDGE RM | ", lost_out_edges, " + ", lost_edges, " from ", scanned);
 
     // Remove the vertices as appropriate
-    for (vertex_t v : v_to_remove)
+    for (vertex_t v : v_to_remove) {
+        unindex_vertex(v);
         graph_.erase(v);
+        #ifdef CONFIG_CS
+        replicated_.erase(v);
+        #endif
+    }
     nV_ -= v_to_remove.size();
 
     // Now, move the actual edges
@@ -349,38 +692,142 @@ void Agent::handle_directory_update() {
     info_agent_(addr_ser, "DIR UPD | ", du_t);
 }
 
-void Agent::send_move_edges() {
-    if (moves.size() == 0) return;
+void Agent::queue_move(move_queue_t &q, uint64_t agent_ser, const update_t &u) {
+    auto &blocks = q.blocks[agent_ser];
+    if (blocks.size() == 0 || blocks.back().sent > 0 || blocks.back().updates.size() == 0)
+        blocks.push_back({});
+    blocks.back().updates.push_back(u);
+    ++q.queued;
+}
 
-    size_t moved_edges = 0;
-    for (auto & [agent, moved_changes]: moves) {
-        const uint8_t flag_move_edges = 0x0;
-        size_t msg_size = sizeof(msg_type_t)+sizeof(flag_move_edges)+sizeof(addr_ser)+moved_changes.size()*sizeof(update_t);
-        char *msg = new char[msg_size];
+void Agent::queue_move(move_queue_t &q, uint64_t agent_ser, VertexStorage &&vs) {
+    size_t num_edges = vs.out_neighbors.size()+vs.in_neighbors.size();
+    if (num_edges == 0) return;
+    q.blocks[agent_ser].push_back({std::move(vs), {}, 0});
+    q.queued += num_edges;
+}
 
-        char *msg_ptr = msg;
+void Agent::send_move_chunks(move_queue_t &q, uint64_t agent_ser, uint8_t flag) {
+    auto q_it = q.blocks.find(agent_ser);
+    if (q_it == q.blocks.end()) return;
+    auto &blocks = q_it->second;
+    size_t &inflight = q.inflight[agent_ser];
+
+    // Chunks are taken from the front, so moves arrive in the order they
+    // were queued, and each block's storage is freed once it is sent
+    std::vector<update_t> chunk;
+    while (blocks.size() > 0 && inflight < MOVE_WINDOW) {
+        chunk.clear();
+        while (blocks.size() > 0 && chunk.size() < MOVE_CHUNK) {
+            move_block_t &b = blocks.front();
+            size_t num_out = b.vs.out_neighbors.size();
+            size_t num_in = b.vs.in_neighbors.size();
+            size_t num_edges = num_out+num_in+b.updates.size();
+            for (; b.sent < num_edges && chunk.size() < MOVE_CHUNK; ++b.sent) {
+                if (b.sent < num_out+num_in) {
+                    update_t u;
+                    u.et = (b.sent < num_out) ? OUT : IN;
+                    u.e = stored_edge(b.vs, u.et, (b.sent < num_out) ? b.sent : b.sent-num_out);
+                    u.insert = true;
+                    chunk.push_back(u);
+                } else
+                    chunk.push_back(b.updates[b.sent-num_out-num_in]);
+            }
+            if (b.sent == num_edges) blocks.pop_front();
+        }
 
-        pack_msg(msg_ptr, SEND_UPDATES);
-        pack_single(msg_ptr, flag_move_edges);
-        pack_single(msg_ptr, addr_ser);
-        for (const update_t & u : moved_changes) {
-            pack_single(msg_ptr, u);
-            ++moved_edges;
+        send_updates(agent_ser, flag, chunk);
+        q.queued -= chunk.size();
+        ++inflight;
+        #ifdef CONFIG_LIVE_MIGRATION
+        // Copies only hold up a batch once their ring is installed
+        if (&q == &copies_) {
+            if (ring_held()) continue;
+            ++copy_acks_counted_;
         }
+        #endif
+        ++update_acks_needed_;
+    }
 
-        ZMQRequester &req = get_requester(agent);
-        req.send(msg, msg_size);
+    if (blocks.size() == 0) q.blocks.erase(q_it);
+}
 
-        delete [] msg;
+void Agent::send_move_edges() {
+    if (moves.blocks.size() == 0) return;
+
+    info_agent_(addr_ser, "MOVED   | ", moves.queued, " to ", moves.blocks.size());
+
+    // Collect the agents first, as a drained queue is removed
+    std::vector<uint64_t> agents;
+    agents.reserve(moves.blocks.size());
+    for (auto & [agent, q] : moves.blocks)
+        agents.push_back(agent);
+    const uint8_t flag_move_edges = 0x0;
+    for (uint64_t agent : agents)
+        send_move_chunks(moves, agent, flag_move_edges);
+}
 
-        moved_changes.clear();
+#ifdef CONFIG_LIVE_MIGRATION
+void Agent::handoff() {
+    release_ring();
+
+    // Drop what was copied away and still belongs elsewhere; changes
+    // since the copy are queued to follow it
+    size_t dropped = 0;
+    for (vertex_t v : handoff_out_) {
+        auto lv_it = graph_.find(v);
+        if (lv_it == graph_.end()) continue;
+        VertexStorage &lv = lv_it->second;
+        for (edge_type et : {OUT, IN}) {
+            auto &neighbors = (et == OUT) ? lv.out_neighbors : lv.in_neighbors;
+            for (size_t idx = 0; idx < neighbors.size();) {
+                bool dummy;
+                if (find_agent(stored_edge(lv, et, idx), et, true, 0, dummy) == addr_ser) {
+                    ++idx;
+                    continue;
+                }
+                remove_neighbor(lv, et, idx);
+                if (et == IN) ++dropped;
+            }
+        }
+        if (lv.out_neighbors.size() == 0 && lv.in_neighbors.size() == 0) {
+            unindex_vertex(v);
+            graph_.erase(lv_it);
+            #ifdef CONFIG_CS
+            replicated_.erase(v);
+            #endif
+            --nV_;
+        }
     }
-    update_acks_needed_ += moves.size();
+    handoff_out_.clear();
+    nE_ -= dropped;
 
-    info_agent_(addr_ser, "MOVED   | ", moved_edges, " to ", moves.size());
+    // Install the copies received, forwarding any that moved on again
+    size_t installed = handoff_in_.size();
+    for (const update_t &u : handoff_in_)
+        change_edge(u);
+    std::vector<update_t>().swap(handoff_in_);
+    send_move_edges();
 
-    moves.clear();
+    // Copies still outstanding must arrive before the next batch
+    for (auto & [agent, inflight] : copies_.inflight) {
+        copy_acks_counted_ += inflight;
+        update_acks_needed_ += inflight;
+    }
+    const uint8_t flag_copy_edges = 0x4;
+    std::vector<uint64_t> agents;
+    for (auto & [agent, q] : copies_.blocks)
+        agents.push_back(agent);
+    for (uint64_t agent : agents)
+        send_move_chunks(copies_, agent, flag_copy_edges);
+
+    info_agent_(addr_ser, "HANDOFF | dropped ", dropped, " installed ", installed, " waiting ", update_acks_needed_);
+    if (update_acks_needed_ != 0) {
+        move_timer_.tick();
+        state_ = WAIT_EDGE_MOVE;
+    }
 }
+#endif
 
 void Agent::process_vn(const char *data, size_t size) {
     // Ignore any trailing end-of-batch messages
@@ -390,6 +837,10 @@ void Agent::process_vn(const char *data, size_t size) {
     #if defined(CONFIG_BSP) || defined(CONFIG_LBSP)
     it_t it;
     unpack_single(data, it);
+    #ifdef CONFIG_ASYNC
+    uint64_t src_agent;
+    unpack_single(data, src_agent);
+    #endif
     while (it >= vn_count_) {
         vn_wait_.push_back({});
         #ifdef CONFIG_BSP
@@ -458,6 +909,10 @@ void Agent::process_vn(const char *data, size_t size) {
             #else
             if (graph_.count(n) > 0) {
                 alg_.set_active(graph_[n], vn);
+                #ifdef CONFIG_ASYNC
+                if (graph_[n].local.state == ACTIVE)
+                    active_.insert(n);
+                #endif
             }
             #endif
         }
@@ -494,19 +949,28 @@ void Agent::process_vn(const char *data, size_t size) {
             vn_wait_[it].erase(v);
         #endif
     }
-    #if defined(CONFIG_BSP) || defined(CONFIG_LBSP)
+    #ifdef CONFIG_ASYNC
+    // Only the first round of messages is counted; the rest are
+    // acknowledged and covered by the termination waves
+    if (it == 1)
+        --agent_msgs_needed_[it];
+    vn_dirty_ = true;
+    ack_vn(src_agent);
+    #elif defined(CONFIG_BSP) || defined(CONFIG_LBSP)
     --agent_msgs_needed_[it];
     if (state_ == PROCESS && it_ >= 0 && agent_msgs_needed_[it_+1] == 0)
         state_ = JOIN_BARRIER;
     #endif
 
     // Now, actually update the graph based on this input
+    #ifndef CONFIG_ASYNC
     pre_poll();
+    #endif
 }
 
 bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t size) {
     #ifdef CONFIG_AUTOSCALE
-    if (dead && t != AS_SCALE && t != QUERY) return true;
+    if (dead && t != AS_SCALE && t != QUERY && t != MULTI_QUERY && t != AGG_QUERY) return true;
     #endif
     switch (t) {
         #ifdef CONFIG_AUTOSCALE
@@ -562,10 +1026,7 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
             ZMQMessage resp { sock, resp_size };
             char* resp_data = resp.edit_data();
 
-            if (graph_.count(v) > 0)
-                alg_.query(resp_data, graph_[v]);
-            else
-                alg_.query(resp_data);
+            answer_query(v, resp_data);
 
             resp.send();
 
@@ -575,6 +1036,47 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
 
             break;
         }
+        case MULTI_QUERY: {
+            // Answer with the packed values, in the order requested
+            size_t num_vertices = size/sizeof(vertex_t);
+            size_t resp_size = alg_.query_resp_size();
+
+            ZMQMessage resp { sock, resp_size*num_vertices };
+            char* resp_data = resp.edit_data();
+
+            for (size_t ctr = 0; ctr < num_vertices; ++ctr) {
+                vertex_t v;
+                unpack_single(data, v);
+                answer_query(v, resp_data);
+                resp_data += resp_size;
+            }
+
+            resp.send();
+
+            #ifdef CONFIG_AUTOSCALE
+            query_count_ += num_vertices;
+            #endif
+
+            break;
+        }
+        case AGG_QUERY: {
+            answer_aggregate(data);
+            break;
+        }
+        #ifdef CONFIG_FLOW_CONTROL
+        case CREDIT: {
+            uint64_t want;
+            unpack_single(data, want);
+
+            uint64_t granted = grant_credits(want);
+
+            ZMQMessage resp { sock, sizeof(granted) };
+            char *resp_data = resp.edit_data();
+            pack_single(resp_data, granted);
+            resp.send();
+            break;
+        }
+        #endif
         case OUT_VN: {
                          debug_agent_(addr_ser, "OUT VN  |");
                          // We received vertex notifications, we need to
@@ -582,6 +1084,15 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                          process_vn(data, size);
                          break;
                      }
+        #ifdef CONFIG_ASYNC
+        case VN_ACK: {
+                         // Once everything we sent has arrived, the next
+                         // pre_poll may join the termination wave
+                         if (vn_unacked_ == 0) throw std::runtime_error("Unexpected vertex message ack");
+                         --vn_unacked_;
+                         break;
+                     }
+        #endif
         case SEND_UPDATES: {
                                // We are receiving a batch of updates to
                                // perform in bulk, to match in with out
@@ -592,6 +1103,21 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                                uint64_t resp_aser = *(const uint64_t*)data;
                                data += sizeof(uint64_t);
                                size_t num_updates = size/sizeof(update_t);
+                               #ifdef CONFIG_PIPELINE_BATCHES
+                               if (count_deg == 0x3) {
+                                   // OUT edges for the next batch; the
+                                   // sender's barrier waits for our ack, so
+                                   // this batch cannot have ended yet
+                                   const update_t *staged = (const update_t*)data;
+                                   staged_in_.insert(staged_in_.end(), staged, staged+num_updates);
+
+                                   char msg[sizeof(msg_type_t)];
+                                   char *msg_ptr = msg;
+                                   pack_msg(msg_ptr, ACK_STAGED);
+                                   get_requester(resp_aser).send(msg, sizeof(msg));
+                                   break;
+                               }
+                               #endif
                                for (size_t ctr = 0; ctr < num_updates; ++ctr) {
                                    update_t u = ((const update_t*)data)[ctr];
                                    if (count_deg == 0x2) {
@@ -608,6 +1134,13 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                                        }
                                        if (!found) throw std::runtime_error("R Check failed; edge not found");
                                    } else {
+                                       #ifdef CONFIG_LIVE_MIGRATION
+                                       // Copies wait until our batch ends
+                                       if (count_deg == 0x4 && hold_ring()) {
+                                           handoff_in_.push_back(u);
+                                           continue;
+                                       }
+                                       #endif
                                        change_edge(u, count_deg == 0x1);
                                    }
                                }
@@ -615,9 +1148,13 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                                // Offload any new moves
                                send_move_edges();
 
-                               // Send back the acknowledgement
-                               char msg[sizeof(msg_type_t)];
-                               *(msg_type_t*)msg = ACK_UPDATES;
+                               // Send back the acknowledgement, naming
+                               // ourselves so moves can be windowed
+                               char msg[sizeof(msg_type_t)+sizeof(addr_ser)+sizeof(count_deg)];
+                               char *msg_ptr = msg;
+                               pack_msg(msg_ptr, ACK_UPDATES);
+                               pack_single(msg_ptr, addr_ser);
+                               pack_single(msg_ptr, count_deg);
                                ZMQRequester &req = get_requester(resp_aser);
                                req.send(msg, sizeof(msg));
                                break;
@@ -630,12 +1167,42 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                             break;
                         }
         case DO_VA: {
+                        #ifdef CONFIG_VA_BALANCE
+                        set_vagents(data, size);
+                        #else
                         balance_va();
+                        #endif
                         break;
                     }
         case ACK_UPDATES: {
                                 // Check if we are at the right count for
                                 // updates
+                                uint64_t acker;
+                                uint8_t flag;
+                                unpack_single(data, acker);
+                                unpack_single(data, flag);
+                                #ifdef CONFIG_LIVE_MIGRATION
+                                if (flag == 0x0 || flag == 0x4) {
+                                    move_queue_t &q = (flag == 0x0) ? moves : copies_;
+                                #else
+                                if (flag == 0x0) {
+                                    move_queue_t &q = moves;
+                                #endif
+                                    // A chunk of moves arrived, so send
+                                    // the next one
+                                    auto inflight_it = q.inflight.find(acker);
+                                    if (inflight_it != q.inflight.end()) {
+                                        if (--inflight_it->second == 0)
+                                            q.inflight.erase(inflight_it);
+                                        send_move_chunks(q, acker, flag);
+                                    }
+                                }
+                                #ifdef CONFIG_LIVE_MIGRATION
+                                if (flag == 0x4) {
+                                    if (copy_acks_counted_ == 0) break;
+                                    --copy_acks_counted_;
+                                }
+                                #endif
                                 debug_agent_(addr_ser, "GOTACK  | ", update_acks_needed_);
                                 if (--update_acks_needed_ != 0) break;
 
@@ -644,6 +1211,7 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                                 if (state_ == WAIT_EDGE_MOVE) {
                                     move_timer_.tock();
                                     info_agent_(addr_ser, "MOVED T | ", move_timer_, " =", time(NULL), "=");
+                                    if (stats_) stats_->move_time = stats_->move_time + move_timer_.get_time().count();
                                     move_timer_.reset();
                                     state_ = IDLE;
                                     break;
@@ -653,10 +1221,23 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
 
                                 break;
                           }
+        #ifdef CONFIG_PIPELINE_BATCHES
+        case ACK_STAGED: {
+                                // Staged edges only hold up joining the
+                                // barrier
+                                if (--staged_acks_needed_ == 0 && state_ == JOIN_BARRIER)
+                                    pre_poll();
+                                break;
+                          }
+        #endif
         case UPDATE_EDGES: {
                                // We are receiving edges to update in bulk
                                // Set them all appropriately
                                size_t num_updates = size/sizeof(update_t);
+                               #ifdef CONFIG_FLOW_CONTROL
+                               credits_outstanding_ -= std::min(credits_outstanding_, num_updates);
+                               credits_used_ = true;
+                               #endif
                                for (size_t ctr = 0; ctr < num_updates; ++ctr) {
                                    update_t u = ((const update_t*)data)[ctr];
                                    if (state_ == NO_PROCESS)
@@ -705,7 +1286,19 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                               // Make sure this is the right batch
                               batch_t have_update_batch;
                               unpack_batch(data, have_update_batch);
+                              #ifdef CONFIG_LIVE_MIGRATION
+                              // An agent that joined a running cluster
+                              // takes up its batches
+                              if (batch_ == 0) batch_ = have_update_batch;
+                              #endif
                               if (have_update_batch != batch_) throw std::runtime_error("Received wrong batch have update from directory");
+                              #ifdef CONFIG_EDGE_WINDOW
+                              // The directory's clock, shared by every
+                              // agent's expiry
+                              timestamp_t have_update_ts;
+                              unpack_single(data, have_update_ts);
+                              window_now_ = std::max(window_now_, have_update_ts);
+                              #endif
 
                               finalize_graph_batch();
                               break;
@@ -790,7 +1383,7 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                                 // zero, it exists elsewhere)
                                 graph_[v].vertex = v;
                                 graph_[v].self = addr_ser;
-                                auto reps = ch_.find(v);
+                                auto reps = route_ch().find(v);
                                 for (auto & rep : reps) {
                                     uint64_t agent_ser;
                                     aid_t aid;
@@ -802,10 +1395,22 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                             #ifdef CONFIG_LBSP
                             alg_.set_rep_active(graph_[v], rep);
                             #endif
+                            #ifdef CONFIG_ASYNC
+                            if (graph_[v].local.state == ACTIVE)
+                                active_.insert(v);
+                            #endif
                         }
+                        #ifdef CONFIG_ASYNC
+                        vn_dirty_ = true;
+                        ack_vn(src_agent);
+                        #endif
                         break;
                     }
         case NV: {
+                     #ifdef CONFIG_LIVE_MIGRATION
+                     // Agents that joined mid-batch are not part of it
+                     if (state_ == NO_PROCESS) break;
+                     #endif
                      // We are ready to enter the processing step
                      // First, extract and set the global nV/nE values
                      global_nV_ = *(size_t*)data;
@@ -816,8 +1421,12 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
 
                      update_timer_.tock();
                      info_agent_(addr_ser, "UPDATE  | ", update_timer_);
+                     if (stats_) stats_->update_time = stats_->update_time + update_timer_.get_time().count();
 
                      batch_timer_.tick();
+                     #ifdef CONFIG_AUTOSCALE
+                     batch_sent_start_ = thread_traffic.sent;
+                     #endif
 
                      // Setup the iteration state variables
                      #ifdef CONFIG_BSP
@@ -831,6 +1440,10 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                      vn_remaining_.push_back(0);
 
                      ss_timer_.tick();
+                     #ifdef CONFIG_VA_BALANCE
+                     busy_timer_.reset();
+                     busy_timer_.tick();
+                     #endif
 
                      if (state_ == NO_PROCESS) {
                         state_ = JOIN_BARRIER;
@@ -851,6 +1464,10 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                                         throw std::runtime_error("Simple sync from unknown state");
                                }
         case SYNC: {
+                       #ifdef CONFIG_LIVE_MIGRATION
+                       // Agents that joined mid-batch are not part of it
+                       if (state_ == NO_PROCESS || state_ == IDLE) break;
+                       #endif
                        if (state_ != WAIT_FOR_SYNC) { info_agent_(addr_ser, "Unknown control flow: ", state_); throw std::runtime_error("Unknown control flow"); }
                        size_t global_num_active = *(size_t*)data;
                        debug_agent_(addr_ser, "SYNC    | ", global_num_active);
@@ -858,18 +1475,46 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                            ss_timer_.tock();
                            info_agent_(addr_ser, "SUP STP | ", ss_timer_);
 
+                           #ifdef CONFIG_QUERY_SNAPSHOT
+                           publish_snapshot();
+                           #endif
+
                            // Clear out the batch memory being used
                            clear_batch_mem();
 
                            state_ = IDLE;
                            batch_timer_.tock();
+                           #ifdef CONFIG_VA_BALANCE
+                           batch_busy_ = busy_timer_.get_time().count();
+                           #endif
+                           #ifdef CONFIG_AUTOSCALE
+                           batch_bytes_ = thread_traffic.sent-batch_sent_start_;
+                           #endif
                            // Increase our batch number
                            ++batch_;
                            info_agent_(addr_ser, "B TIME  | ", batch_timer_);
+                           #ifdef CONFIG_CHECKPOINT
+                           if (batch_ % CHECKPOINT_BATCHES == 0)
+                               checkpoint();
+                           #endif
+                           #ifdef CONFIG_LIVE_MIGRATION
+                           if (ring_held() || handoff_out_.size() > 0 || handoff_in_.size() > 0)
+                               handoff();
+                           #endif
+                           if (stats_) {
+                               stats_->batch_time = stats_->batch_time + batch_timer_.get_time().count();
+                               ++stats_->batches;
+                           }
 
                            // Now, check if we have any updates queued up
                            // If so, we need to begin the next batch now
+                           #ifdef CONFIG_PIPELINE_BATCHES
+                           bool staged = staged_.size() > 0;
+                           apply_staged();
+                           if (update_set_.size() > 0 || staged)
+                           #else
                            if (update_set_.size() > 0)
+                           #endif
                                start_leaving_idle();
                        } else {
                            // It is not a new batch, we need to continue
@@ -883,6 +1528,9 @@ bool Agent::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t
                            find_agent_t.reset();
                            #endif
                            ss_timer_.tick();
+                           #ifdef CONFIG_VA_BALANCE
+                           busy_timer_.tick();
+                           #endif
                            state_ = PROCESS;
                            // Move everyone that was dormant to be procesesed
                            move_dormant_active();
@@ -911,14 +1559,8 @@ void Agent::send_out_edges(bool check) {
 
     if (!check) {
         // Remove multi-edges
-        for (auto &ve : graph_) {
-            auto &in = ve.second.in_neighbors;
-
-            std::sort(in.begin(), in.end());
-            auto last_in = std::unique(in.begin(), in.end());
-            nE_ -= in.end() - last_in;
-            in.erase(last_in, in.end());
-        }
+        for (auto &ve : graph_)
+            nE_ -= remove_multi_edges(ve.second);
     }
 
     absl::flat_hash_map<uint64_t, std::vector<update_t> > updates_to_send;
@@ -929,11 +1571,9 @@ void Agent::send_out_edges(bool check) {
     std::vector<update_t> my_insertions;
 
     for (auto &ve : graph_) {
-        for (auto &n : ve.second.in_neighbors) {
+        for (size_t idx = 0; idx < ve.second.in_neighbors.size(); ++idx) {
             // Register the appropriate edge to send out to
-            edge_t e;
-            e.src = n;
-            e.dst = ve.second.vertex;
+            edge_t e = stored_edge(ve.second, IN, idx);
             uint64_t agent_dst = find_agent(e, OUT, true, 0, dummy);
             update_t u;
             u.e = e;
@@ -1014,6 +1654,9 @@ void Agent::send_out_edges(bool check) {
 #ifdef CONFIG_AUTOSCALE
 void Agent::track_query_rate() {
     query_rate_t_.tock();
+    #ifdef CONFIG_QUERY_THREADS
+    query_count_ += thread_query_count_.exchange(0);
+    #endif
     query_rate_ = query_count_/query_rate_t_.get_time().count();
     query_count_ = 0;
     query_rate_t_.tick();
@@ -1023,18 +1666,40 @@ void Agent::track_query_rate() {
         info_agent_(addr_ser, "THRESH  |");
     #endif
         // Report up
-        size_t msg_size = sizeof(msg_type_t)+sizeof(uint64_t)+sizeof(double);
+        agent_metrics_t metrics;
+        metrics.query_rate = query_rate_;
+        metrics.superstep_time = ss_timer_.get_time().count();
+        metrics.batch_time = batch_timer_.get_time().count();
+        metrics.batch_bytes = batch_bytes_;
+        metrics.rss = resident_bytes();
+        metrics.nE = nE_;
+        metrics.pending = update_set_.size();
+        metrics.batch = batch_;
+
+        size_t msg_size = sizeof(msg_type_t)+sizeof(uint64_t)+sizeof(agent_metrics_t);
         char msg[msg_size];
         char *msg_ptr = msg;
 
         pack_msg_agent(msg_ptr, AS_QUERY, addr_ser, vagent_count_);
-        pack_single(msg_ptr, query_rate_);
+        pack_single(msg_ptr, metrics);
 
         d_req_.send(msg, msg_size);
     #ifdef SEND_ONLY_THRESHOLD
     }
     #endif
 }
+
+#endif
+
+#if defined(CONFIG_AUTOSCALE) || defined(CONFIG_FLOW_CONTROL)
+uint64_t Agent::resident_bytes() const {
+    // The second field of statm is the resident set, in pages
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (!(statm >> size >> resident)) return 0;
+    size_t local_agents = std::max<size_t>(local_max-local_base, 1);
+    return resident*sysconf(_SC_PAGESIZE)/local_agents;
+}
 #endif
 
 bool Agent::heartbeat() {
@@ -1062,6 +1727,24 @@ bool Agent::heartbeat() {
     track_query_rate();
     #endif
 
+    #ifdef CONFIG_VA_BALANCE
+    report_load();
+    #endif
+
+    #ifdef CONFIG_CHECKPOINT
+    reap_checkpoint(false);
+    #endif
+
+    if (stats_) stats_->nE.store(nE_, std::memory_order_relaxed);
+
+    #ifdef CONFIG_FLOW_CONTROL
+    // Streamers use credits immediately, so reclaim any that went unused
+    // for a whole heartbeat (e.g., the streamer exited)
+    if (!credits_used_)
+        credits_outstanding_ = 0;
+    credits_used_ = false;
+    #endif
+
     // Print out our current number of vertices and edges
     info_agent_(addr_ser,
             "HRTBEAT | ",
@@ -1085,12 +1768,140 @@ bool Agent::heartbeat() {
             " it=", it_,
             " amn=", agent_msgs_needed_[it_+1],
             #endif
-            " uan=", update_acks_needed_
+            " uan=", update_acks_needed_,
+            " mq=", moves.queued
+            #ifdef CONFIG_LIVE_MIGRATION
+            , " cq=", copies_.queued
+            #endif
             );
 
     return true;
 }
 
+#ifdef CONFIG_QUERY_SNAPSHOT
+bool Agent::snapshot_answer(const QuerySnapshot &snapshot, vertex_t v, char *resp_data) {
+    auto snap_it = snapshot.index.find(v);
+    if (snap_it == snapshot.index.end()) return false;
+    std::memcpy(resp_data, &snapshot.values[snap_it->second], alg_.query_resp_size());
+    return true;
+}
+#endif
+
+void Agent::answer_query(vertex_t v, char *resp_data) {
+    #ifdef CONFIG_QUERY_SNAPSHOT
+    // Answer from the last completed batch, as values mid-batch may be
+    // from an unfinished iteration.  Vertices that arrived since then are
+    // answered directly once the graph is at rest.
+    auto snapshot = std::atomic_load(&snapshot_);
+    if (snapshot && snapshot_answer(*snapshot, v, resp_data))
+        return;
+    if (state_ != IDLE && state_ != NO_PROCESS) {
+        alg_.query(resp_data);
+        return;
+    }
+    #endif
+    auto v_it = graph_.find(v);
+    if (v_it != graph_.end())
+        alg_.query(resp_data, v_it->second);
+    else
+        alg_.query(resp_data);
+}
+
+void Agent::answer_aggregate(const char *data) {
+    uint8_t kind;
+    uint64_t param, dir_ser, id;
+    unpack_single(data, kind);
+    unpack_single(data, param);
+    unpack_single(data, dir_ser);
+    unpack_single(data, id);
+
+    // Visit the values QUERY would return, with each vertex visited by
+    // only one agent
+    auto for_each_value = [&](auto &&f) {
+        auto visit = [&](vertex_t v, const char *d) {
+            #ifdef CONFIG_CS
+            if (count_agent_reps(v) > 0 && !primary_replica(v)) return;
+            #endif
+            f(v, d);
+        };
+        #ifdef CONFIG_QUERY_SNAPSHOT
+        auto snapshot = std::atomic_load(&snapshot_);
+        if (snapshot) {
+            for (auto & [v, pos] : snapshot->index)
+                visit(v, &snapshot->values[pos]);
+            return;
+        }
+        if (state_ != IDLE && state_ != NO_PROCESS) return;
+        #endif
+        std::vector<char> buf(alg_.query_resp_size());
+        for (auto & [v, gv] : graph_) {
+            alg_.query(buf.data(), gv);
+            visit(v, buf.data());
+        }
+    };
+
+    // The reply names the query and us, followed by the partial result
+    std::vector<char> resp(sizeof(msg_type_t)+sizeof(id)+sizeof(addr_ser));
+    char *resp_ptr = resp.data();
+    pack_msg(resp_ptr, AGG_PART);
+    pack_single(resp_ptr, id);
+    pack_single(resp_ptr, addr_ser);
+    auto append = [&](const auto &res) {
+        const char *res_data = (const char*)res.data();
+        resp.insert(resp.end(), res_data, res_data+res.size()*sizeof(res[0]));
+    };
+
+    if (kind == AGG_TOP_K) {
+        aggregate::TopK top(param);
+        for_each_value([&](vertex_t v, const char *d) {
+                double value = alg_.query_value(d);
+                if (std::isfinite(value)) top.push(v, value);
+            });
+        append(top.sorted());
+    } else if (kind == AGG_GROUP_SIZES) {
+        // Groups are counted by their exact value, and the directory
+        // forms the sizes once merged
+        aggregate::group_counts_t counts;
+        size_t key_size = std::min(alg_.query_resp_size(), sizeof(uint64_t));
+        for_each_value([&](vertex_t v, const char *d) {
+                uint64_t key = 0;
+                std::memcpy(&key, d, key_size);
+                ++counts[key];
+            });
+        append(aggregate::groups(counts));
+    } else {
+        aggregate::counts_t counts;
+        if (kind == AGG_VALUE_HIST) {
+            for_each_value([&](vertex_t v, const char *d) { ++counts[alg_.query_value(d)]; });
+        } else if (kind == AGG_DEGREE_HIST) {
+            // With replication, this is the primary replica's degree
+            for (auto & [v, gv] : graph_) {
+                #ifdef CONFIG_CS
+                if (count_agent_reps(v) > 0 && !primary_replica(v)) continue;
+                #endif
+                ++counts[(double)(param == 0 ? gv.out_neighbors.size() : gv.in_neighbors.size())];
+            }
+        } else
+            throw std::runtime_error("Unknown aggregate query");
+        append(aggregate::buckets(counts));
+    }
+
+    get_requester(dir_ser).send(resp.data(), resp.size());
+}
+
+#ifdef CONFIG_CS
+bool Agent::primary_replica(vertex_t v) {
+    uint64_t primary = -1;
+    for (auto & rep : route_ch().find(v)) {
+        uint64_t agent_ser;
+        aid_t aid;
+        unpack_agent(rep, agent_ser, aid);
+        primary = std::min(primary, agent_ser);
+    }
+    return primary == addr_ser;
+}
+#endif
+
 void Agent::save() {
     // Save the current results in a text format to disk
     timer::Timer t("save_timer");
@@ -1189,7 +2000,11 @@ void Agent::dump() {
             of << v;
             of << " " << ve.in_neighbors.size();
             of << " " << ve.out_neighbors.size();
+            #ifdef CONFIG_HUB_LIST
+            of << " " << hubs_.query(v);
+            #else
             of << " " << cms.query(v);
+            #endif
             of << " " << rm_.query(v);
             of << " " << rm_.sk_query(v);
             of << " " << count_agent_reps(v);
@@ -1202,6 +2017,33 @@ void Agent::dump() {
     #endif
 }
 
+#ifdef CONFIG_QUERY_SNAPSHOT
+void Agent::publish_snapshot() {
+    // Replicas are included: once a batch completes their values have
+    // been merged, the same as what save() writes out
+    std::shared_ptr<QuerySnapshot> snap = std::move(spare_snapshot_);
+    if (!snap) snap = std::make_shared<QuerySnapshot>();
+
+    size_t resp_size = alg_.query_resp_size();
+    snap->batch = batch_;
+    snap->index.clear();
+    snap->index.reserve(graph_.size());
+    snap->values.resize(graph_.size()*resp_size);
+
+    size_t pos = 0;
+    for (auto & [v, gv] : graph_) {
+        snap->index[v] = pos;
+        alg_.query(&snap->values[pos], gv);
+        pos += resp_size;
+    }
+
+    auto old = std::atomic_exchange(&snapshot_, std::shared_ptr<const QuerySnapshot>(std::move(snap)));
+    // Keep the old buffers only if no reader holds them
+    if (old && old.use_count() == 1)
+        spare_snapshot_ = std::const_pointer_cast<QuerySnapshot>(old);
+}
+#endif
+
 void Agent::start_leaving_idle() {
     // If we have already started leaving idle, do not continue spamming
     // the directory
@@ -1221,7 +2063,11 @@ void Agent::done_waiting_ready_nv_ne() {
     // and ready to share our nV and nE update
     // values, because those only depend on IN
     // and we will not receive any more
+    #ifndef CONFIG_EDGE_WINDOW
     char msg[pack_msg_unv_une_size];
+    #else
+    char msg[pack_msg_unv_une_size+sizeof(timestamp_t)];
+    #endif
     char *msg_ptr = msg;
     #ifdef CONFIG_CS
     for (auto & [v_o, lv_o] : graph_) {
@@ -1251,6 +2097,10 @@ void Agent::done_waiting_ready_nv_ne() {
         }
     }
     pack_msg_unv_une(msg_ptr, READY_NV_NE, update_nV_, update_nE_);
+    #ifdef CONFIG_EDGE_WINDOW
+    // The directory takes the newest over all agents as the next clock
+    pack_single(msg_ptr, max_timestamp_);
+    #endif
 
     d_req_.send(msg, sizeof(msg));
 
@@ -1293,6 +2143,17 @@ void Agent::finalize_graph_batch() {
 
     std::vector<update_t> my_insertions;
 
+    #ifdef CONFIG_EDGE_WINDOW
+    // Expire old edges before applying this batch, so refreshed edges
+    // are not removed
+    expire_edges(updates_to_send);
+    #endif
+
+    #ifdef CONFIG_PIPELINE_BATCHES
+    // Send on any staged edges that no longer belong to us
+    send_move_edges();
+    #endif
+
     for (auto &u : update_set_) {
         // Process this update into our graph
         change_edge(u);
@@ -1306,37 +2167,14 @@ void Agent::finalize_graph_batch() {
             // Process the OUT ourselves
             change_edge(new_u);
         } else
-            updates_to_send[agent_dst].push_back(u);
+            updates_to_send[agent_dst].push_back(new_u);
     }
     update_set_.clear();
 
     // Now, send each block of edges
-    for (auto& [agent_ser, updates] : updates_to_send) {
-        const uint8_t flag_out_edges = 0x1;
-        size_t msg_size = sizeof(msg_type_t)+sizeof(flag_out_edges)+sizeof(addr_ser)+sizeof(update_t)*updates.size();
-        ZMQRequester &req = get_requester(agent_ser);
-        #ifdef CONFIG_PREPARE_SEND
-        auto msg = req.prepare_send(msg_size);
-        char *msg_ptr = msg.edit_data();
-        #else
-        char *msg = new char[msg_size];
-        char *msg_ptr = msg;
-        #endif
-        pack_msg(msg_ptr, SEND_UPDATES);
-        pack_single(msg_ptr, flag_out_edges);
-        pack_single(msg_ptr, addr_ser);
-
-        for (auto &u : updates) {
-            pack_single(msg_ptr, u);
-        }
-
-        #ifdef CONFIG_PREPARE_SEND
-        msg.send();
-        #else
-        req.send(msg, msg_size);
-        delete [] msg;
-        #endif
-    }
+    const uint8_t flag_out_edges = 0x1;
+    for (auto& [agent_ser, updates] : updates_to_send)
+        send_updates(agent_ser, flag_out_edges, updates);
 
     // Save the confirmations required, and if there are none left then
     // progress to the ready state
@@ -1347,6 +2185,188 @@ void Agent::finalize_graph_batch() {
     debug_agent_(addr_ser, "SENDOUT | want acks:", update_acks_needed_);
 }
 
+void Agent::send_updates(uint64_t agent_ser, uint8_t flag, const std::vector<update_t> &updates) {
+    size_t msg_size = sizeof(msg_type_t)+sizeof(flag)+sizeof(addr_ser)+sizeof(update_t)*updates.size();
+    ZMQRequester &req = get_requester(agent_ser);
+    #ifdef CONFIG_PREPARE_SEND
+    auto msg = req.prepare_send(msg_size);
+    char *msg_ptr = msg.edit_data();
+    #else
+    char *msg = new char[msg_size];
+    char *msg_ptr = msg;
+    #endif
+    pack_msg(msg_ptr, SEND_UPDATES);
+    pack_single(msg_ptr, flag);
+    pack_single(msg_ptr, addr_ser);
+
+    for (auto &u : updates) {
+        pack_single(msg_ptr, u);
+    }
+
+    #ifdef CONFIG_PREPARE_SEND
+    msg.send();
+    #else
+    req.send(msg, msg_size);
+    delete [] msg;
+    #endif
+}
+
+#ifdef CONFIG_PIPELINE_BATCHES
+void Agent::stage_updates() {
+    // The OUT edges go out now, but neither side applies them until this
+    // batch ends, so computation sees an unchanged graph
+    absl::flat_hash_map<uint64_t, std::vector<update_t> > updates_to_send;
+    bool dummy;
+
+    for (auto &u : update_set_) {
+        if (!staged_.insert(u).second) continue;
+
+        uint64_t agent_dst = find_agent(u.e, OUT, true, 0, dummy);
+        update_t new_u = u;
+        new_u.et = OUT;
+
+        if (agent_dst == addr_ser)
+            staged_in_.push_back(new_u);
+        else
+            updates_to_send[agent_dst].push_back(new_u);
+    }
+    update_set_.clear();
+
+    const uint8_t flag_staged_edges = 0x3;
+    for (auto& [agent_ser, updates] : updates_to_send)
+        send_updates(agent_ser, flag_staged_edges, updates);
+    staged_acks_needed_ += updates_to_send.size();
+
+    debug_agent_(addr_ser, "STAGED  | want acks:", staged_acks_needed_);
+}
+
+void Agent::apply_staged() {
+    // Nothing computes between batches, and the moves this queues are
+    // sent once the next batch is finalized
+    for (auto &u : staged_)
+        change_edge(u);
+    for (auto &u : staged_in_)
+        change_edge(u);
+    staged_.clear();
+    std::vector<update_t>().swap(staged_in_);
+}
+#endif
+
+#ifdef CONFIG_EDGE_WINDOW
+void Agent::expire_edges(absl::flat_hash_map<uint64_t, std::vector<update_t>> &updates_to_send) {
+    // Every agent expires against the directory's clock, not its own
+    if (window_now_ < CONFIG_EDGE_WINDOW) return;
+    timestamp_t cutoff = window_now_ - CONFIG_EDGE_WINDOW;
+
+    // Group the expired edges by the vertex storing them, so each
+    // vertex's in-edges are scanned once however many expire
+    absl::flat_hash_map<vertex_t, absl::flat_hash_map<std::pair<vertex_t, timestamp_t>, uint32_t>> by_dst;
+    expiry_.expire(cutoff, [&](const ExpiryIndex::entry_t &ent) {
+        ++by_dst[ent.dst][{ent.src, ent.timestamp}];
+    });
+
+    size_t expired = 0;
+    std::vector<update_t> local_out;
+    for (auto & [v, ents] : by_dst) {
+        // Deletes and moves erase their entries, so the edges are here
+        auto v_it = graph_.find(v);
+        if (v_it == graph_.end()) continue;
+        VertexStorage &vs = v_it->second;
+        size_t removed = 0;
+        for (size_t idx = 0; idx < vs.in_neighbors.size() && ents.size() > 0;) {
+            auto e_it = ents.find(std::make_pair(vs.in_neighbors[idx], vs.in_timestamps[idx]));
+            if (e_it == ents.end()) {
+                ++idx;
+                continue;
+            }
+            if (--e_it->second == 0) ents.erase(e_it);
+
+            update_t u;
+            u.e = stored_edge(vs, IN, idx);
+            u.et = OUT;
+            u.insert = false;
+
+            remove_neighbor(vs, IN, idx);
+            ++removed;
+
+            // Remove the matching OUT edge as well
+            bool dummy;
+            uint64_t agent_dst = find_agent(u.e, OUT, true, 0, dummy);
+            if (agent_dst == addr_ser)
+                local_out.push_back(u);
+            else
+                updates_to_send[agent_dst].push_back(u);
+        }
+        if (removed == 0) continue;
+
+        update_nE_ -= removed;
+        nE_ -= removed;
+        expired += removed;
+        if (vs.local.state != DORMANT)
+            vs.local.state = ACTIVE;
+        if (vs.in_neighbors.size() == 0 && vs.out_neighbors.size() == 0) {
+            nV_--;
+            update_nV_ -= (vs.replicas.size() > 0) ? 1.0/vs.replicas.size() : 1.0;
+            unindex_vertex(v);
+            graph_.erase(v_it);
+        }
+    }
+    // Only once every vertex is done, as these may remove vertices
+    for (const update_t &u : local_out)
+        change_edge(u);
+
+    if (expired > 0)
+        info_agent_(addr_ser, "EXPIRED | ", expired, " before ", cutoff);
+}
+#endif
+
+#ifdef CONFIG_FLOW_CONTROL
+uint64_t Agent::grant_credits(uint64_t want) {
+    // Measure what we use; the resident set already includes every
+    // buffer, but never count less than the edges known to be buffered,
+    // as where it cannot be read
+    uint64_t used = std::max<uint64_t>(resident_bytes(), buffered_edges()*sizeof(update_t));
+    // Credited edges have not arrived, so they are not resident yet
+    used += credits_outstanding_*sizeof(update_t);
+
+    if (used >= FLOW_CONTROL_MEMORY) {
+        // Pending updates only drain with a batch, so start one rather
+        // than stalling streamers forever
+        if (state_ == IDLE && update_set_.size() > 0) {
+            start_leaving_idle();
+            return 0;
+        }
+        // Computing frees batch memory once it finishes, but nothing else
+        // will, so keep the graph loading slowly
+        if (state_ != NO_PROCESS && state_ != IDLE)
+            return 0;
+        uint64_t granted = std::min<uint64_t>(want, FLOW_CONTROL_MIN);
+        credits_outstanding_ += granted;
+        return granted;
+    }
+
+    // Leave less room while computing, when batch memory is growing
+    uint64_t headroom = (FLOW_CONTROL_MEMORY-used)/sizeof(update_t);
+    if (state_ != NO_PROCESS && state_ != IDLE)
+        headroom /= FLOW_CONTROL_BUSY_DIV;
+
+    uint64_t granted = std::min<uint64_t>(want, headroom);
+    credits_outstanding_ += granted;
+    return granted;
+}
+
+size_t Agent::buffered_edges() const {
+    size_t edges = update_set_.size() + moves.queued;
+    #ifdef CONFIG_PIPELINE_BATCHES
+    edges += staged_.size() + staged_in_.size();
+    #endif
+    #ifdef CONFIG_LIVE_MIGRATION
+    edges += copies_.queued + handoff_in_.size() + unrouted_.size();
+    #endif
+    return edges;
+}
+#endif
+
 void Agent::clear_batch_mem() {
     // Remove all leftover iteration state
     vn_.clear();
@@ -1361,6 +2381,10 @@ void Agent::clear_batch_mem() {
     it_ = -1;
     agent_msgs_needed_.clear();
     #endif
+    #ifdef CONFIG_ASYNC
+    active_.clear();
+    vn_dirty_ = false;
+    #endif
 
     num_inactive_ = 0;
     // Reset the state per the alg
@@ -1406,6 +2430,18 @@ void Agent::balance_va() {
         // Find the number of vagents to keep the highest degree
         size_t max_deg = 0;
         vertex_t arg_max_deg = (vertex_t)-1;
+        #ifdef CONFIG_HUB_LIST
+        // The hub list names the highest degree vertices, so the first
+        // one stored here avoids scanning the graph
+        for (const hub_t &h : rm_.hubs()) {
+            auto it = graph_.find(h.v);
+            if (it == graph_.end()) continue;
+            max_deg = it->second.in_neighbors.size()+it->second.out_neighbors.size();
+            arg_max_deg = h.v;
+            break;
+        }
+        if (max_deg == 0) {
+        #endif
         for (auto& [v, ve] : graph_) {
             size_t deg = ve.in_neighbors.size()+ve.out_neighbors.size();
             if (deg > max_deg) {
@@ -1413,6 +2449,9 @@ void Agent::balance_va() {
                 arg_max_deg = v;
             }
         }
+        #ifdef CONFIG_HUB_LIST
+        }
+        #endif
         info_agent_(addr_ser, " max deg=", max_deg, " v=", arg_max_deg);
 
         // Find which vagent it corresponds to
@@ -1452,3 +2491,55 @@ void Agent::balance_va() {
         info_agent_(addr_ser, "VA UPDT | no change");
     state_ = WAIT_FOR_LB;
 }
+
+#ifdef CONFIG_VA_BALANCE
+void Agent::report_load() {
+    va_load_t load;
+    load.nE = nE_;
+    load.busy_time = batch_busy_;
+    load.batch = batch_;
+
+    size_t msg_size = sizeof(msg_type_t)+sizeof(uint64_t)+sizeof(va_load_t);
+    char msg[msg_size];
+    char *msg_ptr = msg;
+
+    pack_msg_agent(msg_ptr, VA_LOAD, addr_ser, vagent_count_);
+    pack_single(msg_ptr, load);
+
+    d_req_.send(msg, msg_size);
+}
+
+void Agent::set_vagents(const char *data, size_t size) {
+    const char *end = data+size;
+    aid_t count = vagent_count_;
+    while (data < end) {
+        uint64_t target;
+        unpack_single(data, target);
+        uint64_t agent_target;
+        aid_t vagents_target;
+
+        unpack_agent(target, agent_target, vagents_target);
+        if (agent_target == addr_ser) {
+            count = vagents_target;
+            break;
+        }
+    }
+
+    // Every agent waits for the directory to settle, as with balance_va
+    if (count != vagent_count_) {
+        char msg[pack_msg_agent_size];
+        char *msg_ptr = msg;
+        pack_msg_agent(msg_ptr, AGENT_LEAVE, addr_ser, vagent_count_);
+        d_req_.send(msg, sizeof(msg));
+
+        info_agent_(addr_ser, "VA UPDT | ", vagent_count_, " -> ", count);
+        vagent_count_ = count;
+
+        msg_ptr = msg;
+        pack_msg_agent(msg_ptr, AGENT_JOIN, addr_ser, vagent_count_);
+        d_req_.send(msg, sizeof(msg));
+    } else
+        info_agent_(addr_ser, "VA UPDT | no change");
+    state_ = WAIT_FOR_LB;
+}
+#endif
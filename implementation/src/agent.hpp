@@ -24,18 +24,44 @@
 
 #ifdef CONFIG_CS
 #include "countminsketch.hpp"
+#ifdef CONFIG_HUB_LIST
+#include "spacesaving.hpp"
+#endif
+#ifdef CONFIG_COMPACT_SKETCH
+#include "compactsketch.hpp"
+#endif
+#endif
+
+#ifdef CONFIG_EDGE_WINDOW
+#include "edgewindow.hpp"
+#endif
+
+#ifdef CONFIG_AUTOSCALE
+#include "autoscale.hpp"
+#endif
+
+#ifdef CONFIG_VA_BALANCE
+#include "vabalance.hpp"
 #endif
 
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "absl/container/flat_hash_set.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/btree_set.h"
 
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <memory>
 #include <iomanip>
 
+#ifdef CONFIG_CHECKPOINT
+#include <sys/types.h>
+#endif
+
 namespace elga {
 
     extern std::mutex p_mutex;
@@ -105,6 +131,16 @@ namespace elga {
         WAIT_EDGE_MOVE
     } agent_state_t;
 
+    /** Counters an agent publishes for an in-process observer, such as
+     * the benchmark; times are summed over batches, in seconds */
+    typedef struct agent_stats {
+        std::atomic<size_t> nE {0};
+        std::atomic<size_t> batches {0};
+        std::atomic<double> update_time {0.};
+        std::atomic<double> batch_time {0.};
+        std::atomic<double> move_time {0.};
+    } agent_stats_t;
+
     /**
      * Main graph agent, which holds part of the graph in memory and
      * executes algorithms.
@@ -136,6 +172,12 @@ namespace elga {
             timer::Timer batch_timer_;
             timer::Timer update_timer_;
             timer::Timer ss_timer_;
+            #ifdef CONFIG_VA_BALANCE
+            /** Time spent computing outside of barriers this batch, and
+             * in the last batch */
+            timer::Timer busy_timer_;
+            double batch_busy_;
+            #endif
 
             /** The algorithm to run */
             Algorithm alg_;
@@ -156,6 +198,15 @@ namespace elga {
             absl::flat_hash_map<uint64_t, std::vector<VertexNotification> > out_vn_msgs;
             it_t it_;
             #endif
+            #ifdef CONFIG_ASYNC
+            /** Vertex messages we sent that are not yet acknowledged */
+            size_t vn_unacked_;
+            /** Whether vertex messages arrived since our last READY_SYNC */
+            bool vn_dirty_;
+
+            /** Acknowledge a vertex message from the given agent */
+            void ack_vn(uint64_t src_agent);
+            #endif
 
             /** Contains the number of virtual agents */
             aid_t vagent_count_;
@@ -172,14 +223,93 @@ namespace elga {
             /** Keep track of the number of update acks that are needed */
             int32_t update_acks_needed_;
 
+            #ifdef CONFIG_PIPELINE_BATCHES
+            /** Next-batch updates whose OUT edges were sent while computing */
+            absl::flat_hash_set<update_t> staged_;
+            /** OUT edges for the next batch, applied when this one ends */
+            std::vector<update_t> staged_in_;
+            /** Staged OUT edges that have not yet been acknowledged; we
+             * join the barrier only once they are all held */
+            int32_t staged_acks_needed_;
+
+            /** Send the OUT edges of queued updates, to be applied at the
+             * next batch */
+            void stage_updates();
+
+            /** Apply every staged edge once the batch ends, ahead of the
+             * next batch's nV/nE report */
+            void apply_staged();
+            #endif
+
+            #ifdef CONFIG_QUERY_SNAPSHOT
+            /** Query results as of the end of a batch */
+            struct QuerySnapshot {
+                batch_t batch;
+                absl::flat_hash_map<vertex_t, size_t> index;
+                std::vector<char> values;
+            };
+            /** The published snapshot, read and replaced atomically */
+            std::shared_ptr<const QuerySnapshot> snapshot_;
+            /** The previous snapshot's buffers, reused for the next one */
+            std::shared_ptr<QuerySnapshot> spare_snapshot_;
+
+            /** Publish the results of the batch that just completed; this
+             * indexes every vertex, so it costs O(V) per batch */
+            void publish_snapshot();
+
+            /** Write v's result from a snapshot into resp_data, returning
+             * false if v is not in it */
+            bool snapshot_answer(const QuerySnapshot &snapshot, vertex_t v, char *resp_data);
+            #endif
+
+            #ifdef CONFIG_CHECKPOINT
+            /** The child writing our latest checkpoint, or 0 */
+            pid_t checkpoint_pid_;
+
+            /** Return where our checkpoint is kept */
+            std::string checkpoint_path() const;
+
+            /** Write a checkpoint of the completed batch from a forked
+             * child */
+            void checkpoint();
+
+            /** Reap the checkpoint child once it has finished, optionally
+             * waiting for it */
+            void reap_checkpoint(bool wait);
+            #endif
+
+            #ifdef CONFIG_FLOW_CONTROL
+            /** Edges streamers may send that have not yet arrived */
+            size_t credits_outstanding_;
+            /** Whether credited edges arrived since the last heartbeat */
+            bool credits_used_;
+
+            /** Grant up to want edge credits, based on our memory
+             * headroom, or FLOW_CONTROL_MIN past it while no batch can
+             * free memory */
+            uint64_t grant_credits(uint64_t want);
+
+            /** Return the number of edges held outside the graph, in
+             * pending updates, staged batches, and queued moves */
+            size_t buffered_edges() const;
+            #endif
+
             #ifdef DUMP_MSG_DIST
             /** Keep track of the number of times messages have been saved */
             size_t dump_msg_dist_count;
             #endif
 
             #ifdef CONFIG_CS
+            #ifdef CONFIG_HUB_LIST
+            /** Keep an agent-specific summary of the highest degrees */
+            SpaceSaving hubs_;
+            #elif defined(CONFIG_COMPACT_SKETCH)
+            /** Keep an agent-specific sketch, with 16-bit counters */
+            CompactCountMinSketch cms;
+            #else
             /** Keep an agent-specific sketch */
             CountMinSketch cms;
+            #endif
             bool push_sketch_;
             #endif
 
@@ -188,15 +318,127 @@ namespace elga {
             size_t last_edges_;
             #endif
 
+            /** Edges queued to move to an agent: either a whole vertex
+             * detached from the graph, or individual updates */
+            typedef struct move_block {
+                VertexStorage vs;
+                std::vector<update_t> updates;
+                /** The number of edges already sent */
+                size_t sent;
+            } move_block_t;
+
+            /** Edges to send, in order, per agent */
+            typedef struct move_queue {
+                absl::flat_hash_map<uint64_t, std::deque<move_block_t>> blocks;
+                /** Chunks sent to each agent and not yet acknowledged */
+                absl::flat_hash_map<uint64_t, size_t> inflight;
+                /** The number of edges queued */
+                size_t queued;
+            } move_queue_t;
+
             /** Maintain updates to move */
-            absl::flat_hash_map<uint64_t, std::vector<update_t>> moves;
+            move_queue_t moves;
+
+            /** Queue a single update to move */
+            void queue_move(move_queue_t &q, uint64_t agent_ser, const update_t &u);
+
+            /** Queue all of a vertex's edges to move, taking its storage */
+            void queue_move(move_queue_t &q, uint64_t agent_ser, VertexStorage &&vs);
+
+            /** Send queued edges to an agent in chunks, up to the window of
+             * unacknowledged chunks */
+            void send_move_chunks(move_queue_t &q, uint64_t agent_ser, uint8_t flag);
+
+            #ifdef CONFIG_LIVE_MIGRATION
+            /** Copies of edges we lost while the ring is held, which
+             * their new owners stage until the next batch boundary */
+            move_queue_t copies_;
+            /** Our vertices with copied edges, dropped at the handoff */
+            absl::flat_hash_set<vertex_t> handoff_out_;
+            /** Copies received while the ring is held */
+            std::vector<update_t> handoff_in_;
+            /** Edges sent to us before our first directory arrived, as
+             * when joining a running cluster */
+            std::vector<std::pair<update_t, bool>> unrouted_;
+            /** Copy acknowledgements that a batch must wait for, as they
+             * were still outstanding at a handoff */
+            size_t copy_acks_counted_;
+
+            /** Hold ring changes while a batch is underway */
+            bool hold_ring() const {
+                return state_ != NO_PROCESS && state_ != IDLE && state_ != WAIT_EDGE_MOVE &&
+                    state_ != WAIT_FOR_LB && state_ != WAIT_FOR_LB_SYNC;
+            }
+
+            /** At a batch boundary, switch to the newest ring: drop the
+             * edges copied away and install the copies received */
+            void handoff();
+            #endif
+
+            /** Our vertices with edges, ordered by their ring hash */
+            absl::btree_set<std::pair<uint64_t, vertex_t>> by_hash_;
+            /** The ring ranges we owned when edges were last moved */
+            std::vector<hash_range_t> owned_ranges_;
+            bool owned_ranges_known_;
+            #ifdef CONFIG_CS
+            /** Our vertices that were replicated when edges were last
+             * moved, whose edges may be spread over their replicas */
+            absl::flat_hash_set<vertex_t> replicated_;
+            /** The rm_version_ replicated_ was last rebuilt for */
+            uint64_t replicated_version_;
+            #endif
+
+            /** Keep by_hash_ current as vertices gain or lose all edges */
+            void index_vertex(vertex_t v) {
+                by_hash_.insert({hashing::hash(v), v});
+                #ifdef CONFIG_CS
+                if (count_agent_reps(v) > 0) replicated_.insert(v);
+                #endif
+            }
+            void unindex_vertex(vertex_t v) { by_hash_.erase({hashing::hash(v), v}); }
+
+            /** Queue the edges of v that now belong elsewhere to move,
+             * resolving each edge; if copy, they are queued as copies and
+             * kept */
+            void move_lost_edges(vertex_t v, VertexStorage &lv,
+                    size_t &lost_edges, size_t &lost_out_edges, bool copy=false);
 
             /** Keep the serialized address for debugging */
             uint64_t addr_ser;
 
+            /** Optional counters to publish, when observed in-process */
+            agent_stats_t *stats_;
+
             /** Get the owner of the given update */
             uint64_t get_owner(update_t& u);
 
+            /** Append a neighbor, along with any edge attributes */
+            void add_neighbor(VertexStorage &vs, edge_type et, const edge_t &e);
+
+            /** Remove the idx'th neighbor by swapping with the last one */
+            void remove_neighbor(VertexStorage &vs, edge_type et, size_t idx);
+
+            /** Rebuild the full edge stored at the idx'th neighbor */
+            edge_t stored_edge(const VertexStorage &vs, edge_type et, size_t idx);
+
+            /** Remove multi-edges from the IN neighbors, returning the
+             * number removed */
+            size_t remove_multi_edges(VertexStorage &vs);
+
+            #ifdef CONFIG_EDGE_WINDOW
+            /** Index the IN edges by time, for expiring old edges */
+            ExpiryIndex expiry_;
+            /** The newest timestamp seen here, reported with nV/nE */
+            timestamp_t max_timestamp_;
+            /** The newest timestamp across the cluster as of the last
+             * batch, from the directory, which defines the window */
+            timestamp_t window_now_;
+
+            /** Remove IN edges that have left the window, queueing the
+             * corresponding OUT deletions */
+            void expire_edges(absl::flat_hash_map<uint64_t, std::vector<update_t>> &updates_to_send);
+            #endif
+
             #ifdef CONFIG_LBSP
             absl::flat_hash_map<vertex_t, std::vector<vertex_t>> tmap;
             #ifdef CONFIG_TACTIVATE
@@ -214,6 +456,29 @@ namespace elga {
             size_t query_count_;
             bool dying;
             bool dead;
+            /** Bytes sent as of the start of the batch, and during the
+             * last batch */
+            uint64_t batch_sent_start_;
+            uint64_t batch_bytes_;
+            #endif
+
+            #ifdef CONFIG_QUERY_THREADS
+            /** Forwards the query socket to the query threads */
+            std::thread query_proxy_;
+            /** Answer queries from the published snapshot */
+            std::vector<std::thread> query_threads_;
+            std::atomic<bool> query_stop_;
+            #ifdef CONFIG_AUTOSCALE
+            /** Queries answered by the query threads */
+            std::atomic<size_t> thread_query_count_;
+            #endif
+
+            /** Bind the query socket and start the query threads */
+            void start_query_threads();
+            /** Stop and join the query threads */
+            void stop_query_threads();
+            /** Run a query thread, connected to the proxy at backend */
+            void query_worker(std::string backend);
             #endif
         public:
             Agent(const ZMQAddress &addr, const ZMQAddress &directory_master) :
@@ -224,6 +489,10 @@ namespace elga {
                 batch_timer_("batch"),
                 update_timer_("update"),
                 ss_timer_("superstep"),
+                #ifdef CONFIG_VA_BALANCE
+                busy_timer_("busy"),
+                batch_busy_(0.),
+                #endif
                 alg_(),
                 state_(NO_PROCESS),
                 active_(),
@@ -233,11 +502,25 @@ namespace elga {
                 #if defined(CONFIG_BSP) || defined(CONFIG_LBSP)
                 it_(-1),
                 #endif
+                #ifdef CONFIG_ASYNC
+                vn_unacked_(0),
+                vn_dirty_(false),
+                #endif
                 vagent_count_(STARTING_VAGENTS),
                 update_set_(),
                 requested_leave_idle_(false),
                 batch_(0),
                 update_acks_needed_(0),
+                #ifdef CONFIG_PIPELINE_BATCHES
+                staged_acks_needed_(0),
+                #endif
+                #ifdef CONFIG_CHECKPOINT
+                checkpoint_pid_(0),
+                #endif
+                #ifdef CONFIG_FLOW_CONTROL
+                credits_outstanding_(0),
+                credits_used_(false),
+                #endif
                 #ifdef DUMP_MSG_DIST
                 dump_msg_dist_count(0),
                 #endif
@@ -247,20 +530,58 @@ namespace elga {
                 #ifdef CONFIG_TIME_INGESTION
                 last_edges_(0),
                 #endif
+                moves(),
+                #ifdef CONFIG_LIVE_MIGRATION
+                copies_(), handoff_out_(), handoff_in_(), unrouted_(), copy_acks_counted_(0),
+                #endif
+                owned_ranges_known_(false),
+                #ifdef CONFIG_CS
+                replicated_version_(0),
+                #endif
                 addr_ser(addr_.serialize()),
+                stats_(nullptr),
+                #ifdef CONFIG_EDGE_WINDOW
+                expiry_(std::max<timestamp_t>(1, CONFIG_EDGE_WINDOW/EDGE_WINDOW_BUCKETS), EDGE_WINDOW_BUCKETS+1),
+                max_timestamp_(0), window_now_(0),
+                #endif
                 move_timer_("edgemove")
                 #ifdef CONFIG_AUTOSCALE
                 ,query_rate_t_("queryrate"),
                 query_rate_(0.0),
                 query_count_(0),
                 dying(false),
-                dead(false)
+                dead(false),
+                batch_sent_start_(0),
+                batch_bytes_(0)
+                #endif
+                #ifdef CONFIG_QUERY_THREADS
+                ,query_stop_(false)
+                #ifdef CONFIG_AUTOSCALE
+                ,thread_query_count_(0)
                 #endif
-                { }
+                #endif
+                {
+                    #ifdef CONFIG_QUERY_THREADS
+                    start_query_threads();
+                    #endif
+                }
+
+            #ifdef CONFIG_QUERY_THREADS
+            ~Agent() { stop_query_threads(); }
+            #endif
 
             /** Register ourselves with the directory */
             void register_dir();
 
+            #ifdef CONFIG_CHECKPOINT
+            /** Load our checkpoint before registering, returning false if
+             * there is none */
+            bool restore();
+            #endif
+
+            /** Publish our counters into stats while running */
+            void set_stats(agent_stats_t *stats) { stats_ = stats; }
+
             /** Handle an edge change */
             void change_edge(update_t u, bool count_deg=true);
 
@@ -276,12 +597,33 @@ namespace elga {
             /** Agent-specific pre-polling to run algorithms */
             void pre_poll();
 
+            #ifdef CONFIG_ASYNC
+            /** While computing, coalesce incoming vertex messages so each
+             * local round applies many of them */
+            size_t pull_batch() const {
+                return (state_ == PROCESS || state_ == WAIT_FOR_SYNC) ? ASYNC_PULL_BATCH : 1;
+            }
+            #endif
+
             /** Handle any heartbeat-timed work */
             bool heartbeat();
 
             /** Write out the current algorithm results to disk */
             void save();
 
+            /** Write the query result for v into resp_data */
+            void answer_query(vertex_t v, char *resp_data);
+
+            /** Send this agent's part of an aggregate query to the
+             * directory that asked */
+            void answer_aggregate(const char *data);
+
+            #ifdef CONFIG_CS
+            /** Whether this agent is the lowest of the vertex's replicas,
+             * which answers for it in aggregates */
+            bool primary_replica(vertex_t v);
+            #endif
+
             /** Write the current graph out to disk */
             void dump();
 
@@ -303,6 +645,9 @@ namespace elga {
             /** Move edges that do not belong */
             void send_move_edges();
 
+            /** Send a block of edge updates to the given agent */
+            void send_updates(uint64_t agent_ser, uint8_t flag, const std::vector<update_t> &updates);
+
             /** Process the graph update queue and create updates to form
              * corresponding edges */
             void finalize_graph_batch();
@@ -322,12 +667,27 @@ namespace elga {
             #endif
 
             #ifdef CONFIG_AUTOSCALE
-            /** Keep track of query rates */
+            /** Keep track of query rates and report our metrics */
             void track_query_rate();
             #endif
 
+            #if defined(CONFIG_AUTOSCALE) || defined(CONFIG_FLOW_CONTROL)
+            /** Return our resident memory, as an even share of the
+             * process's among its agents */
+            uint64_t resident_bytes() const;
+            #endif
+
             /** Balance virtual agent counts */
             void balance_va();
+
+            #ifdef CONFIG_VA_BALANCE
+            /** Report our load to the directory for balancing */
+            void report_load();
+
+            /** Take our count from a balancing plan of packed agents and
+             * new counts, re-joining if it changed */
+            void set_vagents(const char *data, size_t size);
+            #endif
     };
 
 }
@@ -0,0 +1,230 @@
+/**
+ * ElGA asynchronous agent implementation
+ *
+ * Monotone algorithms (WCC, BFS, k-core) only ever lower vertex values,
+ * so vertices may be processed as soon as a neighbor's value arrives.
+ * Each batch begins with one counted round, where every vertex runs and
+ * every agent sends its messages (even if empty) to every other agent.
+ * Afterwards, only active vertices run and only non-empty messages are
+ * sent, with each one acknowledged by its receiver.
+ *
+ * Termination uses the existing READY_SYNC/SYNC exchange as waves: an
+ * agent joins a wave once it has no active vertices and no unacknowledged
+ * messages, reporting whether it received any messages since its previous
+ * report. Agents keep processing arrivals while a wave completes. A wave
+ * where no agent received anything means nothing is in flight and nothing
+ * can become active again.
+ *
+ * Authors: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "agent.hpp"
+
+#include "pack.hpp"
+
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+using namespace elga;
+
+#ifdef CONFIG_ASYNC
+
+#ifdef CONFIG_TACTIVATE
+#error "CONFIG_ASYNC does not support CONFIG_TACTIVATE"
+#endif
+
+/** The iteration tag of the counted first round of messages */
+#define ASYNC_FIRST_IT 1
+/** The iteration tag of all later, acknowledged messages */
+#define ASYNC_IT 2
+
+void Agent::ack_vn(uint64_t src_agent) {
+    char msg[sizeof(msg_type_t)];
+    char *msg_ptr = msg;
+    pack_msg(msg_ptr, VN_ACK);
+    get_requester(src_agent).send(msg, sizeof(msg));
+}
+
+void Agent::process_vertices() {
+    bool first = it_ < 0;
+    if (first) {
+        it_ = 0;
+    } else if (agent_msgs_needed_[ASYNC_FIRST_IT] > 0) {
+        // Algorithms may need every neighbor's initial value, so wait on
+        // the first round before running anything again
+        debug_agent_(addr_ser, "WAITING ON ", agent_msgs_needed_[ASYNC_FIRST_IT]);
+        return;
+    }
+
+    vnw_t local_vn_wait(2);
+
+    #ifdef CONFIG_CS
+    absl::flat_hash_map<uint64_t, std::vector<std::tuple<it_t, vertex_t, ReplicaLocalStorage&> > > out_rep_msgs;
+    #endif
+
+    auto activate = [&](vertex_t n, VertexNotification &vn) {
+        auto n_it = graph_.find(n);
+        if (n_it == graph_.end()) return;
+        alg_.set_active(n_it->second, vn);
+        if (n_it->second.local.state == ACTIVE)
+            active_.insert(n);
+    };
+
+    auto proc_block = [&](const vertex_t & v, VertexStorage &gv) {
+        debug_agent_(addr_ser, "PRC VTX | ", gv.vertex);
+
+        VertexNotification vertex_notification {};
+        bool notify_out = false;
+        bool notify_in = false;
+        bool notify_replica = false;
+
+        gv.local.state = ACTIVE;
+
+        alg_.run(gv, global_nV_, vn_, local_vn_wait, vn_remaining_,
+                vertex_notification, notify_out, notify_in,
+                notify_replica);
+
+        // Only a neighbor's change may activate this vertex again
+        gv.local.state = INACTIVE;
+
+        if (notify_out || notify_in) {
+            vertex_notification.v = v;
+            vn_[v] = vertex_notification;
+
+            absl::flat_hash_set<uint64_t> notify_agents;
+
+            auto notify = [&](vertex_t n, uint64_t agent_dst) {
+                if (agent_dst == addr_ser)
+                    activate(n, vertex_notification);
+                else
+                    notify_agents.insert(agent_dst);
+            };
+
+            bool dummy;
+            edge_t e;
+            if (notify_out) {
+                for (const auto &n : gv.out_neighbors) {
+                    e.src = v;
+                    e.dst = n;
+                    notify(n, find_agent(e, IN, true, 0, dummy));
+                }
+            }
+            if (notify_in) {
+                for (const auto &n : gv.in_neighbors) {
+                    e.src = n;
+                    e.dst = v;
+                    notify(n, find_agent(e, OUT, true, 0, dummy));
+                }
+            }
+
+            for (const auto & agent_dst : notify_agents)
+                out_vn_msgs[agent_dst].push_back(vertex_notification);
+        }
+        #ifdef CONFIG_CS
+        if (notify_replica) {
+            it_t it = gv.local.iteration;
+            ReplicaLocalStorage & rs = gv.replica_storage[it][gv.self];
+            for (uint64_t rep_agent : gv.replicas) {
+                if (rep_agent == addr_ser) continue;
+                out_rep_msgs[rep_agent].push_back({it, v, rs});
+            }
+        }
+        #endif
+    };
+
+    auto send_out = [&](it_t it, bool all) {
+        #ifdef CONFIG_CS
+        // Replica messages are acknowledged like vertex messages
+        for (auto & [out_agent, reps] : out_rep_msgs) {
+            size_t msg_size = sizeof(msg_type_t)+reps.size()*(sizeof(ReplicaLocalStorage)+sizeof(vertex_t)+sizeof(it_t))+sizeof(uint64_t);
+            std::vector<char> msg(msg_size);
+            char *msg_ptr = msg.data();
+            pack_msg(msg_ptr, RV);
+            pack_single(msg_ptr, addr_ser);
+            for (auto & [rep_it, v, rep] : reps) {
+                pack_single(msg_ptr, rep_it);
+                pack_single(msg_ptr, v);
+                pack_single(msg_ptr, rep);
+            }
+            get_requester(out_agent).send(msg.data(), msg_size);
+            ++vn_unacked_;
+        }
+        out_rep_msgs.clear();
+        #endif
+
+        auto send_vns = [&](uint64_t agent_dst, const std::vector<VertexNotification> *vn_msgs) {
+            size_t num = vn_msgs ? vn_msgs->size() : 0;
+            size_t msg_size = sizeof(msg_type_t)+sizeof(it)+sizeof(uint64_t)+sizeof(VertexNotification)*num;
+            std::vector<char> msg(msg_size);
+            char *msg_ptr = msg.data();
+            pack_msg(msg_ptr, OUT_VN);
+            pack_single(msg_ptr, it);
+            pack_single(msg_ptr, addr_ser);
+            for (size_t idx = 0; idx < num; ++idx)
+                pack_single(msg_ptr, (*vn_msgs)[idx]);
+            get_requester(agent_dst).send(msg.data(), msg_size);
+            ++vn_unacked_;
+        };
+
+        if (all) {
+            for (const auto &agent_dst : route_real_agents()) {
+                if (agent_dst == addr_ser) continue;
+                auto vn_it = out_vn_msgs.find(agent_dst);
+                send_vns(agent_dst, vn_it == out_vn_msgs.end() ? nullptr : &vn_it->second);
+            }
+        } else {
+            for (const auto & [agent_dst, vn_msgs] : out_vn_msgs) {
+                if (vn_msgs.size() == 0) continue;
+                send_vns(agent_dst, &vn_msgs);
+            }
+        }
+        for (auto & [agent_dst, vn_msgs] : out_vn_msgs)
+            vn_msgs.clear();
+    };
+
+    if (first) {
+        debug_agent_(addr_ser, "PROCESS | first");
+        for (auto & [v, gv] : graph_)
+            proc_block(v, gv);
+        send_out(ASYNC_FIRST_IT, true);
+        agent_msgs_needed_[ASYNC_FIRST_IT] += route_real_agents().size()-1;
+    }
+
+    if (agent_msgs_needed_[ASYNC_FIRST_IT] == 0) {
+        // Run to a local fixed point, sending out each round's messages
+        // so other agents can proceed concurrently
+        std::vector<vertex_t> round;
+        while (active_.size() > 0) {
+            ++it_;
+            debug_agent_(addr_ser, "PROCESS | ", it_, " ", active_.size());
+            round.assign(active_.begin(), active_.end());
+            active_.clear();
+            // Activations before a vertex's first run are kept, as that
+            // run may ignore its neighbors
+            for (vertex_t v : round) {
+                auto v_it = graph_.find(v);
+                if (v_it == graph_.end()) continue;
+                proc_block(v, v_it->second);
+            }
+            send_out(ASYNC_IT, false);
+        }
+    }
+
+    num_dormant_ = 0;
+    num_inactive_ = graph_.size()-active_.size();
+
+    if (state_ == PROCESS && agent_msgs_needed_[ASYNC_FIRST_IT] == 0 && vn_unacked_ == 0) {
+        debug_agent_(addr_ser, "JOIN BARRIER");
+        state_ = JOIN_BARRIER;
+        pre_poll();
+    }
+}
+
+#endif
@@ -0,0 +1,281 @@
+/**
+ * ElGA agent checkpoints
+ *
+ * With CONFIG_CHECKPOINT, an agent writes a binary checkpoint at batch
+ * boundaries so it can restart without re-ingesting its edges.  A forked
+ * child writes it from a copy-on-write image of the graph, so the agent
+ * continues with the next batch immediately.  The file is written next to
+ * the final name and renamed into place, so a crash never leaves a partial
+ * checkpoint behind.
+ *
+ * The format is a header, then for each vertex its id, its local state and
+ * its IN edges (with any weights and timestamps), then a trailer.  OUT
+ * edges are not written: each is a mirror of another agent's IN edge, and
+ * a restored agent rebuilds them when leaving NO_PROCESS, exactly as after
+ * an initial load.
+ *
+ * Authors: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "agent.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace elga;
+
+#ifdef CONFIG_CHECKPOINT
+
+namespace {
+
+    const uint64_t CKPT_MAGIC = 0x54504b4341474c45ull; // "ELGACKPT"
+    const uint32_t CKPT_VERSION = 1;
+
+    /** Edge attributes stored with each edge, which must match on restore */
+    const uint32_t CKPT_FEATURES = 0
+        #ifdef CONFIG_EDGE_WEIGHTS
+        | 0x1
+        #endif
+        #ifdef CONFIG_EDGE_TIMESTAMPS
+        | 0x2
+        #endif
+        ;
+
+    typedef struct ckpt_header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t features;
+        uint64_t local_size;
+        uint64_t addr;
+        batch_t batch;
+        aid_t vagent_count;
+        uint64_t num_vertices;
+    } ckpt_header_t;
+
+    typedef struct ckpt_trailer {
+        uint64_t num_edges;
+        uint64_t magic;
+    } ckpt_trailer_t;
+
+    static_assert(std::is_trivially_copyable<LocalStorage>::value,
+            "Checkpoints copy the local storage directly");
+
+    /** Buffered writes using only system calls, which are safe in a
+     * forked child of a multi-threaded process */
+    class CheckpointWriter {
+        private:
+            int fd_;
+            size_t len_;
+            bool ok_;
+            char buf_[1<<16];
+
+            void flush() {
+                size_t off = 0;
+                while (ok_ && off < len_) {
+                    ssize_t r = ::write(fd_, buf_+off, len_-off);
+                    if (r <= 0) ok_ = false;
+                    else off += r;
+                }
+                len_ = 0;
+            }
+
+        public:
+            CheckpointWriter(int fd) : fd_(fd), len_(0), ok_(fd >= 0) { }
+
+            void put(const void *data, size_t size) {
+                const char *p = (const char*)data;
+                while (size > 0) {
+                    if (len_ == sizeof(buf_)) flush();
+                    size_t n = std::min(size, sizeof(buf_)-len_);
+                    std::copy(p, p+n, buf_+len_);
+                    len_ += n; p += n; size -= n;
+                }
+            }
+
+            template <typename T>
+            void put(const std::vector<T> &v) { put(v.data(), sizeof(T)*v.size()); }
+
+            /** Flush and sync to disk, returning whether all writes
+             * succeeded */
+            bool finish() {
+                flush();
+                if (ok_ && ::fsync(fd_) != 0) ok_ = false;
+                return ok_;
+            }
+    };
+
+    template <typename T>
+    void get(std::ifstream &in, T &x) {
+        in.read((char*)&x, sizeof(T));
+    }
+
+    template <typename T>
+    void get(std::ifstream &in, std::vector<T> &v, size_t n) {
+        v.resize(n);
+        in.read((char*)v.data(), sizeof(T)*n);
+    }
+
+}
+
+std::string Agent::checkpoint_path() const {
+    return SAVE_DIR + '/' + std::to_string(addr_ser) + ".ckpt";
+}
+
+void Agent::checkpoint() {
+    reap_checkpoint(false);
+    if (checkpoint_pid_ > 0) {
+        info_agent_(addr_ser, "CKPT    | skipped, previous still writing");
+        return;
+    }
+
+    // Everything the child needs is prepared first, as it may only use
+    // system calls
+    std::string path = checkpoint_path();
+    std::string tmp_path = path + ".tmp";
+    ckpt_header_t header = { CKPT_MAGIC, CKPT_VERSION, CKPT_FEATURES,
+        sizeof(LocalStorage), addr_ser, batch_, vagent_count_, graph_.size() };
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        info_agent_(addr_ser, "CKPT    | unable to fork");
+        return;
+    }
+    if (pid > 0) {
+        checkpoint_pid_ = pid;
+        debug_agent_(addr_ser, "CKPT    | batch ", batch_, " pid ", pid);
+        return;
+    }
+
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    CheckpointWriter w(fd);
+    w.put(&header, sizeof(header));
+    uint64_t num_edges = 0;
+    for (const auto & [v, vs] : graph_) {
+        uint64_t n_in = vs.in_neighbors.size();
+        w.put(&v, sizeof(v));
+        w.put(&vs.local, sizeof(vs.local));
+        w.put(&n_in, sizeof(n_in));
+        w.put(vs.in_neighbors);
+        #ifdef CONFIG_EDGE_WEIGHTS
+        w.put(vs.in_weights);
+        #endif
+        #ifdef CONFIG_EDGE_TIMESTAMPS
+        w.put(vs.in_timestamps);
+        #endif
+        num_edges += n_in;
+    }
+    ckpt_trailer_t trailer = { num_edges, CKPT_MAGIC };
+    w.put(&trailer, sizeof(trailer));
+
+    bool ok = w.finish();
+    if (fd >= 0) ::close(fd);
+    if (ok) ok = ::rename(tmp_path.c_str(), path.c_str()) == 0;
+    else ::unlink(tmp_path.c_str());
+    ::_exit(ok ? 0 : 1);
+}
+
+void Agent::reap_checkpoint(bool wait) {
+    if (checkpoint_pid_ <= 0) return;
+
+    int status;
+    pid_t r = ::waitpid(checkpoint_pid_, &status, wait ? 0 : WNOHANG);
+    if (r == 0) return;
+    checkpoint_pid_ = 0;
+    if (r < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        info_agent_(addr_ser, "CKPT    | failed to write ", checkpoint_path());
+}
+
+bool Agent::restore() {
+    if (state_ != NO_PROCESS || graph_.size() > 0)
+        throw std::runtime_error("Can only restore an empty agent");
+
+    timer::Timer t("restore_timer");
+    t.tick();
+
+    std::ifstream in(checkpoint_path(), std::ios::binary);
+    if (!in) return false;
+
+    ckpt_header_t header;
+    get(in, header);
+    if (!in || header.magic != CKPT_MAGIC || header.version != CKPT_VERSION)
+        throw std::runtime_error("Not an ElGA checkpoint");
+    if (header.features != CKPT_FEATURES || header.local_size != sizeof(LocalStorage))
+        throw std::runtime_error("Checkpoint is from an incompatible build");
+    if (header.addr != addr_ser)
+        throw std::runtime_error("Checkpoint is for another agent");
+
+    graph_.reserve(header.num_vertices);
+    for (uint64_t ctr = 0; ctr < header.num_vertices; ++ctr) {
+        vertex_t v;
+        get(in, v);
+        VertexStorage &vs = graph_[v];
+        vs.vertex = v;
+        get(in, vs.local);
+        uint64_t n_in;
+        get(in, n_in);
+        if (!in) break;
+        get(in, vs.in_neighbors, n_in);
+        #ifdef CONFIG_EDGE_WEIGHTS
+        get(in, vs.in_weights, n_in);
+        #endif
+        #ifdef CONFIG_EDGE_TIMESTAMPS
+        get(in, vs.in_timestamps, n_in);
+        #endif
+
+        // Count what we hold, as change_edge would have; vertices with
+        // only OUT edges are counted when those edges are rebuilt
+        if (n_in > 0) {
+            nV_++;
+            update_nV_set_.insert(v);
+            index_vertex(v);
+            if (vs.local.state != DORMANT) {
+                vs.local.state = ACTIVE;
+                #if !defined(CONFIG_BSP) && !defined(CONFIG_LBSP)
+                active_.insert(v);
+                #endif
+            }
+        }
+        #if defined(CONFIG_WCC) || defined(CONFIG_ASYNC)
+        for (vertex_t n : vs.in_neighbors)
+            tmap[n].push_back(v);
+        #endif
+        nE_ += n_in;
+        #ifdef CONFIG_EDGE_WINDOW
+        for (size_t idx = 0; idx < n_in; ++idx) {
+            expiry_.insert(vs.in_neighbors[idx], v, vs.in_timestamps[idx]);
+            max_timestamp_ = std::max(max_timestamp_, vs.in_timestamps[idx]);
+        }
+        #endif
+    }
+
+    ckpt_trailer_t trailer;
+    get(in, trailer);
+    if (!in || trailer.magic != CKPT_MAGIC || trailer.num_edges != nE_)
+        throw std::runtime_error("Truncated checkpoint");
+
+    update_nE_ += nE_;
+    vagent_count_ = header.vagent_count;
+    if (stats_) stats_->nE.store(nE_, std::memory_order_relaxed);
+    #ifdef CONFIG_QUERY_SNAPSHOT
+    // Serve the restored results until the next batch completes
+    publish_snapshot();
+    #endif
+
+    t.tock();
+    info_agent_(addr_ser, "RESTORE | batch ", header.batch, " nV ", nV_, " nE ", nE_, " ", t);
+    return true;
+}
+
+#endif
@@ -25,7 +25,7 @@
 
 using namespace elga;
 
-#ifdef CONFIG_LBSP
+#if defined(CONFIG_LBSP) && !defined(CONFIG_ASYNC)
 
 void Agent::process_vertices() {
     // Only process when all vertices are active
@@ -258,7 +258,7 @@ void Agent::process_vertices() {
     } else
         throw std::runtime_error("Error opening output file");
     #endif
-    for (const auto &agent_dst : real_agents_) {
+    for (const auto &agent_dst : route_real_agents()) {
         if (agent_dst == my_agent_ser) continue;
         if (out_vn_msgs.count(agent_dst) > 0) {
             auto& vn_msgs = out_vn_msgs[agent_dst];
@@ -304,7 +304,7 @@ void Agent::process_vertices() {
     }
 
     // Count the number of agents we expect messages from
-    agent_msgs_needed_[it+1] += num_agents_-1;
+    agent_msgs_needed_[it+1] += route_real_agents().size()-1;
     debug_agent_(addr_ser, "NEED ", agent_msgs_needed_[it+1]);
 
     // Increase the iteration counter
@@ -0,0 +1,126 @@
+/**
+ * ElGA agent query threads
+ *
+ * With CONFIG_QUERY_THREADS, QUERY and MULTI_QUERY are also served on a
+ * separate query socket.  A proxy thread forwards its requests to a pool
+ * of query threads, which answer only from the published snapshot, so
+ * they neither wait on nor touch the graph being computed on.
+ *
+ * Authors: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "agent.hpp"
+
+#include "pack.hpp"
+
+#include <string>
+
+using namespace elga;
+
+#ifdef CONFIG_QUERY_THREADS
+
+/** How often, in ms, the proxy and query threads check for a stop */
+#define QUERY_THREAD_POLL_MS 100
+
+namespace {
+
+    /** Forward one multi-part message */
+    void forward(zmq_socket_t from, zmq_socket_t to) {
+        int more;
+        do {
+            zmq_msg_t part;
+            zmq_msg_init(&part);
+            if (zmq_msg_recv(&part, from, 0) < 0) {
+                zmq_msg_close(&part);
+                return;
+            }
+            more = zmq_msg_more(&part);
+            zmq_msg_send(&part, to, more ? ZMQ_SNDMORE : 0);
+        } while (more);
+    }
+
+}
+
+void Agent::start_query_threads() {
+    std::string backend = std::string(addr_.get_local_query_str()) + "w";
+
+    zmq_socket_t front = socket_(ZMQ_ROUTER);
+    bind_(front, addr_.get_local_query_str());
+    bind_(front, addr_.get_remote_query_str());
+    zmq_socket_t back = socket_(ZMQ_DEALER);
+    bind_(back, backend.c_str());
+
+    query_proxy_ = std::thread([this, front, back]() {
+            zmq_pollitem_t polls[2];
+            polls[0] = {front, 0, ZMQ_POLLIN, 0};
+            polls[1] = {back, 0, ZMQ_POLLIN, 0};
+            while (!query_stop_) {
+                if (zmq_poll(polls, 2, QUERY_THREAD_POLL_MS) <= 0) continue;
+                if (polls[0].revents & ZMQ_POLLIN) forward(front, back);
+                if (polls[1].revents & ZMQ_POLLIN) forward(back, front);
+            }
+            zmq_close(front);
+            zmq_close(back);
+        });
+
+    for (size_t ctr = 0; ctr < QUERY_THREADS; ++ctr)
+        query_threads_.emplace_back(&Agent::query_worker, this, backend);
+}
+
+void Agent::stop_query_threads() {
+    query_stop_ = true;
+    for (auto &t : query_threads_)
+        t.join();
+    query_threads_.clear();
+    if (query_proxy_.joinable())
+        query_proxy_.join();
+}
+
+void Agent::query_worker(std::string backend) {
+    zmq_socket_t sock = socket_(ZMQ_REP);
+    if (zmq_connect(sock, backend.c_str()) != 0)
+        throw std::runtime_error("Unable to connect to the query proxy");
+
+    size_t resp_size = alg_.query_resp_size();
+    zmq_pollitem_t poll = {sock, 0, ZMQ_POLLIN, 0};
+    while (!query_stop_) {
+        if (zmq_poll(&poll, 1, QUERY_THREAD_POLL_MS) <= 0) continue;
+
+        ZMQMessage msg(sock);
+        const char *data = msg.data();
+        size_t num_vertices = 0;
+        if (msg.size() >= sizeof(msg_type_t)) {
+            msg_type_t t = unpack_msg(data);
+            if (t == QUERY || t == MULTI_QUERY)
+                num_vertices = (msg.size()-sizeof(msg_type_t))/sizeof(vertex_t);
+        }
+
+        // Vertices not in the snapshot get the default answer, as the
+        // graph belongs to the compute thread
+        auto snapshot = std::atomic_load(&snapshot_);
+        ZMQMessage resp { sock, resp_size*num_vertices };
+        char *resp_data = resp.edit_data();
+        for (size_t ctr = 0; ctr < num_vertices; ++ctr) {
+            vertex_t v;
+            unpack_single(data, v);
+            if (!snapshot || !snapshot_answer(*snapshot, v, resp_data))
+                alg_.query(resp_data);
+            resp_data += resp_size;
+        }
+        resp.send();
+
+        #ifdef CONFIG_AUTOSCALE
+        thread_query_count_ += num_vertices;
+        #endif
+    }
+
+    zmq_close(sock);
+}
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * ElGA aggregate query helpers
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "aggregate.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace elga::aggregate;
+
+namespace {
+
+    /** Order by decreasing value, then increasing vertex */
+    bool ranks_before(const ranked_t &a, const ranked_t &b) {
+        if (a.value != b.value) return a.value > b.value;
+        return a.v < b.v;
+    }
+
+}
+
+void TopK::push(vertex_t v, double value) {
+    if (k_ == 0) return;
+    ranked_t r { v, value };
+    if (heap_.size() < k_) {
+        heap_.push_back(r);
+        std::push_heap(heap_.begin(), heap_.end(), ranks_before);
+    } else if (ranks_before(r, heap_.front())) {
+        std::pop_heap(heap_.begin(), heap_.end(), ranks_before);
+        heap_.back() = r;
+        std::push_heap(heap_.begin(), heap_.end(), ranks_before);
+    }
+}
+
+std::vector<ranked_t> TopK::sorted() const {
+    std::vector<ranked_t> res(heap_);
+    std::sort(res.begin(), res.end(), ranks_before);
+    return res;
+}
+
+void elga::aggregate::merge(counts_t &counts, const bucket_t *bs, size_t n) {
+    for (size_t ctr = 0; ctr < n; ++ctr)
+        counts[bs[ctr].key] += bs[ctr].count;
+}
+
+void elga::aggregate::merge(group_counts_t &counts, const group_t *gs, size_t n) {
+    for (size_t ctr = 0; ctr < n; ++ctr)
+        counts[gs[ctr].key] += gs[ctr].count;
+}
+
+std::vector<bucket_t> elga::aggregate::buckets(const counts_t &counts) {
+    std::vector<bucket_t> res;
+    res.reserve(counts.size());
+    for (auto & [key, count] : counts)
+        res.push_back({key, count});
+    std::sort(res.begin(), res.end(), [](const bucket_t &a, const bucket_t &b) {
+            return a.key < b.key;
+        });
+    return res;
+}
+
+std::vector<group_t> elga::aggregate::groups(const group_counts_t &counts) {
+    std::vector<group_t> res;
+    res.reserve(counts.size());
+    for (auto & [key, count] : counts)
+        res.push_back({key, count});
+    return res;
+}
+
+counts_t elga::aggregate::group_sizes(const group_counts_t &value_counts) {
+    counts_t res;
+    for (auto & [value, count] : value_counts)
+        ++res[(double)count];
+    return res;
+}
+
+Merge::Merge(uint8_t kind, uint64_t param) :
+        kind_(kind), top_(kind == AGG_TOP_K ? param : 0), counts_(), groups_() {
+    if (kind > AGG_DEGREE_HIST) throw std::runtime_error("Unknown aggregate query");
+}
+
+void Merge::add(const char *data, size_t size) {
+    // Partial results are whole records of the query's kind
+    size_t rec_size = (kind_ == AGG_TOP_K) ? sizeof(ranked_t) :
+        (kind_ == AGG_GROUP_SIZES) ? sizeof(group_t) : sizeof(bucket_t);
+    if (size % rec_size != 0) throw std::runtime_error("Invalid aggregate reply");
+    size_t n = size/rec_size;
+
+    // Copy out, as message data need not be aligned
+    if (kind_ == AGG_TOP_K) {
+        std::vector<ranked_t> rs(n);
+        std::memcpy(rs.data(), data, size);
+        top_.push(rs.data(), n);
+    } else if (kind_ == AGG_GROUP_SIZES) {
+        std::vector<group_t> gs(n);
+        std::memcpy(gs.data(), data, size);
+        merge(groups_, gs.data(), n);
+    } else {
+        std::vector<bucket_t> bs(n);
+        std::memcpy(bs.data(), data, size);
+        merge(counts_, bs.data(), n);
+    }
+}
+
+std::vector<char> Merge::result() const {
+    std::vector<char> resp;
+    if (kind_ == AGG_TOP_K) {
+        auto res = top_.sorted();
+        resp.resize(res.size()*sizeof(ranked_t));
+        std::memcpy(resp.data(), res.data(), resp.size());
+    } else {
+        auto res = buckets((kind_ == AGG_GROUP_SIZES) ? group_sizes(groups_) : counts_);
+        resp.resize(res.size()*sizeof(bucket_t));
+        std::memcpy(resp.data(), res.data(), resp.size());
+    }
+    return resp;
+}
@@ -0,0 +1,109 @@
+/**
+ * ElGA aggregate query helpers
+ *
+ * Agents reduce their query values to a local top-k or histogram, and the
+ * directory merges these partial results into the single reply sent to
+ * the client.  Both sides use the helpers here so the partial and merged
+ * results share one packed format.
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#ifndef AGGREGATE_HPP
+#define AGGREGATE_HPP
+
+#include "types.hpp"
+
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+namespace elga::aggregate {
+
+    /** A vertex with its query value */
+    typedef struct ranked {
+        vertex_t v;
+        double value;
+    } ranked_t;
+
+    /** A histogram bucket */
+    typedef struct bucket {
+        double key;
+        uint64_t count;
+    } bucket_t;
+
+    /** The number of vertices with an exact query value, as vertex ids
+     * past 2^53 are not exact as doubles */
+    typedef struct group {
+        uint64_t key;
+        uint64_t count;
+    } group_t;
+
+    using counts_t = absl::flat_hash_map<double, uint64_t>;
+    using group_counts_t = absl::flat_hash_map<uint64_t, uint64_t>;
+
+    /** Keep the k vertices with the largest values */
+    class TopK {
+        private:
+            size_t k_;
+            /** A min-heap on value, so the smallest kept is replaced */
+            std::vector<ranked_t> heap_;
+
+        public:
+            TopK(size_t k) : k_(k), heap_() { heap_.reserve(k); }
+
+            /** Offer a vertex */
+            void push(vertex_t v, double value);
+
+            /** Offer a partial result */
+            void push(const ranked_t *rs, size_t n) {
+                for (size_t ctr = 0; ctr < n; ++ctr)
+                    push(rs[ctr].v, rs[ctr].value);
+            }
+
+            /** Return the kept vertices by decreasing value, with ties
+             * broken by increasing vertex */
+            std::vector<ranked_t> sorted() const;
+    };
+
+    /** Add a partial histogram into counts */
+    void merge(counts_t &counts, const bucket_t *bs, size_t n);
+    void merge(group_counts_t &counts, const group_t *gs, size_t n);
+
+    /** Return the buckets by increasing key */
+    std::vector<bucket_t> buckets(const counts_t &counts);
+
+    /** Return the groups, in no particular order */
+    std::vector<group_t> groups(const group_counts_t &counts);
+
+    /** Given the number of vertices with each value, count the number of
+     * values (e.g., components) of each size */
+    counts_t group_sizes(const group_counts_t &value_counts);
+
+    /** Merge the agents' partial results for one query */
+    class Merge {
+        private:
+            uint8_t kind_;
+            TopK top_;
+            counts_t counts_;
+            group_counts_t groups_;
+
+        public:
+            Merge(uint8_t kind, uint64_t param);
+
+            /** Add one agent's partial result */
+            void add(const char *data, size_t size);
+
+            /** Return the packed reply for the client */
+            std::vector<char> result() const;
+    };
+
+}
+
+#endif
@@ -0,0 +1,307 @@
+/**
+ * ElGA autoscaling policies
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "autoscale.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <vector>
+
+using namespace elga;
+
+void elga::add_metrics(cluster_metrics_t &m, const agent_metrics_t &a, bool first) {
+    if (first) {
+        m.agents = 0;
+        m.query_rate = m.superstep_time = 0.;
+        m.rss = m.rss_max = m.nE = m.pending = 0;
+        m.batch = a.batch;
+        m.batch_time = a.batch_time;
+        m.batch_bytes = a.batch_bytes;
+    } else if (a.batch != m.batch || m.batch_time == 0.) {
+        // Agents that did not all finish the same batch give no sample
+        m.batch = std::min(m.batch, a.batch);
+        m.batch_time = 0.;
+        m.batch_bytes = 0;
+    } else {
+        // The slowest agent sets the batch time
+        m.batch_time = std::max(m.batch_time, a.batch_time);
+        m.batch_bytes += a.batch_bytes;
+    }
+
+    ++m.agents;
+    m.query_rate += a.query_rate;
+    m.superstep_time = std::max(m.superstep_time, a.superstep_time);
+    m.rss += a.rss;
+    m.rss_max = std::max(m.rss_max, a.rss);
+    m.nE += a.nE;
+    m.pending += a.pending;
+}
+
+std::string elga::format_metrics(const cluster_metrics_t &m) {
+    std::ostringstream os;
+    os.imbue(std::locale::classic());
+    os.precision(10);
+    os << "M," << m.time << ',' << m.agents << ',' << m.max_agents << ','
+        << m.query_rate << ',' << m.superstep_time << ',' << m.batch << ','
+        << m.batch_time << ',' << m.batch_bytes << ',' << m.rss << ','
+        << m.rss_max << ',' << m.nE << ',' << m.pending;
+    return os.str();
+}
+
+bool elga::parse_metrics(const std::string &line, cluster_metrics_t &m) {
+    if (line.compare(0, 2, "M,") != 0) return false;
+
+    std::vector<std::string> fields;
+    std::istringstream is(line.substr(2));
+    std::string field;
+    while (std::getline(is, field, ','))
+        fields.push_back(field);
+    if (fields.size() != 12) return false;
+
+    try {
+        m.time = std::stoull(fields[0]);
+        m.agents = std::stoull(fields[1]);
+        m.max_agents = std::stoull(fields[2]);
+        m.query_rate = std::stod(fields[3]);
+        m.superstep_time = std::stod(fields[4]);
+        m.batch = std::stoul(fields[5]);
+        m.batch_time = std::stod(fields[6]);
+        m.batch_bytes = std::stoull(fields[7]);
+        m.rss = std::stoull(fields[8]);
+        m.rss_max = std::stoull(fields[9]);
+        m.nE = std::stoull(fields[10]);
+        m.pending = std::stoull(fields[11]);
+    } catch (std::logic_error &e) {
+        return false;
+    }
+    return true;
+}
+
+size_t QueryRatePolicy::target(const cluster_metrics_t &m) {
+    size_t target = m.query_rate / per_agent_ + 1;
+    return std::min<size_t>(target, std::max<uint64_t>(m.max_agents, 1));
+}
+
+CostModelPolicy::CostModelPolicy(double slo, double bandwidth, uint64_t mem_limit,
+        double per_agent_queries, size_t max_samples) :
+        slo_(slo), bandwidth_(bandwidth), mem_limit_(mem_limit),
+        per_agent_queries_(per_agent_queries), max_samples_(max_samples),
+        samples_(), last_batch_(0), bytes_per_edge_(0.), a_(0.), c_(0.) {
+    if (slo_ <= 0. || bandwidth_ <= 0. || per_agent_queries_ <= 0. || max_samples_ == 0)
+        throw std::runtime_error("Invalid cost model parameters");
+}
+
+double CostModelPolicy::net_time(double n, double W) const {
+    return bytes_per_edge_*W*(n-1)/(n*n)/bandwidth_;
+}
+
+void CostModelPolicy::fit() {
+    // Bytes per crossing edge, over all batches that crossed agents
+    double bytes = 0., crossing = 0.;
+    for (const sample_t &s : samples_) {
+        if (s.n < 2) continue;
+        bytes += s.bytes;
+        crossing += s.W*(s.n-1)/s.n;
+    }
+    bytes_per_edge_ = (crossing > 0.) ? bytes/crossing : 0.;
+
+    // Fit the rest, r = a x + c, with x = W/n
+    double mx = 0., mr = 0.;
+    for (const sample_t &s : samples_) {
+        mx += s.W/s.n;
+        mr += s.T-net_time(s.n, s.W);
+    }
+    mx /= samples_.size();
+    mr /= samples_.size();
+    double sxx = 0., sxr = 0., sxx0 = 0., sxr0 = 0.;
+    for (const sample_t &s : samples_) {
+        double x = s.W/s.n;
+        double r = s.T-net_time(s.n, s.W);
+        sxx += (x-mx)*(x-mx);
+        sxr += (x-mx)*(r-mr);
+        sxx0 += x*x;
+        sxr0 += x*r;
+    }
+
+    if (sxx > 1e-9*mx*mx) {
+        a_ = sxr/sxx;
+        c_ = mr-a_*mx;
+    } else {
+        // Every batch had the same work per agent, so it cannot be
+        // split from the overhead; charge it all to the work, which
+        // errs towards more agents
+        a_ = (sxx0 > 0.) ? sxr0/sxx0 : 0.;
+        c_ = 0.;
+    }
+    if (a_ < 0.) {
+        a_ = 0.;
+        c_ = mr;
+    } else if (c_ < 0.) {
+        a_ = (sxx0 > 0.) ? sxr0/sxx0 : 0.;
+        c_ = 0.;
+    }
+    a_ = std::max(a_, 0.);
+    c_ = std::max(c_, 0.);
+}
+
+/** The edges a batch works on: those stored and those pending */
+static double batch_edges(const cluster_metrics_t &m) {
+    return (double)m.nE+m.pending;
+}
+
+double CostModelPolicy::predict(const cluster_metrics_t &m, size_t n) const {
+    if (samples_.size() == 0 || n == 0) return -1.;
+    double W = batch_edges(m);
+    return a_*W/n + c_ + net_time(n, W);
+}
+
+size_t CostModelPolicy::target(const cluster_metrics_t &m) {
+    if (m.batch > last_batch_ && m.batch_time > 0. && m.agents > 0) {
+        samples_.push_back({(double)m.agents, batch_edges(m), m.batch_time, (double)m.batch_bytes});
+        if (samples_.size() > max_samples_)
+            samples_.pop_front();
+        last_batch_ = m.batch;
+        fit();
+    }
+
+    // Keep enough agents for the queries and the memory in use
+    size_t hi = std::max<uint64_t>(m.max_agents, 1);
+    size_t lo = m.query_rate / per_agent_queries_ + 1;
+    if (mem_limit_ > 0)
+        lo = std::max<size_t>(lo, (m.rss+mem_limit_-1)/mem_limit_);
+    if (lo >= hi) return hi;
+
+    if (samples_.size() == 0)
+        return std::min(std::max<size_t>(m.agents, lo), hi);
+
+    // Take the fewest agents predicted to meet the target, or else the
+    // fastest
+    size_t best = lo;
+    double best_T = std::numeric_limits<double>::max();
+    for (size_t n = lo; n <= hi; ++n) {
+        double T = predict(m, n);
+        if (T <= slo_) return n;
+        if (T < best_T) {
+            best_T = T;
+            best = n;
+        }
+    }
+    return best;
+}
+
+std::unique_ptr<ScalingPolicy> elga::make_scaling_policy(const std::string &name) {
+    std::string policy = name;
+    if (policy.size() == 0) {
+        #ifdef CONFIG_AUTOSCALE_COST
+        policy = "cost";
+        #else
+        policy = "query";
+        #endif
+    }
+
+    if (policy == "query")
+        return std::make_unique<QueryRatePolicy>(AUTOSCALE_QR_TARGET);
+    if (policy == "cost") {
+        #ifdef AUTOSCALE_MEM_LIMIT
+        uint64_t mem_limit = AUTOSCALE_MEM_LIMIT;
+        #else
+        uint64_t mem_limit = 0;
+        #endif
+        return std::make_unique<CostModelPolicy>(AUTOSCALE_BATCH_SLO,
+                AUTOSCALE_BANDWIDTH, mem_limit, AUTOSCALE_QR_TARGET,
+                AUTOSCALE_SAMPLES);
+    }
+    throw std::runtime_error("Unknown scaling policy: " + policy);
+}
+
+namespace elga::autoscale {
+
+    void print_usage() {
+        std::cout << "Usage: autoscale-sim [options] trace" << std::endl;
+    }
+
+    int print_help() {
+        std::cout << "\n"
+            "ElGA autoscaling simulation.\n"
+            "Replays the cluster metrics (M, lines) a directory printed\n"
+            "against a scaling policy, printing the policy's target and\n"
+            "predicted batch time for each as CSV, then a JSON summary.\n"
+            "Options:\n"
+            "    help : display this help message\n"
+            "    +policy P : query or cost (default from the build)\n"
+            "Traces:\n"
+            "    file : a directory's output, other lines are skipped\n"
+            << std::endl;
+        return 0;
+    }
+
+    int main(int argc, const char **argv) {
+        if (argc <= 1) { print_usage(); return 0; }
+        for (int i = 1; i < argc; ++i) {
+            if (std::string(argv[i]) == "help") {
+                print_usage();
+                return print_help();
+            }
+        }
+
+        std::string policy_name;
+        std::string fname;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "+policy") {
+                if (argc-i < 2)
+                    throw std::runtime_error("Expecting arguments");
+                policy_name = argv[++i];
+            } else {
+                fname = arg;
+            }
+        }
+        if (fname.size() == 0) { print_usage(); return 1; }
+
+        std::ifstream reader(fname);
+        if (!reader.good()) throw std::runtime_error("Unable to open " + fname);
+        auto policy = make_scaling_policy(policy_name);
+
+        std::cout.imbue(std::locale::classic());
+        std::cout << "time,agents,target,batch_s,predicted_s,predicted_target_s" << std::endl;
+
+        size_t lines = 0, changes = 0;
+        double agents_sum = 0., target_sum = 0.;
+        std::string line;
+        cluster_metrics_t m;
+        while (std::getline(reader, line)) {
+            if (!parse_metrics(line, m)) continue;
+            size_t target = policy->target(m);
+            ++lines;
+            agents_sum += m.agents;
+            target_sum += target;
+            if (target != m.agents) ++changes;
+            std::cout << m.time << ',' << m.agents << ',' << target << ','
+                << m.batch_time << ',' << policy->predict(m, m.agents) << ','
+                << policy->predict(m, target) << '\n';
+        }
+
+        std::cout << "{\n"
+            << "  \"records\": " << lines << ",\n"
+            << "  \"changes\": " << changes << ",\n"
+            << "  \"mean_agents\": " << (lines ? agents_sum/lines : 0.) << ",\n"
+            << "  \"mean_target\": " << (lines ? target_sum/lines : 0.) << "\n"
+            << "}" << std::endl;
+        return 0;
+    }
+
+}
@@ -0,0 +1,174 @@
+/**
+ * ElGA autoscaling policies
+ *
+ * Agents report their metrics to their directory every heartbeat, and the
+ * directory combines them into cluster metrics and asks a scaling policy
+ * how many agents it wants.  The query rate policy sizes the cluster for
+ * its query load.  The cost model policy fits the observed batch times to
+ * a model of compute and network time versus agent count, and picks the
+ * fewest agents predicted to meet a batch time target, while keeping
+ * enough agents for the memory in use and the query load.
+ *
+ * Directories print their cluster metrics as trace lines, which the
+ * autoscale-sim command replays against a policy offline.
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#ifndef AUTOSCALE_HPP
+#define AUTOSCALE_HPP
+
+#include "types.hpp"
+
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace elga {
+
+    /** What an agent reports each heartbeat */
+    typedef struct agent_metrics {
+        /** Queries answered per second */
+        double query_rate;
+        /** Wall time of the last superstep, in seconds */
+        double superstep_time;
+        /** Wall time of the last batch, in seconds */
+        double batch_time;
+        /** Bytes sent during the last batch */
+        uint64_t batch_bytes;
+        /** Resident memory, in bytes */
+        uint64_t rss;
+        uint64_t nE;
+        /** Updates waiting for the next batch */
+        uint64_t pending;
+        /** Batches completed */
+        batch_t batch;
+    } agent_metrics_t;
+
+    /** Metrics combined over a directory's agents */
+    typedef struct cluster_metrics {
+        /** Seconds since the epoch */
+        uint64_t time;
+        uint64_t agents;
+        /** The most agents that could be running */
+        uint64_t max_agents;
+        double query_rate;
+        /** The slowest agent's last superstep */
+        double superstep_time;
+        /** The batch all agents completed last, and its time and bytes,
+         * or zero time if agents disagree on the last batch */
+        batch_t batch;
+        double batch_time;
+        uint64_t batch_bytes;
+        uint64_t rss;
+        uint64_t rss_max;
+        uint64_t nE;
+        uint64_t pending;
+    } cluster_metrics_t;
+
+    /** Combine an agent's report into the cluster metrics */
+    void add_metrics(cluster_metrics_t &m, const agent_metrics_t &a, bool first);
+
+    /** Write and read cluster metrics as a trace line */
+    std::string format_metrics(const cluster_metrics_t &m);
+    bool parse_metrics(const std::string &line, cluster_metrics_t &m);
+
+    /** Decides how many agents to run */
+    class ScalingPolicy {
+        public:
+            virtual ~ScalingPolicy() { }
+
+            /** Return the number of agents wanted, between 1 and
+             * m.max_agents, given the latest cluster metrics */
+            virtual size_t target(const cluster_metrics_t &m) = 0;
+
+            /** Return the predicted batch time with n agents, or a
+             * negative value if there is no prediction */
+            virtual double predict(const cluster_metrics_t &m, size_t n) const { return -1.; }
+    };
+
+    /** Size the cluster for a target query rate per agent */
+    class QueryRatePolicy : public ScalingPolicy {
+        private:
+            double per_agent_;
+
+        public:
+            QueryRatePolicy(double per_agent) : per_agent_(per_agent) { }
+
+            size_t target(const cluster_metrics_t &m) override;
+    };
+
+    /**
+     * Predict batch time with n agents as
+     *
+     *     T(n) = a W/n + c + b W (n-1)/n^2 / bw
+     *
+     * where W is the edges stored and pending when the metrics are
+     * reported, both when fitting and predicting.  The last term is
+     * network time: with hashed placement, (n-1)/n of the edges cross
+     * agents and each agent sends 1/n of them, at b bytes per crossing
+     * edge, measured from the reported bytes, over bandwidth bw.  The
+     * compute rate a and overhead c are fit by least squares over recent
+     * batches.
+     */
+    class CostModelPolicy : public ScalingPolicy {
+        private:
+            typedef struct sample {
+                double n;
+                double W;
+                double T;
+                double bytes;
+            } sample_t;
+
+            double slo_;
+            double bandwidth_;
+            uint64_t mem_limit_;
+            double per_agent_queries_;
+            size_t max_samples_;
+
+            std::deque<sample_t> samples_;
+            batch_t last_batch_;
+
+            /** Bytes per crossing edge, and the fit */
+            double bytes_per_edge_;
+            double a_;
+            double c_;
+
+            void fit();
+
+            double net_time(double n, double W) const;
+
+        public:
+            /** Aim for batches within slo seconds, with bandwidth bytes/s
+             * per agent and at most mem_limit resident bytes per agent (or
+             * no limit if 0), keeping per_agent_queries queries/s per
+             * agent, and fitting to the last max_samples batches */
+            CostModelPolicy(double slo, double bandwidth, uint64_t mem_limit,
+                    double per_agent_queries, size_t max_samples);
+
+            size_t target(const cluster_metrics_t &m) override;
+            double predict(const cluster_metrics_t &m, size_t n) const override;
+
+            size_t num_samples() const { return samples_.size(); }
+    };
+
+    /** Build a policy by name, "query" or "cost", configured from the
+     * build; an empty name gives the build's default */
+    std::unique_ptr<ScalingPolicy> make_scaling_policy(const std::string &name="");
+
+    namespace autoscale {
+
+        /** Main entry point for the autoscale-sim command */
+        int main(int argc, const char **argv);
+
+    }
+
+}
+
+#endif
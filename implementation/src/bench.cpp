@@ -0,0 +1,293 @@
+/**
+ * ElGA ingestion benchmark
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "bench.hpp"
+
+#include "directory_master.hpp"
+#include "directory.hpp"
+#include "streamer.hpp"
+#include "client.hpp"
+#include "agent.hpp"
+#include "generator.hpp"
+#include "timer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <locale>
+#include <thread>
+#include <vector>
+
+using namespace elga;
+
+namespace elga::bench {
+
+    void print_usage() {
+        std::cout << "Usage: bench [options] source" << std::endl;
+    }
+
+    int print_help() {
+        std::cout << "\n"
+            "ElGA ingestion benchmark.\n"
+            "Runs a directory master, a directory, and -P agents in this\n"
+            "process, replays the source through a streamer, and prints\n"
+            "the timings as JSON.\n"
+            "Options:\n"
+            "    help : display this help message\n"
+            "    +el : the source file is an edge list\n"
+            "    +rate R : target R edges per second (default unlimited)\n"
+            "    +chunk C : send C edges per message (default 10000)\n"
+            "    +no+run : do not run a batch after ingesting\n"
+            "    +timeout S : give up after S seconds (default 600)\n"
+            "Sources:\n"
+            "    file : an edge file of insertions\n"
+            "    rmat S M seed : an R-MAT graph with 2^S vertices\n"
+            "    chunglu N M g seed : a Chung-Lu graph with exponent g\n"
+            << std::endl;
+        return 0;
+    }
+
+    /** Read all insertions from the given file */
+    std::vector<edge_t> read_edges(const std::string &fname, bool el) {
+        std::vector<edge_t> edges;
+        std::fstream reader(fname);
+        if (!reader.good()) throw std::runtime_error("Unable to open " + fname);
+        while (!reader.eof() && reader.good()) {
+            if (reader.peek() == '\r' || reader.peek() == '\n' || reader.peek() == -1) {
+                reader.get();
+            } else if (reader.peek() == '%' || reader.peek() == '#') {
+                reader.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            } else {
+                auto [e, ins] = streamer::parse_edge(reader, el);
+                if (!ins) throw std::runtime_error("The benchmark replays insertions only");
+                edges.push_back(e);
+            }
+        }
+        return edges;
+    }
+
+    template<typename Generator>
+    std::vector<edge_t> generate_edges(const Generator &gen, uint64_t M) {
+        std::vector<edge_t> edges;
+        edges.reserve(M);
+        for (uint64_t idx = 0; idx < M; ++idx)
+            edges.push_back(gen.edge(idx));
+        return edges;
+    }
+
+    int main(int argc, const char **argv, const ZMQAddress &directory_master, localnum_t num_agents) {
+        if (argc <= 1) { print_usage(); return 0; }
+        for (int i = 1; i < argc; ++i) {
+            if (std::string(argv[i]) == "help") {
+                print_usage();
+                return print_help();
+            }
+        }
+
+        bool el = false;
+        bool run = true;
+        double rate = 0.;
+        size_t chunk = 10000;
+        double timeout = 600.;
+        std::vector<edge_t> edges;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "+el") {
+                el = true;
+            } else if (arg == "+no+run") {
+                run = false;
+            } else if (arg == "+rate" || arg == "+chunk" || arg == "+timeout") {
+                if (argc-i < 2)
+                    throw std::runtime_error("Expecting arguments");
+                std::string val(argv[++i]);
+                if (arg == "+rate") rate = std::stod(val);
+                else if (arg == "+chunk") chunk = std::stoull(val);
+                else timeout = std::stod(val);
+            } else if (arg == "rmat") {
+                if (argc-i < 4)
+                    throw std::runtime_error("Expecting arguments");
+                uint32_t S = std::stoul(std::string(argv[i+1]));
+                uint64_t M = std::stoull(std::string(argv[i+2]));
+                uint64_t seed = std::stoull(std::string(argv[i+3]));
+                i += 3;
+                edges = generate_edges(generator::RMAT(S, seed), M);
+            } else if (arg == "chunglu") {
+                if (argc-i < 5)
+                    throw std::runtime_error("Expecting arguments");
+                uint64_t N = std::stoull(std::string(argv[i+1]));
+                uint64_t M = std::stoull(std::string(argv[i+2]));
+                double gamma = std::stod(std::string(argv[i+3]));
+                uint64_t seed = std::stoull(std::string(argv[i+4]));
+                i += 4;
+                edges = generate_edges(generator::ChungLu(N, gamma, seed), M);
+            } else {
+                edges = read_edges(arg, el);
+            }
+        }
+        if (chunk == 0) throw std::runtime_error("Chunk must be positive");
+
+        // Local numbers: the directory master, then the directory, then
+        // the agents
+        uint32_t ip = directory_master.get_addr();
+        auto local_addr = [ip](localnum_t ln) {
+            return ZMQAddress((((uint64_t)ln)<<32) | ip);
+        };
+        localnum_t ln_base = directory_master.get_localnum();
+
+        std::deque<agent_stats_t> stats(num_agents);
+        std::vector<std::thread> threads;
+
+        threads.emplace_back([&]() {
+                DirectoryMaster dm(directory_master);
+                dm.start();
+            });
+        threads.emplace_back([&]() {
+                Directory d(local_addr(ln_base+1), directory_master);
+                d.join_directory();
+                d.join_peers();
+                d.start();
+            });
+
+        // Agents need a registered directory to join
+        {
+            ZMQRequester dm_req(directory_master, ZMQAddress());
+            while (!global_shutdown) {
+                dm_req.send(GET_DIRECTORIES);
+                if (dm_req.read().size() > 0) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        for (localnum_t a = 0; a < num_agents; ++a) {
+            threads.emplace_back([&, a]() {
+                    Agent agent(local_addr(ln_base+2+a), directory_master);
+                    agent.set_stats(&stats[a]);
+                    agent.register_dir();
+                    agent.start();
+                });
+        }
+
+        timer::Timer total_t("bench");
+        total_t.tick();
+        auto timed_out = [&]() {
+            total_t.tock();
+            return global_shutdown || total_t.get_time().count() > timeout;
+        };
+
+        double send_s = 0., visible_s = 0., visible_lag_s = 0., batch_s = 0.;
+        size_t visible = 0;
+        {
+            Streamer s(directory_master);
+            s.wait_until_ready();
+            while (s.num_agents() < num_agents && !timed_out()) {
+                while (s.do_poll(true)) { }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            // Replay the edges at the target rate
+            timer::Timer send_t("send");
+            send_t.tick();
+            for (size_t pos = 0; pos < edges.size() && !timed_out(); pos += chunk) {
+                size_t end = std::min(pos+chunk, edges.size());
+                for (size_t idx = pos; idx < end; ++idx)
+                    s.add_edge(edges[idx]);
+                s.send_batch();
+                if (rate > 0.) {
+                    send_t.tock();
+                    double ahead = end/rate - send_t.get_time().count();
+                    if (ahead > 0.)
+                        std::this_thread::sleep_for(std::chrono::duration<double>(ahead));
+                }
+            }
+            s.drain_spills();
+            send_t.tock();
+            send_s = send_t.get_time().count();
+
+            // Wait until every edge is stored by an agent
+            auto count_visible = [&]() {
+                size_t nE = 0;
+                for (auto &st : stats) nE += st.nE.load(std::memory_order_relaxed);
+                return nE;
+            };
+            while ((visible = count_visible()) < edges.size() && !timed_out())
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            send_t.tock();
+            visible_s = send_t.get_time().count();
+            visible_lag_s = visible_s - send_s;
+        }
+
+        Client c(directory_master);
+        if (run && !timed_out()) {
+            timer::Timer batch_t("batch");
+            batch_t.tick();
+            #ifdef CONFIG_START_VTX
+            c.start_vtx(edges.size() > 0 ? edges[0].src : 0);
+            #else
+            c.query(START);
+            #endif
+            auto batches_done = [&]() {
+                for (auto &st : stats)
+                    if (st.batches.load() == 0) return false;
+                return true;
+            };
+            while (!batches_done() && !timed_out())
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            batch_t.tock();
+            batch_s = batch_t.get_time().count();
+        }
+        bool completed = !timed_out();
+
+        c.query(SHUTDOWN);
+        for (auto &t : threads)
+            t.join();
+
+        // Report the results, without locale formatting
+        std::cout.imbue(std::locale::classic());
+        double update_max = 0., batch_max = 0., move_max = 0.;
+        for (auto &st : stats) {
+            update_max = std::max(update_max, st.update_time.load());
+            batch_max = std::max(batch_max, st.batch_time.load());
+            move_max = std::max(move_max, st.move_time.load());
+        }
+        std::cout << "{\n"
+            << "  \"agents\": " << num_agents << ",\n"
+            << "  \"edges\": " << edges.size() << ",\n"
+            << "  \"target_rate\": " << rate << ",\n"
+            << "  \"chunk\": " << chunk << ",\n"
+            << "  \"completed\": " << (completed ? "true" : "false") << ",\n"
+            << "  \"send_s\": " << send_s << ",\n"
+            << "  \"ingest_eps\": " << (send_s > 0. ? edges.size()/send_s : 0.) << ",\n"
+            << "  \"visible_edges\": " << visible << ",\n"
+            << "  \"visible_s\": " << visible_s << ",\n"
+            << "  \"visible_lag_s\": " << visible_lag_s << ",\n"
+            << "  \"visible_eps\": " << (visible_s > 0. ? visible/visible_s : 0.) << ",\n"
+            << "  \"run_s\": " << batch_s << ",\n"
+            << "  \"update_s\": " << update_max << ",\n"
+            << "  \"batch_s\": " << batch_max << ",\n"
+            << "  \"move_s\": " << move_max << ",\n"
+            << "  \"per_agent\": [";
+        for (size_t a = 0; a < stats.size(); ++a) {
+            auto &st = stats[a];
+            std::cout << (a ? ", " : "") << "{\"nE\": " << st.nE.load()
+                << ", \"update_s\": " << st.update_time.load()
+                << ", \"batch_s\": " << st.batch_time.load()
+                << ", \"move_s\": " << st.move_time.load() << "}";
+        }
+        std::cout << "]\n}" << std::endl;
+
+        return completed ? 0 : 1;
+    }
+
+}
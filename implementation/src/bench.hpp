@@ -0,0 +1,32 @@
+/**
+ * ElGA ingestion benchmark
+ *
+ * This command runs a complete local cluster in one process, with the
+ * directory master, a directory, and the agents as threads, then replays
+ * an edge file or generated graph through a streamer and reports the
+ * ingestion and batch timings as JSON.
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include "types.hpp"
+#include "address.hpp"
+
+namespace elga::bench {
+
+    /** Main entry point for the bench command, using num_agents agents
+     * at local numbers following the directory master's */
+    int main(int argc, const char **argv, const ZMQAddress &directory_master, localnum_t num_agents);
+
+}
+
+#endif
@@ -22,6 +22,10 @@ using namespace elga;
 /** ZMQ specific context used globally per-process */
 void *G_zmq_context_;
 
+#ifdef CONFIG_AUTOSCALE
+thread_local traffic_t elga::thread_traffic = {0, 0};
+#endif
+
 void ZMQChatterbox::Setup(int num_threads) {
     G_zmq_context_ = zmq_ctx_new();
     if (zmq_ctx_set(G_zmq_context_, ZMQ_IO_THREADS, num_threads) != 0)
@@ -53,6 +57,9 @@ zmq_socket_t elga::socket_(int type, uint64_t affinity, bool use_buffering) {
     if (zmq_setsockopt(socket, ZMQ_BACKLOG, &backlog, sizeof(backlog)) != 0)
         throw std::runtime_error("Unable to set message backlog limit");
     int hwm = (use_buffering) ? HIGHWATERMARK : 1;
+    // Queues stay unbounded: agents send to each other from their single
+    // polling thread, so blocking on a full peer could deadlock.
+    // Streamer input is bounded by CONFIG_FLOW_CONTROL instead.
     hwm = 0;
     if (zmq_setsockopt(socket, ZMQ_SNDHWM, &hwm, sizeof(hwm)) != 0)
         throw std::runtime_error("Unable to set high water mark for sending");
@@ -164,6 +171,9 @@ void ZMQChatterbox::send(zmq_socket_t sock, const char *data, size_t size, bool
         ret = zmq_send(sock, data, size, (nowait)?0:0);
     } while (ret == -1 && errno == EAGAIN);
     if (ret < 0) { perror("ZMQChatterbox::send"); throw std::runtime_error("Unable to send"); }
+    #ifdef CONFIG_AUTOSCALE
+    thread_traffic.sent += size;
+    #endif
     #ifdef DEBUG_VERBOSE
     std::cerr << "[ElGA : ZMQChatterbox] sent : " << sock << " , " << size << std::endl;
     #endif
@@ -304,6 +314,9 @@ ZMQMessage::ZMQMessage(zmq_socket_t sock, bool block) : msg_part_(), sock_(sock)
     }
 
     if (size_ < 0) throw std::runtime_error("Unable to read message");
+    #ifdef CONFIG_AUTOSCALE
+    thread_traffic.recv += size_;
+    #endif
 
     // The message is now held up in the internal zmq_msg
     data_ = (char*)zmq_msg_data(&msg_part_);
@@ -348,4 +361,7 @@ ZMQMessage& ZMQMessage::operator=(ZMQMessage&& that) {
 void ZMQMessage::send() {
     int ret_size = zmq_msg_send(&msg_part_, sock_, 0);
     if (ret_size != size_) throw std::runtime_error("Error while sending");
+    #ifdef CONFIG_AUTOSCALE
+    thread_traffic.sent += size_;
+    #endif
 }
@@ -33,6 +33,15 @@ namespace elga {
     /** Helper function to bind to an address */
     void bind_(zmq_socket_t socket, const char *addr);
 
+    #ifdef CONFIG_AUTOSCALE
+    /** Bytes the calling thread sent and received, for autoscaling */
+    typedef struct traffic {
+        uint64_t sent;
+        uint64_t recv;
+    } traffic_t;
+    extern thread_local traffic_t thread_traffic;
+    #endif
+
     /** Handles receiving and replying to a message, as appropriate */
     class ZMQMessage {
         private:
@@ -159,6 +168,10 @@ namespace elga {
             /** Indefinitely poll for any request */
             std::vector<zmq_socket_t> poll(long timeout=2500);
 
+            /** Return true if sock is our pull socket, i.e., the message
+             * was sent directly to us */
+            bool is_pull(zmq_socket_t sock) const { return sock == sock_pull_; }
+
             /** Send out to the given socket */
             static void send(zmq_socket_t sock, const char *data, size_t size, bool nowait=false);
 
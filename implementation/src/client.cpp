@@ -14,9 +14,12 @@
 
 #include "pack.hpp"
 
+#include <cstring>
 #include <random>
 #include <iostream>
 
+#include "absl/container/flat_hash_map.h"
+
 using namespace elga;
 
 namespace elga::client {
@@ -47,7 +50,11 @@ namespace elga::client {
             "    save : save the computation results to disk\n"
             "    dump : dump the current graph to disk\n"
             "    workload : query following workloads\n"
-            "    query <vertex> : perform a vertex query\n"
+            "    query <vertex>... : perform a vertex query, batching several\n"
+            "    top <k> : list the k vertices with the largest values\n"
+            "    histogram <values|sizes|out-degree|in-degree> : count vertices\n"
+            "        by value, values by how many vertices share them (e.g.,\n"
+            "        component sizes), or vertices by degree\n"
             "    check-transpose : confirm the transpose\n"
             "    va : change virtual agent counts\n"
             "    help : display this message\n"
@@ -114,8 +121,33 @@ namespace elga::client {
             if (argc != 2) { usage_(); return help_(); }
             client.query(VA);
         } else if (query == "query") {
+            if (argc < 3) { usage_(); return help_(); }
+            if (argc == 3) {
+                client.query_vertex(std::strtoull(argv[2], NULL, 0));
+            } else {
+                std::vector<vertex_t> vs;
+                for (int i = 2; i < argc; ++i)
+                    vs.push_back(std::strtoull(argv[i], NULL, 0));
+                size_t value_size;
+                client.query_vertices(vs, value_size);
+            }
+        } else if (query == "top") {
             if (argc != 3) { usage_(); return help_(); }
-            client.query_vertex(std::strtoull(argv[2], NULL, 0));
+            std::cout.precision(15);
+            for (auto &r : client.top_k(std::strtoull(argv[2], NULL, 0)))
+                std::cout << r.v << " " << r.value << std::endl;
+        } else if (query == "histogram") {
+            if (argc != 3) { usage_(); return help_(); }
+            std::string of(argv[2]);
+            std::vector<aggregate::bucket_t> hist;
+            if (of == "values") hist = client.histogram(AGG_VALUE_HIST);
+            else if (of == "sizes") hist = client.histogram(AGG_GROUP_SIZES);
+            else if (of == "out-degree") hist = client.histogram(AGG_DEGREE_HIST, 0);
+            else if (of == "in-degree") hist = client.histogram(AGG_DEGREE_HIST, 1);
+            else throw arg_error("Unknown histogram");
+            std::cout.precision(15);
+            for (auto &b : hist)
+                std::cout << b.key << " " << b.count << std::endl;
         } else {
             throw arg_error("Unknown client command");
         }
@@ -151,12 +183,7 @@ void Client::query(msg_type_t t) {
 }
 
 void Client::workload() {
-    while (!ready_ && do_poll()) {
-        if (global_shutdown) {
-            std::cerr << "[ElGA : Client] shutting down" << std::endl;
-            return;
-        }
-    }
+    if (!wait_ready()) return;
 
     vertex_t max_v = 500000;
 
@@ -191,31 +218,184 @@ void Client::workload() {
             while (do_poll(true)) {}
         } while (time(NULL)-start < 300 && !global_shutdown);
     }
+    #ifdef CONFIG_VERTEX_CACHE
+    if (cache_)
+        std::cerr << "[ElGA : Client] cache hits: " << cache_->hits()
+            << " misses: " << cache_->misses() << std::endl;
+    #endif
 }
 
-void Client::query_vertex(vertex_t v) {
+bool Client::wait_ready() {
     while (!ready_ && do_poll()) {
         if (global_shutdown) {
             std::cerr << "[ElGA : Client] shutting down" << std::endl;
-            return;
+            return false;
         }
     }
+    return true;
+}
+
+ZMQRequester & Client::query_requester(uint64_t agent_ser) {
+    auto req_it = query_reqs_.find(agent_ser);
+    if (req_it == query_reqs_.end())
+        #ifdef CONFIG_QUERY_THREADS
+        req_it = query_reqs_.try_emplace(agent_ser, ZMQAddress(agent_ser), addr_, QUERY_REQUEST).first;
+        #else
+        req_it = query_reqs_.try_emplace(agent_ser, ZMQAddress(agent_ser), addr_).first;
+        #endif
+    return req_it->second;
+}
+
+void Client::query_vertex(vertex_t v) {
+    if (!wait_ready()) return;
     // Find the agent for this vertex
     edge_t e;
     e.src = v;
     e.dst = -1;
 
+    #ifdef CONFIG_VERTEX_CACHE
+    // Apply any completed batches before trusting the cache
+    while (do_poll(true)) { }
+    if (cache_ && cache_->find(v)) return;
+    batch_t batch = cache_ ? cache_->batch() : 0;
+    #endif
+
     bool dummy;
     auto agent = find_agent(e, OUT, false, 0, dummy);
 
-    ZMQRequester req { ZMQAddress(agent), addr_ };
+    ZMQRequester &req = query_requester(agent);
     size_t msg_size = sizeof(msg_type_t)+sizeof(vertex_t);
     char msg[msg_size];
     char* msg_ptr = msg;
     pack_msg(msg_ptr, QUERY);
-    pack_msg(msg_ptr, v);
+    pack_single(msg_ptr, v);
     req.send(msg, msg_size);
     ZMQMessage resp = req.read();
+
+    #ifdef CONFIG_VERTEX_CACHE
+    cache_answer(v, resp.data(), resp.size(), batch);
+    #endif
+}
+
+std::vector<char> Client::query_vertices(const std::vector<vertex_t> &vs, size_t &value_size) {
+    value_size = 0;
+    if (!wait_ready()) return {};
+
+    std::vector<char> res;
+
+    #ifdef CONFIG_VERTEX_CACHE
+    // Apply any completed batches before trusting the cache
+    while (do_poll(true)) { }
+    batch_t batch = cache_ ? cache_->batch() : 0;
+    if (cache_) {
+        value_size = cache_->value_size();
+        res.resize(value_size*vs.size());
+    }
+    #endif
+
+    // Group the vertices by agent, remembering where each answer goes
+    absl::flat_hash_map<uint64_t, std::vector<size_t> > agent_pos;
+    edge_t e;
+    e.dst = -1;
+    bool dummy;
+    for (size_t pos = 0; pos < vs.size(); ++pos) {
+        #ifdef CONFIG_VERTEX_CACHE
+        if (cache_) {
+            const char *value = cache_->find(vs[pos]);
+            if (value) {
+                std::memcpy(&res[pos*value_size], value, value_size);
+                continue;
+            }
+        }
+        #endif
+        e.src = vs[pos];
+        agent_pos[find_agent(e, OUT, false, 0, dummy)].push_back(pos);
+    }
+
+    // Send every request before reading, so agents answer concurrently
+    for (auto & [agent, positions] : agent_pos) {
+        size_t msg_size = sizeof(msg_type_t)+sizeof(vertex_t)*positions.size();
+        std::vector<char> msg(msg_size);
+        char* msg_ptr = msg.data();
+        pack_msg(msg_ptr, MULTI_QUERY);
+        for (size_t pos : positions)
+            pack_single(msg_ptr, vs[pos]);
+        query_requester(agent).send(msg.data(), msg_size);
+    }
+
+    for (auto & [agent, positions] : agent_pos) {
+        ZMQMessage resp = query_requester(agent).read();
+        size_t resp_value_size = resp.size()/positions.size();
+        if (value_size == 0) {
+            value_size = resp_value_size;
+            res.resize(value_size*vs.size());
+        }
+        if (resp_value_size != value_size || resp.size() != value_size*positions.size())
+            throw std::runtime_error("Invalid multi-query response");
+
+        const char *resp_data = resp.data();
+        for (size_t pos : positions) {
+            std::memcpy(&res[pos*value_size], resp_data, value_size);
+            #ifdef CONFIG_VERTEX_CACHE
+            cache_answer(vs[pos], resp_data, value_size, batch);
+            #endif
+            resp_data += value_size;
+        }
+    }
+
+    return res;
+}
+
+#ifdef CONFIG_VERTEX_CACHE
+void Client::cache_answer(vertex_t v, const char *value, size_t value_size, batch_t batch) {
+    if (!cache_) cache_ = std::make_unique<VertexCache>(VERTEX_CACHE_SIZE, value_size);
+    cache_->insert(v, value, batch);
+}
+
+bool Client::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t size) {
+    switch (t) {
+        case SYNC: {
+            size_t global_num_active = *(size_t*)data;
+            if (global_num_active == 0 && cache_) cache_->invalidate();
+            break;
+        }
+        default:
+            return false;
+    }
+    return true;
+}
+#endif
+
+std::vector<char> Client::aggregate_query(uint8_t kind, uint64_t param) {
+    auto dirs = query_directories();
+    if (dirs.size() == 0) throw std::runtime_error("No directories");
+
+    ZMQRequester req { dirs[0], addr_ };
+    size_t msg_size = sizeof(msg_type_t)+sizeof(kind)+sizeof(param);
+    char msg[msg_size];
+    char* msg_ptr = msg;
+    pack_msg(msg_ptr, AGG_QUERY);
+    pack_single(msg_ptr, kind);
+    pack_single(msg_ptr, param);
+    req.send(msg, msg_size);
+
+    ZMQMessage resp = req.read();
+    return std::vector<char>(resp.data(), resp.data()+resp.size());
+}
+
+std::vector<aggregate::ranked_t> Client::top_k(size_t k) {
+    auto resp = aggregate_query(AGG_TOP_K, k);
+    std::vector<aggregate::ranked_t> res(resp.size()/sizeof(aggregate::ranked_t));
+    std::memcpy(res.data(), resp.data(), res.size()*sizeof(aggregate::ranked_t));
+    return res;
+}
+
+std::vector<aggregate::bucket_t> Client::histogram(uint8_t kind, uint64_t param) {
+    if (kind == AGG_TOP_K) throw std::runtime_error("Not a histogram");
+    auto resp = aggregate_query(kind, param);
+    std::vector<aggregate::bucket_t> res(resp.size()/sizeof(aggregate::bucket_t));
+    std::memcpy(res.data(), resp.data(), res.size()*sizeof(aggregate::bucket_t));
+    return res;
 }
 
 void Client::handle_directory_update() {
@@ -228,7 +408,7 @@ void Client::start_vtx(vertex_t start) {
     char msg[msg_size];
     char* msg_ptr = msg;
     pack_msg(msg_ptr, START);
-    pack_msg(msg_ptr, start);
+    pack_single(msg_ptr, start);
     dm_req_.send(msg, msg_size);
     dm_req_.wait_ack();
 }
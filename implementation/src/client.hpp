@@ -16,8 +16,15 @@
 #include "types.hpp"
 
 #include <vector>
+#include <unordered_map>
 
 #include "participant.hpp"
+#include "aggregate.hpp"
+#ifdef CONFIG_VERTEX_CACHE
+#include "vertexcache.hpp"
+
+#include <memory>
+#endif
 
 namespace elga {
 
@@ -35,10 +42,44 @@ namespace elga {
     class Client : public Participant {
         private:
             ZMQRequester dm_req_;
+            /** Query connections to agents, kept across queries */
+            std::unordered_map<uint64_t, ZMQRequester> query_reqs_;
+
+            /** Return the pooled query connection to an agent */
+            ZMQRequester & query_requester(uint64_t agent_ser);
+
+            /** Wait until the directory is installed, returning false on
+             * shutdown */
+            bool wait_ready();
+
+            #ifdef CONFIG_VERTEX_CACHE
+            /** Cached vertex results, created with the first answer */
+            std::unique_ptr<VertexCache> cache_;
+
+            /** Cache an answer requested as of the given batch */
+            void cache_answer(vertex_t v, const char *value, size_t value_size, batch_t batch);
+            #endif
+
+            /** Send an aggregate query to a directory, returning the
+             * merged reply */
+            std::vector<char> aggregate_query(uint8_t kind, uint64_t param);
         public:
             /** Construct the client, pointing to the given directory */
             Client(const ZMQAddress &dm) : Participant(ZMQAddress {}, dm, true),
-                        dm_req_(dm, addr_) { }
+                        dm_req_(dm, addr_) {
+                #ifdef CONFIG_VERTEX_CACHE
+                // Completed batches invalidate the cache
+                sub(SYNC);
+                #endif
+            }
+
+            #ifdef CONFIG_VERTEX_CACHE
+            /** Handle batch completions */
+            bool handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t size);
+
+            /** Return the vertex cache, if any answer has been cached */
+            const VertexCache *cache() const { return cache_.get(); }
+            #endif
 
             /** Query and return all directory servers */
             const std::vector<ZMQAddress> query_directories();
@@ -55,6 +96,18 @@ namespace elga {
             /** Query a vertex */
             void query_vertex(vertex_t v);
 
+            /** Query many vertices, with one request per agent.
+             * Returns the values packed in the order of vs, each
+             * value_size bytes */
+            std::vector<char> query_vertices(const std::vector<vertex_t> &vs, size_t &value_size);
+
+            /** Return the k vertices with the largest values */
+            std::vector<aggregate::ranked_t> top_k(size_t k);
+
+            /** Return a cluster-wide histogram, for an AGG_*_HIST or
+             * AGG_GROUP_SIZES kind */
+            std::vector<aggregate::bucket_t> histogram(uint8_t kind, uint64_t param=0);
+
             /** Report a directory update */
             void handle_directory_update();
 
@@ -0,0 +1,146 @@
+/**
+ * ElGA compact count-min sketch
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "compactsketch.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static void put_varint(std::vector<char> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+static uint64_t get_varint(const char *&data, const char *end) {
+    uint64_t v = 0;
+    for (size_t shift = 0; data < end && shift < 64; shift += 7) {
+        uint8_t b = *data++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) return v;
+    }
+    throw std::runtime_error("Invalid compact sketch");
+}
+
+CompactCountMinSketch::CompactCountMinSketch() : data_(TABLE_SIZE, 0), overflow_() { }
+
+CompactCountMinSketch::CompactCountMinSketch(const char *data, size_t size) :
+        data_(TABLE_SIZE, 0), overflow_() {
+    update(data, size);
+}
+
+void CompactCountMinSketch::set(uint64_t i, int32_t v) {
+    if (v >= SATURATED) {
+        data_[i] = SATURATED;
+        overflow_[i] = v;
+    } else {
+        if (data_[i] == SATURATED) overflow_.erase(i);
+        data_[i] = v;
+    }
+}
+
+void CompactCountMinSketch::count(uint64_t key) {
+    query_count(key);
+}
+
+int32_t CompactCountMinSketch::query(uint64_t key) const {
+    uint64_t idx[TABLE_DEPTH];
+    CountSketch::cells(key, idx);
+    int32_t min = value(idx[0]);
+    for (uint64_t i = 1; i < TABLE_DEPTH; i++)
+        min = std::min(min, value(idx[i]));
+    return min;
+}
+
+int32_t CompactCountMinSketch::query_count(uint64_t key) {
+    uint64_t idx[TABLE_DEPTH];
+    CountSketch::cells(key, idx);
+    uint16_t min = data_[idx[0]];
+    for (uint64_t i = 1; i < TABLE_DEPTH; i++)
+        min = std::min(min, data_[idx[i]]);
+
+    if (min < SATURATED-1) {
+        // Conservative update: only counters below the new estimate rise
+        uint16_t est = min+1;
+        for (uint64_t i = 0; i < TABLE_DEPTH; i++)
+            data_[idx[i]] = std::max(data_[idx[i]], est);
+        return est;
+    }
+
+    // Every counter is saturated or about to be
+    int32_t est = value(idx[0]);
+    for (uint64_t i = 1; i < TABLE_DEPTH; i++)
+        est = std::min(est, value(idx[i]));
+    ++est;
+    for (uint64_t i = 0; i < TABLE_DEPTH; i++)
+        if (value(idx[i]) < est) set(idx[i], est);
+    return est;
+}
+
+void CompactCountMinSketch::merge(const CompactCountMinSketch &other) {
+    for (uint64_t i = 0; i < TABLE_SIZE; i++) {
+        if (other.data_[i] == 0) continue;
+        if (data_[i] == SATURATED || other.data_[i] == SATURATED ||
+                (uint32_t)data_[i]+other.data_[i] >= SATURATED)
+            set(i, value(i)+other.value(i));
+        else
+            data_[i] += other.data_[i];
+    }
+}
+
+void CompactCountMinSketch::clear() {
+    std::fill(data_.begin(), data_.end(), 0);
+    overflow_.clear();
+}
+
+void CompactCountMinSketch::serialize(std::vector<char> &out) const {
+    size_t start = out.size();
+    uint64_t next = 0;
+    for (uint64_t i = 0; i < TABLE_SIZE; i++) {
+        if (data_[i] == 0) continue;
+        put_varint(out, i-next);
+        put_varint(out, value(i));
+        next = i+1;
+    }
+    uint64_t payload = out.size()-start;
+    out.insert(out.end(), (const char*)&payload, (const char*)(&payload+1));
+}
+
+size_t CompactCountMinSketch::update(const char *data, size_t size) {
+    uint64_t payload;
+    if (size < sizeof(payload))
+        throw std::runtime_error("Compact sketch too small");
+    std::memcpy(&payload, data+size-sizeof(payload), sizeof(payload));
+    if (size-sizeof(payload) < payload)
+        throw std::runtime_error("Compact sketch too small");
+
+    clear();
+    const char *end = data+size-sizeof(payload);
+    data = end-payload;
+    uint64_t i = 0;
+    while (data < end) {
+        i += get_varint(data, end);
+        uint64_t v = get_varint(data, end);
+        if (i >= TABLE_SIZE || v == 0 || v > INT32_MAX)
+            throw std::runtime_error("Invalid compact sketch");
+        set(i, v);
+        ++i;
+    }
+    return payload+sizeof(payload);
+}
+
+bool CompactCountMinSketch::operator==(const CompactCountMinSketch &rhs) const {
+    return data_ == rhs.data_ && overflow_ == rhs.overflow_;
+}
@@ -0,0 +1,75 @@
+/**
+ * ElGA compact count-min sketch
+ *
+ * A count-min sketch with the same rows as CountMinSketch, but with
+ * 16-bit counters, halving its footprint.  Counters saturate, and a
+ * saturated counter's count moves to a side table.  Counting uses
+ * conservative update, raising only the counters at the key's current
+ * minimum, which lowers overestimation.  As most counters are zero or
+ * small, the serialized form lists only the nonzero counters, as
+ * varint gaps and values.
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#ifndef COMPACTSKETCH_HPP
+#define COMPACTSKETCH_HPP
+
+#include "countminsketch.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+class CompactCountMinSketch {
+    private:
+        const static uint64_t TABLE_SIZE = TABLE_WIDTH*TABLE_DEPTH;
+        /** Counters at this value hold their count in overflow_ */
+        const static uint16_t SATURATED = UINT16_MAX;
+
+        std::vector<uint16_t> data_;
+        absl::flat_hash_map<uint32_t, int32_t> overflow_;
+
+        int32_t value(uint64_t i) const {
+            return (data_[i] == SATURATED) ? overflow_.at(i) : data_[i];
+        }
+        void set(uint64_t i, int32_t v);
+
+    public:
+        CompactCountMinSketch();
+        /** Deserialize a sketch ending data, as written by serialize */
+        CompactCountMinSketch(const char *data, size_t size);
+
+        void count(uint64_t key);
+        int32_t query(uint64_t key) const;
+        /** Count key, then return its new estimate */
+        int32_t query_count(uint64_t key);
+
+        /** Add other's counters into this sketch */
+        void merge(const CompactCountMinSketch &other);
+
+        void clear();
+
+        /** Append the nonzero counters to out as [varint gap, varint
+         * value]... followed by their size as a uint64 */
+        void serialize(std::vector<char> &out) const;
+        /** Replace the sketch from one ending data, returning its
+         * serialized size */
+        size_t update(const char *data, size_t size);
+
+        /** The number of counters held in the side table */
+        size_t overflow() const { return overflow_.size(); }
+
+        bool operator==(const CompactCountMinSketch &rhs) const;
+
+        static const size_t size() { return TABLE_SIZE*sizeof(uint16_t); }
+};
+
+#endif
@@ -12,6 +12,7 @@
 
 #include "consistenthasher.hpp"
 
+#include <limits>
 #include <random>
 
 ConsistentHasher::ConsistentHasher(std::vector<uint64_t> &agents,
@@ -80,6 +81,63 @@ uint64_t ConsistentHasher::find_one(uint64_t key, uint64_t owner_check, bool &ha
     return containers[dist(mt)];
 }
 
+std::vector<hash_range_t> ConsistentHasher::owned_ranges(uint64_t agent_ser) const {
+    // The i'th ring position takes the hashes after the previous position,
+    // with the first starting at zero and the last extending to the end,
+    // as in find
+    std::vector<hash_range_t> ranges;
+    size_t ring_size = ring_.size();
+    for (size_t idx = 0; idx < ring_size; ++idx) {
+        uint64_t container = agent_map_.at(ring_[idx]);
+        if ((container & ((1llu<<49)-1)) != agent_ser) continue;
+
+        uint64_t lo = (idx == 0) ? 0 : ring_[idx-1]+1;
+        uint64_t hi = (idx == ring_size-1) ? std::numeric_limits<uint64_t>::max() : ring_[idx];
+        if (idx > 0 && ring_[idx-1] == ring_[idx]) continue;
+        if (ranges.size() > 0 && ranges.back().second+1 == lo)
+            ranges.back().second = hi;
+        else
+            ranges.push_back({lo, hi});
+    }
+    return ranges;
+}
+
+std::vector<hash_range_t> subtract_ranges(const std::vector<hash_range_t> &a,
+        const std::vector<hash_range_t> &b) {
+    std::vector<hash_range_t> res;
+    size_t b_idx = 0;
+    for (auto [lo, hi] : a) {
+        // Skip the ranges of b entirely before this one
+        while (b_idx < b.size() && b[b_idx].second < lo) ++b_idx;
+        size_t idx = b_idx;
+        bool open = true;
+        while (idx < b.size() && b[idx].first <= hi) {
+            if (b[idx].first > lo)
+                res.push_back({lo, b[idx].first-1});
+            if (b[idx].second >= hi) { open = false; break; }
+            lo = b[idx].second+1;
+            ++idx;
+        }
+        if (open) res.push_back({lo, hi});
+    }
+    return res;
+}
+
+uint64_t rendezvous(const std::vector<uint64_t> &containers, uint64_t key) {
+    // The container with the highest combined hash wins, so adding or
+    // removing one only moves the keys it wins
+    uint64_t hkey = hashing::hash(key);
+    uint64_t best = 0, best_score = 0;
+    for (uint64_t c : containers) {
+        uint64_t score = hashing::hash(hkey ^ c);
+        if (score > best_score || (score == best_score && c > best)) {
+            best = c;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
 void ConsistentHasher::update_agents(std::vector<uint64_t> &agents) {
     // This might be done in a better way
     ring_.clear();
@@ -100,3 +158,27 @@ void ConsistentHasher::update_agents(std::vector<uint64_t> &agents) {
     std::cerr << std::endl;
     #endif
 }
+
+void ConsistentHasher::add_agents(const std::vector<uint64_t> &agents) {
+    // Sort only the new positions, then merge them into the ring
+    size_t old_size = ring_.size();
+    for (uint64_t agent : agents) {
+        uint64_t h = hashing::hash(agent);
+        ring_.push_back(h);
+        agent_map_[h] = agent;
+    }
+    std::sort(ring_.begin()+old_size, ring_.end());
+    std::inplace_merge(ring_.begin(), ring_.begin()+old_size, ring_.end());
+}
+
+void ConsistentHasher::remove_agents(const std::vector<uint64_t> &agents) {
+    absl::flat_hash_set<uint64_t> removed;
+    for (uint64_t agent : agents) {
+        uint64_t h = hashing::hash(agent);
+        removed.insert(h);
+        agent_map_.erase(h);
+    }
+    ring_.erase(std::remove_if(ring_.begin(), ring_.end(),
+                [&removed](uint64_t h) { return removed.count(h) > 0; }),
+            ring_.end());
+}
@@ -17,12 +17,26 @@
 #include <cmath>
 #include <iostream>
 
+#include <utility>
 #include <vector>
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 
 #include "replicationmap.hpp"
 #include "integer_hash.hpp"
 
+/** A closed range of ring hashes */
+using hash_range_t = std::pair<uint64_t, uint64_t>;
+
+/** Return the parts of the sorted ranges a not covered by the sorted
+ * ranges b */
+std::vector<hash_range_t> subtract_ranges(const std::vector<hash_range_t> &a,
+        const std::vector<hash_range_t> &b);
+
+/** Choose one of the containers for key by rendezvous hashing, which
+ * spreads keys evenly over the containers without building a ring */
+uint64_t rendezvous(const std::vector<uint64_t> &containers, uint64_t key);
+
 class ConsistentHasher {
     private:
         std::vector<uint64_t> agents_;
@@ -42,8 +56,19 @@ class ConsistentHasher {
         /** Retrieve a single u.r. container in the consistent hash ring */
         uint64_t find_one(uint64_t key, uint64_t owner_check, bool &have_ownership);
 
+        /** Return, in order, the ranges of hashes whose first container
+         * is one of the given agent's virtual agents */
+        std::vector<hash_range_t> owned_ranges(uint64_t agent_ser) const;
+
         /** Support replacing the agents */
         void update_agents(std::vector<uint64_t> &agents);
+
+        /** Support adding and removing agents without rebuilding */
+        void add_agents(const std::vector<uint64_t> &agents);
+        void remove_agents(const std::vector<uint64_t> &agents);
+
+        /** The number of entries on the ring */
+        size_t size() const { return ring_.size(); }
 };
 
 #endif
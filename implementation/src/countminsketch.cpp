@@ -19,16 +19,20 @@ CountMinSketch::CountMinSketch() : CountSketch() {
 CountMinSketch::CountMinSketch(const char * in) : CountSketch(in) {}
 
 void CountMinSketch::count(uint64_t key) {
+    uint64_t idx[TABLE_DEPTH];
+    cells(key, idx);
     for (int64_t i = 0; i < TABLE_DEPTH; i++)
-        table->data[i * TABLE_WIDTH + hash(key, i)]++;
+        table->data[idx[i]]++;
 }
 
 
 int32_t CountMinSketch::query(uint64_t key) const {
     static_assert(TABLE_DEPTH > 0);
-    int32_t min = table->data[hash(key, 0)];
+    uint64_t idx[TABLE_DEPTH];
+    cells(key, idx);
+    int32_t min = table->data[idx[0]];
     for (uint32_t i = 1; i < TABLE_DEPTH; i++) {
-        int32_t this_val = table->data[i * TABLE_WIDTH + hash(key, i)];
+        int32_t this_val = table->data[idx[i]];
         if (this_val < min) min = this_val;
     }
     return min;
@@ -36,9 +40,11 @@ int32_t CountMinSketch::query(uint64_t key) const {
 
 int32_t CountMinSketch::query_count(uint64_t key) {
     static_assert(TABLE_DEPTH > 0);
-    int32_t min = ++table->data[hash(key, 0)];
+    uint64_t idx[TABLE_DEPTH];
+    cells(key, idx);
+    int32_t min = ++table->data[idx[0]];
     for (uint32_t i = 1; i < TABLE_DEPTH; i++) {
-        int32_t this_val = ++table->data[i * TABLE_WIDTH + hash(key, i)];
+        int32_t this_val = ++table->data[idx[i]];
         if (this_val < min) min = this_val;
     }
     return min;
@@ -46,20 +52,20 @@ int32_t CountMinSketch::query_count(uint64_t key) {
 
 void CountMinSketch::merge(CountSketchBase &cs) {
     CountMinSketch *other = static_cast<CountMinSketch *>(&cs);
-    for (uint32_t i = 0; i < TABLE_DEPTH * TABLE_WIDTH; i++)
-            table->data[i] += other->table->data[i];
+    add_table(table->data, other->table->data);
 }
 
 void CountMinSketch::disjoint_merge(CountSketchBase &cs) {
     CountMinSketch *other = static_cast<CountMinSketch *>(&cs);
-    for (uint32_t i = 0; i < TABLE_DEPTH * TABLE_WIDTH; i++)
-            table->data[i] = std::max(table->data[i], other->table->data[i]);
+    max_table(table->data, other->table->data);
 }
 
 void CountMinSketch::test_count(uint64_t key, int64_t &max, int64_t &min){
+    uint64_t idx[TABLE_DEPTH];
+    cells(key, idx);
     for (int64_t i = 0; i < TABLE_DEPTH; i++) {
-        table->data[i * TABLE_WIDTH + hash(key, i)]++;
-        int32_t value = table->data[i * TABLE_WIDTH + hash(key, i)];
+        table->data[idx[i]]++;
+        int32_t value = table->data[idx[i]];
         if(value > max)
             max = value;
         else if (value < min)
@@ -12,6 +12,11 @@
 
 #include "countsketch.hpp"
 #include <iostream>
+#include <stdexcept>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 CountSketch::CountSketch(const char * in) {
     init_table();
@@ -31,17 +36,56 @@ void CountSketch::init_table() {
     table = std::make_shared<SharedTable>();
 }
 
-int64_t CountSketch::hash(uint64_t key, int64_t index) const {
-    return hashing::hash(key ^ index) & (TABLE_WIDTH - 1);
+void CountSketch::cells(uint64_t key, uint64_t idx[TABLE_DEPTH]) {
+    uint64_t h = hashing::hash(key);
+    #ifdef CONFIG_BLOCKED_SKETCH
+    // The high half picks the block, and four bits per row the counter
+    // within it, from the low half while it suffices.  A row whose
+    // counter is taken probes to the next free one, so a key's rows
+    // never share a counter.
+    uint64_t block = ((h >> 32) * (TABLE_SIZE/BLOCK_SIZE)) >> 32;
+    uint64_t s = (TABLE_DEPTH <= 8) ? h : hashing::hash(h);
+    uint32_t used = 0;
+    for (uint64_t i = 0; i < TABLE_DEPTH; ++i) {
+        uint64_t off = (s >> (4*i)) & (BLOCK_SIZE-1);
+        while (used & (1u << off))
+            off = (off+1) & (BLOCK_SIZE-1);
+        used |= 1u << off;
+        idx[i] = block*BLOCK_SIZE + off;
+    }
+    #else
+    uint64_t a = h, b = (h >> 32) | 1;
+    for (uint64_t i = 0; i < TABLE_DEPTH; ++i)
+        idx[i] = i*TABLE_WIDTH + ((a + i*b) & (TABLE_WIDTH-1));
+    #endif
+}
+
+uint64_t CountSketch::signs(uint64_t key) const {
+    return hashing::hash(key ^ 0x9e3779b97f4a7c15llu);
 }
 
-int16_t CountSketch::hash_sign(uint64_t key, int64_t index) const {
-   return (hashing::hash(key ^ (TABLE_DEPTH + index) ) & 1) == 0 ? 1 : - 1;
+static inline void compare_swap(int32_t &a, int32_t &b) {
+    int32_t lo = std::min(a, b);
+    b = std::max(a, b);
+    a = lo;
 }
 
 // Finds the median of a given array
 uint32_t CountSketch::median(int32_t res[]) const {
-    std::sort(res, res + TABLE_DEPTH);
+    if constexpr (TABLE_DEPTH == 8) {
+        // Batcher's odd-even merge sort, without branches
+        compare_swap(res[0], res[1]); compare_swap(res[2], res[3]);
+        compare_swap(res[4], res[5]); compare_swap(res[6], res[7]);
+        compare_swap(res[0], res[2]); compare_swap(res[1], res[3]);
+        compare_swap(res[4], res[6]); compare_swap(res[5], res[7]);
+        compare_swap(res[1], res[2]); compare_swap(res[5], res[6]);
+        compare_swap(res[0], res[4]); compare_swap(res[1], res[5]);
+        compare_swap(res[2], res[6]); compare_swap(res[3], res[7]);
+        compare_swap(res[2], res[4]); compare_swap(res[3], res[5]);
+        compare_swap(res[1], res[2]); compare_swap(res[3], res[4]);
+        compare_swap(res[5], res[6]);
+    } else
+        std::sort(res, res + TABLE_DEPTH);
     int32_t mid = TABLE_DEPTH >> 1;
 
     if((TABLE_DEPTH & 1) == 1)
@@ -52,16 +96,22 @@ uint32_t CountSketch::median(int32_t res[]) const {
 
 // Insert a given value using hash functionss
 void CountSketch::count(uint64_t key) {
+    uint64_t idx[TABLE_DEPTH];
+    cells(key, idx);
+    uint64_t s = signs(key);
     for (int64_t i = 0; i < TABLE_DEPTH; i++)
-        table->data[i * TABLE_WIDTH + hash(key, i)] += hash_sign(key, i);
+        table->data[idx[i]] += ((s >> i) & 1) ? -1 : 1;
 }
 
 
 // Query a given value and return median
 int32_t CountSketch::query(uint64_t key) const {
+    uint64_t idx[TABLE_DEPTH];
+    cells(key, idx);
+    uint64_t s = signs(key);
     int32_t res[TABLE_DEPTH];
     for (int32_t i = 0; i < TABLE_DEPTH; i++)
-        res[i] = table->data[i * TABLE_WIDTH + hash(key, i)] * hash_sign(key, i);
+        res[i] = ((s >> i) & 1) ? -table->data[idx[i]] : table->data[idx[i]];
 
     return median(res);
 }
@@ -71,9 +121,12 @@ void CountSketch::update(const char* data){
 }
 
 void CountSketch::test_count(uint64_t key, int64_t &max, int64_t &min){
+    uint64_t idx[TABLE_DEPTH];
+    cells(key, idx);
+    uint64_t s = signs(key);
     for (int64_t i = 0; i < TABLE_DEPTH; i++) {
-        table->data[i * TABLE_WIDTH + hash(key, i)] += hash_sign(key, i);
-        int32_t value = table->data[i * TABLE_WIDTH + hash(key, i)];
+        table->data[idx[i]] += ((s >> i) & 1) ? -1 : 1;
+        int32_t value = table->data[idx[i]];
         if(value > max)
             max = value;
         else if (value < min)
@@ -81,10 +134,71 @@ void CountSketch::test_count(uint64_t key, int64_t &max, int64_t &min){
     }
 }
 
+void CountSketch::add_table(int32_t *dst, const int32_t *src) {
+    #ifdef __AVX2__
+    for (uint64_t i = 0; i < TABLE_SIZE; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(dst+i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src+i));
+        _mm256_storeu_si256((__m256i*)(dst+i), _mm256_add_epi32(a, b));
+    }
+    #else
+    for (uint64_t i = 0; i < TABLE_SIZE; i++)
+        dst[i] += src[i];
+    #endif
+}
+
+void CountSketch::max_table(int32_t *dst, const int32_t *src) {
+    #ifdef __AVX2__
+    for (uint64_t i = 0; i < TABLE_SIZE; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(dst+i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src+i));
+        _mm256_storeu_si256((__m256i*)(dst+i), _mm256_max_epi32(a, b));
+    }
+    #else
+    for (uint64_t i = 0; i < TABLE_SIZE; i++)
+        dst[i] = std::max(dst[i], src[i]);
+    #endif
+}
+
 void CountSketch::merge(CountSketchBase &cs) {
     CountSketch *other = static_cast<CountSketch *>(&cs);
-    for (uint64_t i = 0; i < TABLE_DEPTH * TABLE_WIDTH; i++)
-            table->data[i] += other->table->data[i];
+    add_table(table->data, other->table->data);
+}
+
+void CountSketch::encode_delta(const CountSketch& base, std::vector<char> &out) const {
+    // Nearby changes share a run when the gap is no larger than a run
+    // header
+    const uint64_t max_gap = 2*sizeof(uint32_t)/sizeof(int32_t);
+    const int32_t *cur = table->data;
+    const int32_t *old = base.table->data;
+    uint64_t i = 0;
+    while (i < TABLE_SIZE) {
+        if (cur[i] == old[i]) { ++i; continue; }
+        uint64_t start = i, end = i+1, gap = 0;
+        for (uint64_t j = end; j < TABLE_SIZE && gap <= max_gap; ++j) {
+            if (cur[j] != old[j]) { end = j+1; gap = 0; }
+            else ++gap;
+        }
+        uint32_t run[2] = {(uint32_t)start, (uint32_t)(end-start)};
+        out.insert(out.end(), (const char*)run, (const char*)(run+2));
+        out.insert(out.end(), (const char*)(cur+start), (const char*)(cur+end));
+        i = end;
+    }
+}
+
+void CountSketch::apply_delta(const char* data, size_t size) {
+    const char *end = data+size;
+    while (data < end) {
+        uint32_t run[2];
+        if ((size_t)(end-data) < sizeof(run)) throw std::runtime_error("Invalid sketch delta");
+        std::memcpy(run, data, sizeof(run));
+        data += sizeof(run);
+        size_t bytes = run[1]*sizeof(int32_t);
+        if ((uint64_t)run[0]+run[1] > TABLE_SIZE || (size_t)(end-data) < bytes)
+            throw std::runtime_error("Invalid sketch delta");
+        std::memcpy(table->data+run[0], data, bytes);
+        data += bytes;
+    }
 }
 
 bool CountSketch::operator==(const CountSketch& rhs) const{
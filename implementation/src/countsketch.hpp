@@ -17,6 +17,7 @@
 
 #include <cmath>
 #include <ctime>
+#include <vector>
 
 class CountSketch : public CountSketchBase {
 
@@ -25,13 +26,27 @@ class CountSketch : public CountSketchBase {
 
     protected:
         const static uint64_t TABLE_SIZE = TABLE_WIDTH*TABLE_DEPTH;
+        static_assert(TABLE_DEPTH <= 64, "Row signs come from one 64-bit hash");
+        #ifdef __AVX2__
+        static_assert(TABLE_SIZE % 8 == 0, "Tables are merged eight counters at a time");
+        #endif
+
+        #ifdef CONFIG_BLOCKED_SKETCH
+        /** A key's counters all fall in one cache line of this many */
+        const static uint64_t BLOCK_SIZE = 64/sizeof(int32_t);
+        static_assert(TABLE_DEPTH <= BLOCK_SIZE && TABLE_SIZE % BLOCK_SIZE == 0);
+        #endif
 
         struct SharedTable{
-            int32_t data[TABLE_SIZE];
+            alignas(64) int32_t data[TABLE_SIZE];
         };
 
         std::shared_ptr<SharedTable> table;
 
+        /** Add, or take the maximum of, every counter of src into dst */
+        static void add_table(int32_t *dst, const int32_t *src);
+        static void max_table(int32_t *dst, const int32_t *src);
+
     public:
         CountSketch();
         CountSketch(const char * in);
@@ -42,10 +57,19 @@ class CountSketch : public CountSketchBase {
         int32_t query(uint64_t key) const;
         void update(const char* data);
         void test_count(uint64_t key, int64_t &max, int64_t &min);
-        int64_t hash(uint64_t key, int64_t index) const;
-        int16_t hash_sign(uint64_t key, int64_t index) const;
+        /** Find the counter of each row for key, all derived from one
+         * hash by double hashing */
+        static void cells(uint64_t key, uint64_t idx[TABLE_DEPTH]);
+        /** Return the sign of each row for key, as bit i for row i */
+        uint64_t signs(uint64_t key) const;
         bool operator==(const CountSketch& rhs) const;
         uint32_t median(int32_t res[]) const;
 
+        /** Append the cells that differ from base to out, as runs of
+         * [uint32 start][uint32 length][int32 values...] */
+        void encode_delta(const CountSketch& base, std::vector<char> &out) const;
+        /** Apply runs produced by encode_delta */
+        void apply_delta(const char* data, size_t size);
+
         static const size_t size() { return sizeof(SharedTable); }
 };
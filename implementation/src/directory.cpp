@@ -13,11 +13,14 @@
 #include "directory.hpp"
 
 #include "pack.hpp"
+#include "aggregate.hpp"
 
 #include <thread>
 #include <chrono>
 #include <iostream>
 #include <random>
+#include <algorithm>
+#include <cstring>
 
 #include <iomanip>
 #include <mutex>
@@ -121,6 +124,9 @@ void Directory::join_directory() {
     #ifdef CONFIG_AUTOSCALE
     sub(AS_QUERY);
     #endif
+    #ifdef CONFIG_VA_BALANCE
+    sub(VA_LOAD_INT);
+    #endif
     sub_connect(dm_);
 
     //wait_for_heartbeat
@@ -146,6 +152,10 @@ void Directory::join_peer(uint64_t ser_addr) {
 
     // Add it to our directory list
     directories_.insert(ser_addr);
+
+    #ifdef CONFIG_TREE_BARRIER
+    tree_update();
+    #endif
 }
 
 void Directory::leave_peer(uint64_t ser_addr) {
@@ -154,19 +164,31 @@ void Directory::leave_peer(uint64_t ser_addr) {
 
     // Add it to our directory list
     directories_.erase(ser_addr);
+
+    #ifdef CONFIG_TREE_BARRIER
+    tree_reqs_.erase(ser_addr);
+    child_sizes_.erase(ser_addr);
+    tree_update();
+    #endif
 }
 
 #ifdef CONFIG_AUTOSCALE
 void Directory::autoscaler() {
-    double rate = 0.;
-    for (const auto & [id, r] : as_rate_) {
-        rate += r;
-    }
-
     scale_direction dir;
     time_t now = time(NULL);
 
-    size_t target = rate / (double)AUTOSCALE_QR_TARGET + 1;
+    // Combine the agents' metrics and ask the policy
+    cluster_metrics_t m = {};
+    bool first = true;
+    for (const auto & [id, am] : as_metrics_) {
+        add_metrics(m, am, first);
+        first = false;
+    }
+    m.time = now;
+    m.max_agents = std::min<size_t>(AUTOSCALE_MAX_AGENTS, agents_.size() + dead_agents_.size());
+    double rate = m.query_rate;
+
+    size_t target = as_policy_->target(m);
     if (target > AUTOSCALE_MAX_AGENTS)
         target = AUTOSCALE_MAX_AGENTS;
     if (target > agents_.size() + dead_agents_.size())
@@ -174,6 +196,8 @@ void Directory::autoscaler() {
     if (target < AUTOSCALE_MIN_AGENTS)
         target = AUTOSCALE_MIN_AGENTS;
 
+    // The metrics are printed as a trace for autoscale-sim
+    std::cout << format_metrics(m) << std::endl;
     printf("T,%lu,%lf,%ld,%ld,%ld,%ld,%d", now, rate, agents_.size(), dead_agents_.size(), target, as_req_, as_wait_);
     std::cout << std::endl;
 
@@ -241,6 +265,64 @@ void Directory::autoscaler() {
 }
 #endif
 
+#ifdef CONFIG_VA_BALANCE
+void Directory::balance_va(bool force) {
+    if (!force && --va_wait_ > 0) return;
+    va_wait_ = VA_BALANCE_PERIOD;
+
+    // Only balance between batches, with every agent's load measured on
+    // the same batch since the last plan
+    if (va_running_ || simple_sync_ > 0) return;
+    if (agents_.size() < 2 || va_loads_.size() != agents_.size()) return;
+
+    // Every directory holds every load, so only the lowest addressed
+    // one plans
+    for (uint64_t d : directories_)
+        if (d < addr_ser) return;
+
+    std::vector<uint64_t> agents;
+    std::vector<aid_t> vagents;
+    std::vector<va_load_t> loads;
+    batch_t batch = va_loads_.begin()->second.batch;
+    for (const auto & [id, load] : va_loads_) {
+        if (load.batch != batch) return;
+        uint64_t agent_ser;
+        aid_t count;
+        unpack_agent(id, agent_ser, count);
+        agents.push_back(agent_ser);
+        vagents.push_back(count);
+        loads.push_back(load);
+    }
+    if (batch <= va_batch_) return;
+
+    std::vector<aid_t> counts;
+    bool commit = va_balancer_.plan(vagents, loads, counts);
+    info_(addr_ser, "VA BAL  | batch ", batch, " imbalance ", va_balancer_.imbalance(),
+            " predicted ", va_balancer_.predicted(), (commit) ? " moving" : " keeping");
+    if (!commit) return;
+    va_batch_ = batch;
+
+    // Send the agents whose counts change their new counts
+    std::vector<uint64_t> moves;
+    for (size_t i = 0; i < agents.size(); ++i) {
+        if (counts[i] == vagents[i]) continue;
+        debug_(addr_ser, "VA BAL  | ", agents[i], " ", vagents[i], " -> ", counts[i]);
+        moves.push_back(pack_agent(agents[i], counts[i]));
+    }
+
+    size_t msg_size = sizeof(msg_type_t) + sizeof(uint64_t)*moves.size();
+    char* msg = new char[msg_size];
+    char* msg_ptr = msg;
+    pack_msg(msg_ptr, DO_VA);
+    for (uint64_t move : moves)
+        pack_single(msg_ptr, move);
+
+    pub(msg, msg_size);
+
+    delete[] msg;
+}
+#endif
+
 bool Directory::heartbeat() {
     if (ZMQChatterbox::heartbeat() == false)
         return false;
@@ -249,49 +331,136 @@ bool Directory::heartbeat() {
     autoscaler();
     #endif
 
+    #ifdef CONFIG_VA_BALANCE
+    balance_va(false);
+    #endif
+
     if (!notify_)
         return true;
 
+    if (notify_changed_) {
+        // Install the current directory as a new version
+        ++version_;
+        if (!pub_delta())
+            pub_snapshot(DIRECTORY_SNAPSHOT_CHANGED);
+        published_agents_ = agents_;
+        #ifdef CONFIG_CS
+        #ifdef CONFIG_HUB_LIST
+        published_hubs_ = HHReplicationMap::hub_list(hubs_);
+        #elif defined(CONFIG_COMPACT_SKETCH)
+        published_cms_ = cms_;
+        #else
+        published_cms_.update(cms_.serialize());
+        #endif
+        #endif
+        info_(addr_ser, "sent new directory, num agents: ", agents_.size(), " version: ", version_);
+    } else {
+        // Someone joined or missed an update, resend the current version
+        pub_snapshot(DIRECTORY_SNAPSHOT);
+    }
+
+    notify_ = false;
+    notify_changed_ = false;
+
+    return true;
+}
+
+void Directory::pub_snapshot(uint8_t flag) {
     // Broadcast the agent list and sketch
-    #ifdef CONFIG_CS
+    #ifdef CONFIG_HUB_LIST
+    // The hub list takes the place of the sketch
+    std::vector<char> hubs_ser;
+    HHReplicationMap::encode((flag == DIRECTORY_SNAPSHOT) ? published_hubs_ : HHReplicationMap::hub_list(hubs_), hubs_ser);
+    size_t cms_size = hubs_ser.size();
+    #elif defined(CONFIG_COMPACT_SKETCH)
+    std::vector<char> cms_ser;
+    ((flag == DIRECTORY_SNAPSHOT) ? published_cms_ : cms_).serialize(cms_ser);
+    size_t cms_size = cms_ser.size();
+    #elif defined(CONFIG_CS)
     size_t cms_size = CountMinSketch::size();
     #else
     size_t cms_size = 0;
     #endif
-    size_t size = sizeof(msg_type_t)+sizeof(uint8_t)+agents_.size()*sizeof(uint64_t)+cms_size;
+    // Changed snapshots carry the new directory, others the published one
+    const absl::flat_hash_set<uint64_t> &agents =
+        (flag == DIRECTORY_SNAPSHOT) ? published_agents_ : agents_;
+    size_t size = sizeof(msg_type_t)+sizeof(uint8_t)+sizeof(uint64_t)+agents.size()*sizeof(uint64_t)+cms_size;
     ZMQMessage msg = prepare_pub(size);
 
     // Get the raw destination space
     char *data = msg.edit_data();
 
     pack_msg(data, DIRECTORY_UPDATE);
-    // Indicate if something changed
-    uint8_t changed = 0;
-    if (notify_changed_)
-        changed = 1;
-    pack_single(data, changed);
+    pack_single(data, flag);
+    pack_single(data, version_);
     // Now, add in the agents
     size_t ctr = 0;
     uint64_t *data_agents = (uint64_t*)data;
-    for (auto agent : agents_)
+    for (auto agent : agents)
         data_agents[ctr++] = agent;
-    data += sizeof(uint64_t)*agents_.size();
+    data += sizeof(uint64_t)*agents.size();
 
-    #ifdef CONFIG_CS
+    #ifdef CONFIG_HUB_LIST
+    memcpy(data, hubs_ser.data(), cms_size);
+    data += cms_size;
+    #elif defined(CONFIG_COMPACT_SKETCH)
+    memcpy(data, cms_ser.data(), cms_size);
+    data += cms_size;
+    #elif defined(CONFIG_CS)
     // Finally, include the count sketch
-    char* cms_ser = cms_.serialize();
+    char* cms_ser = (flag == DIRECTORY_SNAPSHOT) ? published_cms_.serialize() : cms_.serialize();
     memcpy(data, cms_ser, cms_size);
     data += cms_size;
     #endif
 
-    if (notify_changed_)
-        info_(addr_ser, "sent new directory, num agents: ", agents_.size());
-
-    // Send out the message, and mark that we have notified
+    // Send out the message
     msg.send();
-    notify_ = false;
-    notify_changed_ = false;
+}
+
+bool Directory::pub_delta() {
+    std::vector<uint64_t> added, removed;
+    for (auto agent : agents_)
+        if (published_agents_.count(agent) == 0)
+            added.push_back(agent);
+    for (auto agent : published_agents_)
+        if (agents_.count(agent) == 0)
+            removed.push_back(agent);
+
+    // The header, then the agent changes, then the changed sketch cells
+    std::vector<char> delta;
+    delta.resize(sizeof(msg_type_t)+sizeof(uint8_t)+3*sizeof(uint64_t)+(added.size()+removed.size())*sizeof(uint64_t));
+    char *data = delta.data();
+    pack_msg(data, DIRECTORY_UPDATE);
+    pack_single(data, (uint8_t)DIRECTORY_DELTA);
+    pack_single(data, version_);
+    pack_single(data, (uint64_t)added.size());
+    pack_single(data, (uint64_t)removed.size());
+    for (auto agent : added)
+        pack_single(data, agent);
+    for (auto agent : removed)
+        pack_single(data, agent);
+    #ifdef CONFIG_HUB_LIST
+    // The hub list is small, so it is sent whole
+    size_t hubs_start = delta.size();
+    HHReplicationMap::encode(HHReplicationMap::hub_list(hubs_), delta);
+    size_t cms_size = delta.size()-hubs_start;
+    #elif defined(CONFIG_COMPACT_SKETCH)
+    // The compressed sketch is already sparse, so it is sent whole
+    size_t cms_start = delta.size();
+    cms_.serialize(delta);
+    size_t cms_size = delta.size()-cms_start;
+    #elif defined(CONFIG_CS)
+    cms_.encode_delta(published_cms_, delta);
+    size_t cms_size = CountMinSketch::size();
+    #else
+    size_t cms_size = 0;
+    #endif
+
+    size_t snapshot_size = sizeof(msg_type_t)+sizeof(uint8_t)+sizeof(uint64_t)+agents_.size()*sizeof(uint64_t)+cms_size;
+    if (delta.size() >= snapshot_size)
+        return false;
 
+    pub(delta.data(), delta.size());
     return true;
 }
 
@@ -384,10 +553,20 @@ bool Directory::agent_leave(uint64_t *agent_list, size_t num_agents) {
     for (size_t ctr = 0; ctr < num_agents; ++ctr) {
         agents_.erase(agent_list[ctr]);
         #ifdef CONFIG_AUTOSCALE
-        as_rate_.erase(agent_list[ctr]);
+        as_metrics_.erase(agent_list[ctr]);
         dead_agents_.insert(agent_list[ctr]);
         #endif
+        #ifdef CONFIG_VA_BALANCE
+        va_loads_.erase(agent_list[ctr]);
+        #endif
+        // Do not wait on an aggregate reply that will not come
+        uint64_t agent_ser;
+        aid_t aid;
+        unpack_agent(agent_list[ctr], agent_ser, aid);
+        agg_waiting_.erase(agent_ser);
+        agg_reqs_.erase(agent_ser);
     }
+    aggregate_check();
 
     // Then, mark we need to send out a directory update
     notify_ = true;
@@ -399,9 +578,17 @@ bool Directory::agent_leave(uint64_t *agent_list, size_t num_agents) {
 #ifdef CONFIG_CS
 void Directory::cs_update(const char *data, size_t cs_size) {
     if (cs_size > 0) {
+        #ifdef CONFIG_HUB_LIST
+        SpaceSaving new_hubs {data, cs_size};
+        hubs_.merge(new_hubs);
+        #elif defined(CONFIG_COMPACT_SKETCH)
+        CompactCountMinSketch new_cms {data, cs_size};
+        cms_.merge(new_cms);
+        #else
         // Merge the new CS with the main, full CS
         CountMinSketch new_cms {data};
         cms_.merge(new_cms);
+        #endif
     }
 
     ++cms_recv_;
@@ -415,6 +602,210 @@ void Directory::cs_update(const char *data, size_t cs_size) {
 }
 #endif
 
+#ifdef CONFIG_TREE_BARRIER
+std::vector<uint64_t> Directory::tree_order() const {
+    std::vector<uint64_t> order(directories_.begin(), directories_.end());
+    order.push_back(addr_ser);
+    std::sort(order.begin(), order.end());
+    return order;
+}
+
+uint64_t Directory::tree_parent() const {
+    auto order = tree_order();
+    size_t idx = std::find(order.begin(), order.end(), addr_ser)-order.begin();
+    if (idx == 0) return 0;
+    return order[(idx-1)/TREE_BARRIER_FANOUT];
+}
+
+std::vector<uint64_t> Directory::tree_children() const {
+    auto order = tree_order();
+    size_t idx = std::find(order.begin(), order.end(), addr_ser)-order.begin();
+    std::vector<uint64_t> children;
+    for (size_t c = idx*TREE_BARRIER_FANOUT+1; c <= (idx+1)*TREE_BARRIER_FANOUT && c < order.size(); ++c)
+        children.push_back(order[c]);
+    return children;
+}
+
+ZMQRequester& Directory::tree_req(uint64_t dir) {
+    auto req_it = tree_reqs_.find(dir);
+    if (req_it == tree_reqs_.end())
+        req_it = tree_reqs_.try_emplace(dir, ZMQAddress(dir), addr_, PULL).first;
+    return req_it->second;
+}
+
+void Directory::tree_update() {
+    size_t size = local_agents_.size();
+    for (auto child : tree_children()) {
+        auto search = child_sizes_.find(child);
+        if (search != child_sizes_.end()) size += search->second;
+    }
+
+    uint64_t parent = tree_parent();
+    if (parent == tree_parent_ && size == tree_reported_) return;
+    tree_parent_ = parent;
+    tree_reported_ = size;
+    if (parent == 0) return;
+
+    char msg[sizeof(msg_type_t)+sizeof(uint64_t)+sizeof(size_t)];
+    char *msg_ptr = msg;
+    pack_msg(msg_ptr, TREE_SIZE);
+    pack_single(msg_ptr, addr_ser);
+    pack_single(msg_ptr, size);
+    tree_req(parent).send(msg, sizeof(msg));
+}
+
+void Directory::tree_ready(batch_t batch, it_t it, size_t count, size_t dormant, bool local) {
+    tree_count_t &tc = tree_counts_[batch][it];
+    if (local) ++tc.local;
+    else ++tc.children;
+    tc.count += count;
+    tc.dormant += dormant;
+    debug_(addr_ser, "tree READY_SYNC[", batch, "][", it, "] count=", tc.count);
+
+    tree_check(batch, it);
+}
+
+void Directory::tree_check(batch_t batch, it_t it) {
+    auto b_search = tree_counts_.find(batch);
+    if (b_search == tree_counts_.end()) return;
+    auto search = b_search->second.find(it);
+    if (search == b_search->second.end()) return;
+    tree_count_t tc = search->second;
+
+    uint64_t parent = tree_parent();
+    if (parent == 0) {
+        // The root releases the barrier once everyone arrived
+        if (tc.count < barrier_size()) return;
+        if (tc.count > barrier_size())
+            throw std::runtime_error("Received too many syncs");
+    } else {
+        // Others wait for their agents and each non-empty subtree
+        size_t children = 0;
+        for (auto child : tree_children()) {
+            auto c_search = child_sizes_.find(child);
+            if (c_search != child_sizes_.end() && c_search->second > 0) ++children;
+        }
+        if (tc.local < local_agents_.size() || tc.children < children) return;
+    }
+
+    b_search->second.erase(search);
+    if (b_search->second.size() == 0) tree_counts_.erase(b_search);
+
+    if (parent == 0) {
+        tree_sync(tc.dormant, it, batch);
+        return;
+    }
+
+    // Combine everything below us into a single message
+    char msg[sizeof(msg_type_t)+2*sizeof(size_t)+sizeof(it_t)+sizeof(batch_t)];
+    char *msg_ptr = msg;
+    pack_msg(msg_ptr, READY_SYNC_TREE);
+    pack_single(msg_ptr, tc.count);
+    pack_single(msg_ptr, tc.dormant);
+    pack_single(msg_ptr, it);
+    pack_single(msg_ptr, batch);
+    tree_req(parent).send(msg, sizeof(msg));
+}
+
+void Directory::tree_sync(size_t dormant, it_t it, batch_t batch) {
+    // Pass the release down, then release our own agents
+    char msg[sizeof(msg_type_t)+sizeof(size_t)+sizeof(it_t)+sizeof(batch_t)];
+    char *msg_ptr = msg;
+    pack_msg(msg_ptr, SYNC_TREE);
+    pack_single(msg_ptr, dormant);
+    pack_single(msg_ptr, it);
+    pack_single(msg_ptr, batch);
+    for (auto child : tree_children())
+        tree_req(child).send(msg, sizeof(msg));
+
+    char data[sizeof(msg_type_t)+sizeof(size_t)];
+    char *data_ptr = data;
+    pack_msg(data_ptr, SYNC);
+    pack_single(data_ptr, dormant);
+    pub(data, sizeof(data));
+    info_(addr_ser, "SENDING SYNC ", batch, ":", it);
+
+    // Follow the superstep as in the flat barrier
+    batch_ = batch;
+    it_ = it;
+    if (dormant == 0)
+        end_batch();
+    ++it_;
+    agents_idle_ = true;
+}
+#endif
+
+void Directory::aggregate(zmq_socket_t sock, const char *data, size_t size) {
+    if (size != sizeof(uint8_t)+sizeof(uint64_t)) throw std::runtime_error("Invalid aggregate query");
+    // A client waits on its reply, so only one query runs at a time
+    if (agg_sock_ != NULL) throw std::runtime_error("Aggregate query already running");
+    uint8_t kind;
+    uint64_t param;
+    unpack_single(data, kind);
+    unpack_single(data, param);
+
+    agg_sock_ = sock;
+    ++agg_id_;
+    agg_merge_ = std::make_unique<aggregate::Merge>(kind, param);
+    agg_start_ = timer::TimePoint();
+
+    // Ask each agent once, however many virtual agents it has; replies
+    // are merged as they arrive
+    char msg[sizeof(msg_type_t)+sizeof(kind)+sizeof(param)+sizeof(addr_ser)+sizeof(agg_id_)];
+    char *msg_ptr = msg;
+    pack_msg(msg_ptr, AGG_QUERY);
+    pack_single(msg_ptr, kind);
+    pack_single(msg_ptr, param);
+    pack_single(msg_ptr, addr_ser);
+    pack_single(msg_ptr, agg_id_);
+
+    agg_waiting_.clear();
+    for (uint64_t agent : agents_) {
+        uint64_t agent_ser;
+        aid_t aid;
+        unpack_agent(agent, agent_ser, aid);
+        if (!agg_waiting_.insert(agent_ser).second) continue;
+        auto req_it = agg_reqs_.find(agent_ser);
+        if (req_it == agg_reqs_.end())
+            req_it = agg_reqs_.try_emplace(agent_ser, ZMQAddress(agent_ser), addr_, PULL).first;
+        req_it->second.send(msg, sizeof(msg));
+    }
+
+    aggregate_check();
+}
+
+void Directory::aggregate_part(const char *data, size_t size) {
+    if (size < sizeof(uint64_t)+sizeof(uint64_t)) throw std::runtime_error("Message too small");
+    uint64_t id, agent_ser;
+    unpack_single(data, id);
+    unpack_single(data, agent_ser);
+    size -= sizeof(id)+sizeof(agent_ser);
+
+    // Replies to a query already answered are dropped
+    if (agg_sock_ == NULL || id != agg_id_ || agg_waiting_.erase(agent_ser) == 0)
+        return;
+    agg_merge_->add(data, size);
+
+    aggregate_check();
+}
+
+void Directory::aggregate_check() {
+    if (agg_sock_ == NULL) return;
+    if (agg_waiting_.size() > 0) {
+        if (agg_start_.distance_us() < AGG_TIMEOUT*1000) return;
+        info_(addr_ser, "aggregate timed out waiting on ", agg_waiting_.size(), " agents");
+    }
+
+    std::vector<char> resp = agg_merge_->result();
+    ZMQMessage reply { agg_sock_, resp.size() };
+    std::memcpy(reply.edit_data(), resp.data(), resp.size());
+    reply.send();
+
+    agg_sock_ = NULL;
+    agg_merge_.reset();
+    agg_waiting_.clear();
+}
+
 void Directory::start() {
     #ifdef DEBUG_VERBOSE
     std::cerr << "[ElGA : Directory] running" << std::endl;
@@ -431,6 +822,7 @@ void Directory::start() {
         }
 
         heartbeat();
+        aggregate_check();
 
         #ifdef DEBUG_VERBOSE
         std::cerr << "[ElGA : Directory] polling" << std::endl;
@@ -466,26 +858,66 @@ void Directory::start() {
                     break; }
                 case AGENT_JOIN: {
                     size_t num_agents = (total_size-sizeof(msg_type_t))/sizeof(uint64_t);
+                    #ifdef CONFIG_TREE_BARRIER
+                    if (is_pull(sock)) {
+                        for (size_t ctr = 0; ctr < num_agents; ++ctr)
+                            local_agents_.insert(((uint64_t*)data)[ctr]);
+                        tree_update();
+                    }
+                    #endif
                     if (agent_join((uint64_t*)data, num_agents))
                         pub(msg.data(), total_size);
                     break; }
                 case AGENT_LEAVE: {
                     size_t num_agents = (total_size-sizeof(msg_type_t))/sizeof(uint64_t);
+                    #ifdef CONFIG_TREE_BARRIER
+                    if (is_pull(sock)) {
+                        for (size_t ctr = 0; ctr < num_agents; ++ctr)
+                            local_agents_.erase(((uint64_t*)data)[ctr]);
+                        tree_update();
+                    }
+                    #endif
                     if (agent_leave((uint64_t*)data, num_agents))
                         pub(msg.data(), total_size);
                     break; }
                 #ifdef CONFIG_AUTOSCALE
                 case AS_QUERY: {
                     uint64_t recv_agent;
-                    double val;
+                    agent_metrics_t metrics;
                     unpack_single(data, recv_agent);
-                    unpack_single(data, val);
+                    unpack_single(data, metrics);
 
                     if (dead_agents_.count(recv_agent) > 0) break;
 
                     const double alpha = 2./(AUTOSCALE_EMA+1);
-                    as_rate_[recv_agent] = alpha*val + (1-alpha)*as_rate_[recv_agent];
+                    agent_metrics_t &am = as_metrics_[recv_agent];
+                    metrics.query_rate = alpha*metrics.query_rate + (1-alpha)*am.query_rate;
+                    am = metrics;
+
+                    break;
+                }
+                #endif
+                #ifdef CONFIG_VA_BALANCE
+                case VA: {
+                    // Balance now, rather than waiting for the period
+                    balance_va(true);
+                    break;
+                }
+                case VA_LOAD_INT:
+                case VA_LOAD: {
+                    // Share our agents' loads with the other directories
+                    if (type == VA_LOAD) {
+                        char new_msg[total_size];
+                        char *new_msg_ptr = new_msg;
+                        pack_msg(new_msg_ptr, VA_LOAD_INT);
+                        memcpy(new_msg_ptr, data, total_size-sizeof(msg_type_t));
+                        pub(new_msg, total_size);
+                    }
 
+                    uint64_t recv_agent;
+                    unpack_single(data, recv_agent);
+                    if (agents_.count(recv_agent) == 0) break;
+                    unpack_single(data, va_loads_[recv_agent]);
                     break;
                 }
                 #endif
@@ -495,6 +927,14 @@ void Directory::start() {
                                     break;
                                 }
                 #endif
+                case AGG_QUERY: {
+                                    aggregate(sock, data, total_size-sizeof(msg_type_t));
+                                    break;
+                                }
+                case AGG_PART: {
+                                    aggregate_part(data, total_size-sizeof(msg_type_t));
+                                    break;
+                                }
                 case NEED_DIRECTORY: {
                                          notify_ = true;
                                          break;
@@ -515,19 +955,31 @@ void Directory::start() {
                                       debug_(addr_ser, "got ", unV);
                                       nV_ += unV;
                                       nE_ += unE;
+                                      #ifdef CONFIG_EDGE_WINDOW
+                                      timestamp_t max_ts;
+                                      unpack_single(data, max_ts);
+                                      max_timestamp_ = std::max(max_timestamp_, max_ts);
+                                      #endif
 
                                       // Update other directories with the
                                       // increase nV/nE
                                       if (type == READY_NV_NE) {
+                                          #ifndef CONFIG_EDGE_WINDOW
                                           char msg[pack_msg_unv_une_size];
+                                          #else
+                                          char msg[pack_msg_unv_une_size+sizeof(timestamp_t)];
+                                          #endif
                                           char *msg_ptr = msg;
                                           pack_msg_unv_une(msg_ptr, READY_NV_NE_INT, unV, unE);
-                                          pub(msg, pack_msg_unv_une_size);
+                                          #ifdef CONFIG_EDGE_WINDOW
+                                          pack_single(msg_ptr, max_ts);
+                                          #endif
+                                          pub(msg, sizeof(msg));
                                       }
 
                                       // Finally, if all agents are ready,
                                       // then the next phase can begin
-                                      if (ready_ctr_ == agents_.size()) {
+                                      if (ready_ctr_ == barrier_size()) {
                                           // This will occur when we have
                                           // the sync ctr for all known
                                           // agents, not just our agents
@@ -542,7 +994,7 @@ void Directory::start() {
                                           pub(msg, sizeof(msg));
 
                                           // Reset the sync ctr
-                                          ready_ctr_ -= agents_.size();
+                                          ready_ctr_ -= barrier_size();
                                           it_ = 0;
                                           info_(addr_ser, "ready NV NE");
                                       }
@@ -564,7 +1016,9 @@ void Directory::start() {
                 #endif
                 case RESET:
                 case CHK_T:
+                #ifndef CONFIG_VA_BALANCE
                 case VA:
+                #endif
                 case UPDATE:
                 case SAVE:
                 case DUMP:
@@ -576,6 +1030,8 @@ void Directory::start() {
                                 pack_msg(new_msg_ptr, st);
                                 memcpy(new_msg_ptr, data, total_size-sizeof(msg_type_t));
                                 pub(new_msg, total_size);
+                                if (type == START || type == UPDATE)
+                                    begin_batch();
                                 break;
                             }
                 case HEARTBEAT:
@@ -596,6 +1052,52 @@ void Directory::start() {
                                     }
                                     break;
                                   }
+                #ifdef CONFIG_TREE_BARRIER
+                case READY_SYNC: {
+                                     size_t this_dormant;
+                                     unpack_single(data, this_dormant);
+                                     tree_ready(batch_, it_, 1, this_dormant, true);
+                                     break;
+                                 }
+                case READY_SYNC_TREE: {
+                                     size_t count, this_dormant;
+                                     it_t msg_it;
+                                     batch_t msg_batch;
+                                     unpack_single(data, count);
+                                     unpack_single(data, this_dormant);
+                                     unpack_single(data, msg_it);
+                                     unpack_single(data, msg_batch);
+                                     tree_ready(msg_batch, msg_it, count, this_dormant, false);
+                                     break;
+                                 }
+                case SYNC_TREE: {
+                                     size_t this_dormant;
+                                     it_t msg_it;
+                                     batch_t msg_batch;
+                                     unpack_single(data, this_dormant);
+                                     unpack_single(data, msg_it);
+                                     unpack_single(data, msg_batch);
+                                     tree_sync(this_dormant, msg_it, msg_batch);
+                                     break;
+                                 }
+                case TREE_SIZE: {
+                                     uint64_t child;
+                                     size_t size;
+                                     unpack_single(data, child);
+                                     unpack_single(data, size);
+                                     child_sizes_[child] = size;
+                                     tree_update();
+
+                                     // We may no longer be waiting on it
+                                     std::vector<std::pair<batch_t, it_t>> pending;
+                                     for (auto &[b, its] : tree_counts_)
+                                         for (auto &[i, tc] : its)
+                                             pending.emplace_back(b, i);
+                                     for (auto [b, i] : pending)
+                                         tree_check(b, i);
+                                     break;
+                                 }
+                #else
                 case READY_SYNC_INT:
                 case READY_SYNC: {
                                      size_t this_dormant;
@@ -632,7 +1134,7 @@ void Directory::start() {
 
                                      // If the counter is a full sync,
                                      // broadcast that and reset
-                                     if (sync_ctr_[batch_][it_] == agents_.size()) {
+                                     if (sync_ctr_[batch_][it_] == barrier_size()) {
                                          char data[sizeof(msg_type_t)+sizeof(size_t)];
                                          char *data_ptr = data;
 
@@ -649,17 +1151,18 @@ void Directory::start() {
                                          // from triggering a new batch
                                          // continuation
                                          if (num_dormant_[batch_][it_] == 0)
-                                            ++batch_;
+                                            end_batch();
 
                                          // Increment the iteration
                                          ++it_;
 
                                          // Reset the counters
                                          agents_idle_ = true;
-                                     } else if (sync_ctr_[batch_][it_] > agents_.size())
+                                     } else if (sync_ctr_[batch_][it_] > barrier_size())
                                         throw std::runtime_error("Received too many syncs");
                                      break;
                                  }
+                #endif
                     case HAVE_UPDATE: {
                                           // Broadcast if:
                                           //    -agents are idle (haven't
@@ -675,7 +1178,19 @@ void Directory::start() {
                                               break;
 
                                           // Broadcast it
+                                          #ifndef CONFIG_EDGE_WINDOW
                                           pub(msg.data(), total_size);
+                                          #else
+                                          // With the cluster's newest
+                                          // timestamp, so every agent
+                                          // expires against one cutoff
+                                          char have_update[pack_msg_batch_size+sizeof(timestamp_t)];
+                                          char *have_update_ptr = have_update;
+                                          pack_msg_batch(have_update_ptr, HAVE_UPDATE, batch_of_req);
+                                          pack_single(have_update_ptr, max_timestamp_);
+                                          pub(have_update, sizeof(have_update));
+                                          #endif
+                                          begin_batch();
 
                                           // Now, agents are no longer
                                           // idle
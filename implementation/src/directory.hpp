@@ -20,10 +20,29 @@
 #include "absl/container/flat_hash_set.h"
 #include "absl/container/flat_hash_map.h"
 
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 #include "chatterbox.hpp"
 #include "address.hpp"
 
+#include "aggregate.hpp"
 #include "countminsketch.hpp"
+#ifdef CONFIG_HUB_LIST
+#include "replicationmap.hpp"
+#endif
+#ifdef CONFIG_COMPACT_SKETCH
+#include "compactsketch.hpp"
+#endif
+
+#ifdef CONFIG_AUTOSCALE
+#include "autoscale.hpp"
+#endif
+
+#ifdef CONFIG_VA_BALANCE
+#include "vabalance.hpp"
+#endif
 
 namespace elga {
 
@@ -56,20 +75,76 @@ namespace elga {
             bool notify_;
             bool notify_changed_;
 
+            /** The last published directory, which updates are
+             * delta-encoded against */
+            uint64_t version_;
+            absl::flat_hash_set<uint64_t> published_agents_;
+            #ifdef CONFIG_CS
+            #ifdef CONFIG_HUB_LIST
+            std::vector<hub_t> published_hubs_;
+            #elif defined(CONFIG_COMPACT_SKETCH)
+            CompactCountMinSketch published_cms_;
+            #else
+            CountMinSketch published_cms_;
+            #endif
+            #endif
+
             /** Keep track of the graph statistics */
             double nV_;
             size_t nE_;
+            #ifdef CONFIG_EDGE_WINDOW
+            /** The newest edge timestamp any agent holds, which every
+             * agent expires against in the next batch */
+            timestamp_t max_timestamp_;
+            #endif
             #ifdef CONFIG_CS
+            #ifdef CONFIG_HUB_LIST
+            /** The agents' degree summaries, merged */
+            SpaceSaving hubs_;
+            #elif defined(CONFIG_COMPACT_SKETCH)
+            CompactCountMinSketch cms_;
+            #else
             CountMinSketch cms_;
+            #endif
             size_t cms_recv_;
             #endif
             size_t simple_sync_;
 
+            #ifdef CONFIG_TREE_BARRIER
+            /** Agents registered directly with us */
+            absl::flat_hash_set<uint64_t> local_agents_;
+            /** The number of agents below each child in the tree */
+            absl::flat_hash_map<uint64_t, size_t> child_sizes_;
+            /** The parent and subtree size we last reported */
+            uint64_t tree_parent_;
+            size_t tree_reported_;
+            /** Partial barrier counts, from our agents and children */
+            typedef struct tree_count {
+                size_t local;
+                size_t children;
+                size_t count;
+                size_t dormant;
+            } tree_count_t;
+            absl::flat_hash_map<batch_t, absl::flat_hash_map<it_t, tree_count_t>> tree_counts_;
+            /** Connections to our parent and children */
+            std::unordered_map<uint64_t, ZMQRequester> tree_reqs_;
+            #endif
+
             /** Keep a counter for how many agents have indicated sync */
             absl::flat_hash_map<batch_t, absl::flat_hash_map<it_t, size_t>> sync_ctr_;
             absl::flat_hash_map<batch_t, absl::flat_hash_map<it_t, size_t>> num_dormant_;
             size_t ready_ctr_;
 
+            /** The client aggregate query being answered, if agg_sock_
+             * is set, with the agents yet to reply */
+            zmq_socket_t agg_sock_;
+            uint64_t agg_id_;
+            absl::flat_hash_set<uint64_t> agg_waiting_;
+            std::unique_ptr<aggregate::Merge> agg_merge_;
+            timer::TimePoint agg_start_;
+            /** Connections to agents for aggregate queries */
+            std::unordered_map<uint64_t, ZMQRequester> agg_reqs_;
+
             /** Keep track of the current batch */
             it_t it_;
             batch_t batch_;
@@ -77,30 +152,67 @@ namespace elga {
             /** Keep track of whether the agents are in an idle state */
             bool agents_idle_;
 
+            #ifdef CONFIG_LIVE_MIGRATION
+            /** The agents taking part in the running batch, or 0 between
+             * batches; agents joining mid-batch wait for the next one */
+            size_t batch_agents_;
+            #endif
+
             /** Keep our serialized address for printing */
             uint64_t addr_ser;
 
             #ifdef CONFIG_AUTOSCALE
-            absl::flat_hash_map<uint64_t, double> as_rate_;
+            /** The latest metrics from each agent, with the query rate
+             * as a moving average */
+            absl::flat_hash_map<uint64_t, agent_metrics_t> as_metrics_;
+            std::unique_ptr<ScalingPolicy> as_policy_;
             int as_wait_;
             absl::flat_hash_set<uint64_t> dead_agents_;
             size_t as_req_;
             #endif
+
+            #ifdef CONFIG_VA_BALANCE
+            /** The latest load from each agent */
+            absl::flat_hash_map<uint64_t, va_load_t> va_loads_;
+            VABalancer va_balancer_;
+            /** Heartbeats until the next balancing round */
+            size_t va_wait_;
+            /** The batch the last committed plan was measured on */
+            batch_t va_batch_;
+            /** Whether a batch is running */
+            bool va_running_;
+            #endif
         public:
             Directory(const ZMQAddress &addr, const ZMQAddress &directory_master) :
                     ZMQChatterbox(addr), agents_(),
                     dm_(directory_master), directories_(), notify_(false), notify_changed_(false),
+                    version_(0),
                     nV_(0), nE_(0),
+                    #ifdef CONFIG_EDGE_WINDOW
+                    max_timestamp_(0),
+                    #endif
                     #ifdef CONFIG_CS
                     cms_recv_(0),
                     #endif
                     simple_sync_(0),
+                    #ifdef CONFIG_TREE_BARRIER
+                    tree_parent_(0), tree_reported_(0),
+                    #endif
                     ready_ctr_(0),
+                    agg_sock_(NULL), agg_id_(0),
                     it_(0),
                     batch_(0), agents_idle_(false),
+                    #ifdef CONFIG_LIVE_MIGRATION
+                    batch_agents_(0),
+                    #endif
                     addr_ser(addr_.serialize())
                     #ifdef CONFIG_AUTOSCALE
-                    ,as_wait_(AUTOSCALE_EMA),as_req_(0)
+                    ,as_metrics_(),as_policy_(make_scaling_policy()),
+                    as_wait_(AUTOSCALE_EMA),as_req_(0)
+                    #endif
+                    #ifdef CONFIG_VA_BALANCE
+                    ,va_loads_(),va_balancer_(make_va_balancer()),
+                    va_wait_(VA_BALANCE_PERIOD),va_batch_(0),va_running_(false)
                     #endif
                     { }
 
@@ -127,6 +239,17 @@ namespace elga {
             void cs_update(const char *data, size_t cs_size);
             #endif
 
+            /** Start a client's aggregate query, asking every agent for
+             * its partial result */
+            void aggregate(zmq_socket_t sock, const char *data, size_t size);
+
+            /** Merge an agent's partial result into the running query */
+            void aggregate_part(const char *data, size_t size);
+
+            /** Reply to the client once every agent answered, or with
+             * what has arrived once AGG_TIMEOUT has passed */
+            void aggregate_check();
+
             /** Process a clean shutdown */
             void shutdown();
 
@@ -136,8 +259,76 @@ namespace elga {
             /** Process a heartbeat */
             bool heartbeat();
 
+            /** Publish the full directory, with the given update flag */
+            void pub_snapshot(uint8_t flag);
+
+            /** Publish the changes since the last published directory;
+             * return false if a snapshot would be smaller */
+            bool pub_delta();
+
+            /** Return the number of agents a barrier waits for */
+            size_t barrier_size() const {
+                #ifdef CONFIG_LIVE_MIGRATION
+                if (batch_agents_ > 0) return batch_agents_;
+                #endif
+                return agents_.size();
+            }
+
+            /** A batch is starting, so fix the agents taking part */
+            void begin_batch() {
+                #ifdef CONFIG_LIVE_MIGRATION
+                if (batch_agents_ == 0) batch_agents_ = agents_.size();
+                #endif
+                #ifdef CONFIG_VA_BALANCE
+                va_running_ = true;
+                #endif
+            }
+
+            /** The running batch finished */
+            void end_batch() {
+                ++batch_;
+                #ifdef CONFIG_LIVE_MIGRATION
+                batch_agents_ = 0;
+                #endif
+                #ifdef CONFIG_VA_BALANCE
+                va_running_ = false;
+                #endif
+            }
+
             /** Handle autoscaling */
             void autoscaler();
+
+            #ifdef CONFIG_VA_BALANCE
+            /** Plan and send out new virtual agent counts, every period or
+             * now if forced, once all agents report a new batch */
+            void balance_va(bool force);
+            #endif
+
+            #ifdef CONFIG_TREE_BARRIER
+            /** Return all directories, including us, in tree order */
+            std::vector<uint64_t> tree_order() const;
+
+            /** Return our parent in the tree, or 0 if we are the root */
+            uint64_t tree_parent() const;
+
+            /** Return our children in the tree */
+            std::vector<uint64_t> tree_children() const;
+
+            /** Report our subtree size to our parent if it changed */
+            void tree_update();
+
+            /** Add barrier arrivals for the given superstep */
+            void tree_ready(batch_t batch, it_t it, size_t count, size_t dormant, bool local);
+
+            /** Pass the superstep's counts up once our subtree arrived */
+            void tree_check(batch_t batch, it_t it);
+
+            /** Release the barrier down the tree and to our agents */
+            void tree_sync(size_t dormant, it_t it, batch_t batch);
+
+            /** Get a connection to another directory */
+            ZMQRequester& tree_req(uint64_t dir);
+            #endif
     };
 
 
@@ -0,0 +1,57 @@
+/**
+ * ElGA time-window edge expiry index
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "edgewindow.hpp"
+
+#include <stdexcept>
+
+using namespace elga;
+
+ExpiryIndex::ExpiryIndex(timestamp_t bucket_width, size_t max_buckets) :
+        width_(bucket_width), max_buckets_(max_buckets), base_(0), buckets_(), size_(0) {
+    if (width_ == 0) throw std::runtime_error("Expiry bucket width must be positive");
+    if (max_buckets_ == 0) throw std::runtime_error("Expiry ring must hold a bucket");
+}
+
+void ExpiryIndex::place(const entry_t &e, uint32_t count) {
+    size_t bucket = bucket_of(e.timestamp);
+    if (bucket >= buckets_.size())
+        buckets_.resize(bucket+1);
+    buckets_[bucket][e] += count;
+}
+
+void ExpiryIndex::insert(vertex_t src, vertex_t dst, timestamp_t timestamp) {
+    // Rebase an empty ring, so gaps in time do not leave empty buckets
+    if (size_ == 0) {
+        buckets_.clear();
+        base_ = timestamp - timestamp % width_;
+    }
+
+    place({src, dst, timestamp}, 1);
+    ++size_;
+}
+
+bool ExpiryIndex::erase(vertex_t src, vertex_t dst, timestamp_t timestamp) {
+    size_t bucket = bucket_of(timestamp);
+    if (bucket >= buckets_.size()) return false;
+
+    bucket_t &b = buckets_[bucket];
+    auto e_it = b.find(entry_t {src, dst, timestamp});
+    if (e_it == b.end()) return false;
+    if (--e_it->second == 0) b.erase(e_it);
+    --size_;
+
+    // Drop emptied buckets at the back, so the ring only spans held edges
+    while (!buckets_.empty() && buckets_.back().empty())
+        buckets_.pop_back();
+    return true;
+}
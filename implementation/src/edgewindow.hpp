@@ -0,0 +1,145 @@
+/**
+ * ElGA time-window edge expiry index
+ *
+ * Keeps references to timestamped edges in a ring of fixed-width time
+ * buckets, so that expiring everything older than a cutoff only touches
+ * the expired edges (and at most one partially expired bucket) rather
+ * than the whole graph.  The ring holds a bounded number of buckets;
+ * edges further ahead share the last one, and are checked one at a time
+ * when it expires.
+ *
+ * Each bucket counts its edges in a hash map, so an edge that is deleted
+ * or moved away is erased in constant time, and the index only holds
+ * edges still stored.
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#ifndef EDGE_WINDOW_HPP
+#define EDGE_WINDOW_HPP
+
+#include "types.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+namespace elga {
+
+    class ExpiryIndex {
+        public:
+            /** A reference to a single stored edge */
+            typedef struct entry {
+                vertex_t src;
+                vertex_t dst;
+                timestamp_t timestamp;
+
+                bool operator==(const struct entry &rhs) const {
+                    return src == rhs.src && dst == rhs.dst && timestamp == rhs.timestamp;
+                }
+                template <typename H>
+                friend H AbslHashValue(H h, const struct entry &e) {
+                    return H::combine(std::move(h), e.src, e.dst, e.timestamp);
+                }
+            } entry_t;
+
+        private:
+            /** Each bucket counts its entries, as multi-edges repeat */
+            typedef absl::flat_hash_map<entry_t, uint32_t> bucket_t;
+
+            /** The time span covered by each bucket */
+            timestamp_t width_;
+            /** The most buckets the ring may hold */
+            size_t max_buckets_;
+            /** The starting time of the front bucket */
+            timestamp_t base_;
+            std::deque<bucket_t> buckets_;
+            size_t size_;
+
+            /** Return the bucket holding timestamp, which may be past
+             * the end of the ring, but not past its largest size */
+            size_t bucket_of(timestamp_t timestamp) const {
+                size_t bucket = (timestamp >= base_) ? (timestamp - base_) / width_ : 0;
+                return std::min(bucket, max_buckets_-1);
+            }
+
+            /** Add count copies of an entry to its bucket */
+            void place(const entry_t &e, uint32_t count);
+
+        public:
+            ExpiryIndex(timestamp_t bucket_width, size_t max_buckets);
+
+            /** Record an edge; edges older than the front bucket are
+             * placed in the front bucket, and those past the largest
+             * ring in the last one */
+            void insert(vertex_t src, vertex_t dst, timestamp_t timestamp);
+
+            /** Forget one copy of an edge, returning whether it was held */
+            bool erase(vertex_t src, vertex_t dst, timestamp_t timestamp);
+
+            /** Remove every entry with a timestamp before cutoff, then
+             * call f on each one, once per copy, and return the number
+             * removed.  Erasing a removed entry from f does nothing. */
+            template<typename F>
+            size_t expire(timestamp_t cutoff, F &&f) {
+                std::vector<std::pair<entry_t, uint32_t>> expired;
+                std::vector<std::pair<entry_t, uint32_t>> later;
+                while (!buckets_.empty()) {
+                    bucket_t &front = buckets_.front();
+                    if (base_ + width_ <= cutoff) {
+                        // The whole bucket is expired, except for edges
+                        // placed in the last bucket from further ahead
+                        for (auto &e : front)
+                            ((e.first.timestamp < cutoff) ? expired : later).push_back(e);
+                        buckets_.pop_front();
+                        base_ += width_;
+                        continue;
+                    }
+                    // The front bucket straddles the cutoff
+                    for (auto e_it = front.begin(); e_it != front.end();) {
+                        if (e_it->first.timestamp < cutoff) {
+                            expired.push_back(*e_it);
+                            front.erase(e_it++);
+                        } else
+                            ++e_it;
+                    }
+                    break;
+                }
+                if (!later.empty() && buckets_.empty()) {
+                    timestamp_t first = later.front().first.timestamp;
+                    for (auto & [e, count] : later)
+                        first = std::min(first, e.timestamp);
+                    base_ = first - first % width_;
+                }
+                for (auto & [e, count] : later)
+                    place(e, count);
+
+                size_t num = 0;
+                for (auto & [e, count] : expired)
+                    num += count;
+                size_ -= num;
+                for (auto & [e, count] : expired)
+                    for (uint32_t c = 0; c < count; ++c)
+                        f(e);
+                return num;
+            }
+
+            /** Return the number of entries held */
+            size_t size() const { return size_; }
+
+            /** Return the number of buckets currently in the ring */
+            size_t num_buckets() const { return buckets_.size(); }
+    };
+
+}
+
+#endif
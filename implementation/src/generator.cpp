@@ -0,0 +1,102 @@
+/**
+ * ElGA synthetic graph generators
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "generator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace elga::generator;
+
+namespace {
+    // SplitMix64 finalizer
+    inline uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    /** Give up on avoiding self-loops after this many attempts */
+    const int MAX_ATTEMPTS = 64;
+}
+
+CounterRNG::CounterRNG(uint64_t seed, uint64_t stream) :
+        key_(mix(seed ^ mix(stream + 0x9e3779b97f4a7c15ull))), ctr_(0) { }
+
+uint64_t CounterRNG::next() {
+    return mix(key_ + (++ctr_) * 0x9e3779b97f4a7c15ull);
+}
+
+double CounterRNG::uniform() {
+    return (next() >> 11) * 0x1.0p-53;
+}
+
+std::pair<uint64_t, uint64_t> elga::generator::rank_range(uint64_t M, uint32_t r, uint32_t P) {
+    if (P == 0 || r >= P) throw std::runtime_error("Invalid rank");
+    uint64_t per = M/P;
+    uint64_t extra = M%P;
+    uint64_t start = r*per + std::min<uint64_t>(r, extra);
+    uint64_t end = start + per + (r < extra ? 1 : 0);
+    return {start, end};
+}
+
+RMAT::RMAT(uint32_t scale, uint64_t seed, double a, double b, double c) :
+        scale_(scale), seed_(seed), a_(a), ab_(a+b), abc_(a+b+c) {
+    if (scale_ == 0 || scale_ > 63) throw std::runtime_error("R-MAT scale must be in [1, 63]");
+    if (a < 0 || b < 0 || c < 0 || abc_ >= 1.0) throw std::runtime_error("Invalid R-MAT probabilities");
+}
+
+edge_t RMAT::edge(uint64_t idx) const {
+    CounterRNG rng(seed_, idx);
+    edge_t e;
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+        e.src = 0;
+        e.dst = 0;
+        // Descend into one quadrant per level
+        for (uint32_t level = 0; level < scale_; ++level) {
+            double p = rng.uniform();
+            e.src <<= 1;
+            e.dst <<= 1;
+            if (p < a_) continue;
+            if (p < ab_) e.dst |= 1;
+            else if (p < abc_) e.src |= 1;
+            else { e.src |= 1; e.dst |= 1; }
+        }
+        if (e.src != e.dst) return e;
+    }
+    throw std::runtime_error("Unable to generate an R-MAT edge without a self-loop");
+}
+
+ChungLu::ChungLu(uint64_t N, double gamma, uint64_t seed) :
+        N_(N), seed_(seed) {
+    if (N_ < 2) throw std::runtime_error("Chung-Lu needs at least two vertices");
+    if (gamma <= 2.0) throw std::runtime_error("Chung-Lu exponent must be greater than 2");
+    // Weights (i+1)^-alpha with alpha = 1/(gamma-1) have a CDF of about
+    // (x/N)^(1-alpha), which inverts in closed form
+    double alpha = 1.0/(gamma-1.0);
+    inv_exp_ = 1.0/(1.0-alpha);
+}
+
+edge_t ChungLu::edge(uint64_t idx) const {
+    CounterRNG rng(seed_, idx);
+    auto endpoint = [&]() -> vertex_t {
+        vertex_t v = (vertex_t)(N_ * std::pow(rng.uniform(), inv_exp_));
+        return (v < N_) ? v : N_-1;
+    };
+    edge_t e;
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+        e.src = endpoint();
+        e.dst = endpoint();
+        if (e.src != e.dst) return e;
+    }
+    throw std::runtime_error("Unable to generate a Chung-Lu edge without a self-loop");
+}
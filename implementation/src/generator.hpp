@@ -0,0 +1,82 @@
+/**
+ * ElGA synthetic graph generators
+ *
+ * Generators produce the i'th edge of a graph as a pure function of the
+ * seed and i, so any rank can generate any subset of the edges in
+ * parallel, without coordination, and reproducibly.
+ * Multi-edges are not removed; agents remove them when leaving the
+ * NO_PROCESS state.
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include "types.hpp"
+
+#include <utility>
+
+namespace elga::generator {
+
+    /** A counter-based random number generator, where each (seed, stream)
+     * pair selects an independent sequence */
+    class CounterRNG {
+        private:
+            uint64_t key_;
+            uint64_t ctr_;
+        public:
+            CounterRNG(uint64_t seed, uint64_t stream);
+
+            /** Return the next 64 random bits */
+            uint64_t next();
+
+            /** Return a uniform double in [0, 1) */
+            double uniform();
+    };
+
+    /** Return the [start, end) edge indices generated by rank r of P */
+    std::pair<uint64_t, uint64_t> rank_range(uint64_t M, uint32_t r, uint32_t P);
+
+    /** Recursive matrix (R-MAT) generator over 2^scale vertices */
+    class RMAT {
+        private:
+            uint32_t scale_;
+            uint64_t seed_;
+            double a_, ab_, abc_;
+        public:
+            /** Defaults to the Graph 500 parameters */
+            RMAT(uint32_t scale, uint64_t seed, double a=0.57, double b=0.19, double c=0.19);
+
+            /** Return the idx'th edge; self-loops are never produced */
+            edge_t edge(uint64_t idx) const;
+
+            uint64_t num_vertices() const { return 1ull << scale_; }
+    };
+
+    /** Chung-Lu generator, where vertex i has expected degree
+     * proportional to (i+1)^(-1/(gamma-1)), giving a power-law degree
+     * distribution with exponent gamma */
+    class ChungLu {
+        private:
+            uint64_t N_;
+            uint64_t seed_;
+            double inv_exp_;
+        public:
+            ChungLu(uint64_t N, double gamma, uint64_t seed);
+
+            /** Return the idx'th edge; self-loops are never produced */
+            edge_t edge(uint64_t idx) const;
+
+            uint64_t num_vertices() const { return N_; }
+    };
+
+}
+
+#endif
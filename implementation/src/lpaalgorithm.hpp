@@ -67,6 +67,16 @@ typedef struct VertexStorage {
     uint64_t self;
     std::vector<vertex_t> in_neighbors;
     std::vector<vertex_t> out_neighbors;
+    #ifdef CONFIG_EDGE_WEIGHTS
+    /** Edge weights, parallel to the neighbor lists */
+    std::vector<weight_t> in_weights;
+    std::vector<weight_t> out_weights;
+    #endif
+    #ifdef CONFIG_EDGE_TIMESTAMPS
+    /** Edge timestamps, parallel to the neighbor lists */
+    std::vector<timestamp_t> in_timestamps;
+    std::vector<timestamp_t> out_timestamps;
+    #endif
     std::unordered_map<it_t, std::unordered_map<uint64_t, ReplicaLocalStorage>> replica_storage;
     VertexStorage() : vertex(std::numeric_limits<vertex_t>::max()) { }
 } VertexStorage;
@@ -89,6 +99,11 @@ class LPAAlgorithm {
         size_t const query_resp_size() { return sizeof(vertex_t); }
         void const query(char* d, VertexStorage &v) { *(vertex_t*)d = v.local.lp; }
         void const query(char* d) { *(vertex_t*)d = -1; }
+        /** Unset values are infinite, so rankings skip them */
+        double const query_value(const char* d) {
+            vertex_t x = *(const vertex_t*)d;
+            return x == std::numeric_limits<vertex_t>::max() ? INFINITY : (double)x;
+        }
 };
 
 using Algorithm = LPAAlgorithm;
@@ -27,6 +27,10 @@
 #include "streamer.hpp"
 #include "client.hpp"
 #include "agent.hpp"
+#include "bench.hpp"
+#include "autoscale.hpp"
+#include "placementtable.hpp"
+#include "sketchbench.hpp"
 
 #ifdef USE_NUMA
 #ifdef CONFIG_USE_NUMA
@@ -59,7 +63,14 @@ int help_() {
         "    streamer : streams changes into ElGA\n"
         "    client : queries ElGA\n"
         "    agent : runs agents on the node to maintain the graph and\n"
-        "        execute algorithms\n\n"
+        "        execute algorithms\n"
+        "    bench : runs a local cluster with -P agents in this process\n"
+        "        and benchmarks ingestion\n"
+        "    autoscale-sim : replays a directory's metrics trace against\n"
+        "        an autoscaling policy offline\n"
+        "    placement-bench : compares vertex placement by the ring and\n"
+        "        by the placement table\n"
+        "    sketch-bench : measures the sketches' throughput and accuracy\n\n"
         "Options:\n"
         "    -d : required, IP address of the directory master, required\n"
         "    -B : local number base to start at for multiple processes\n"
@@ -110,6 +121,8 @@ void thread(localnum_t ln, localnum_t num_cores,
         res = elga::directory::main(argc, argv, dm, ln);
     else if (command == "agent")
         res = elga::agent::main(argc, argv, dm, ln);
+    else if (command == "bench")
+        res = elga::bench::main(argc, argv, dm, num_cores);
     else
         throw arg_error("Unknown command.");
 
@@ -181,6 +194,14 @@ int main_(int argc, char **argv) {
         }
     }
 
+    // The autoscaling simulation runs offline, without a cluster
+    if (command == "autoscale-sim")
+        return elga::autoscale::main(argc-optind, (const char**)&(argv[optind]));
+    if (command == "placement-bench")
+        return elga::placement::main(argc-optind, (const char**)&(argv[optind]));
+    if (command == "sketch-bench")
+        return elga::sketchbench::main(argc-optind, (const char**)&(argv[optind]));
+
     if (dir_ip.length() == 0)
         throw arg_error("directory-ip is a required argument");
 
@@ -200,11 +221,19 @@ int main_(int argc, char **argv) {
 
     local_base = ln_base;
     local_max = ln_base+num_cores;
+    // The benchmark runs from one thread, and itself uses local numbers
+    // for the directory master, the directory, and each agent
+    size_t num_threads = num_cores;
+    if (command == "bench") {
+        if (ln_base != 0) throw arg_error("The benchmark requires base 0");
+        local_max = ln_base+num_cores+2;
+        num_threads = 1;
+    }
     if (local_max < local_base)
         throw arg_error("Num cores, base too large");
 
     std::vector<std::thread> ln_threads;
-    for (localnum_t ln = local_base; ln < local_max; ++ln) {
+    for (localnum_t ln = local_base; ln < local_base+num_threads; ++ln) {
         #ifdef CONFIG_USE_NUMA
         ln_threads.push_back(std::thread([ln, num_cores, &topology, &command, &directory, nargc, &nargv]{ thread(ln, num_cores, topology, command, directory, nargc, nargv); }));
         #else
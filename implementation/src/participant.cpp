@@ -11,6 +11,8 @@
  */
 
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 
 #include "pack.hpp"
 #include "participant.hpp"
@@ -25,6 +27,13 @@ Participant::Participant(ZMQAddress addr, const ZMQAddress &dm, bool persist) :
         lru_(), lru_lookup_(),
         ready_(false), ch_(agents_, rm_), d_req_(),
         num_agents_(0), num_vagents_(0),
+        #ifdef CONFIG_LIVE_MIGRATION
+        serving_agents_(), serving_real_agents_(), serving_rm_(), serving_ch_(), route_newest_(false),
+        #endif
+        dir_version_(0), need_snapshot_(true),
+        #ifdef CONFIG_CS
+        rm_version_(0),
+        #endif
         #ifdef CONFIG_TIME_FIND_AGENTS
         find_agent_t("agent_find"),
         #endif
@@ -53,10 +62,12 @@ Participant::Participant(ZMQAddress addr, const ZMQAddress &dm, bool persist) :
     // Meaning: sub to its updates and notify it to send an update
     sub(HEARTBEAT);
     sub(SHUTDOWN);
-    char du_all[] = {DIRECTORY_UPDATE, 0x0};
+    char du_all[] = {DIRECTORY_UPDATE, DIRECTORY_SNAPSHOT};
     sub(du_all, sizeof(du_all));
-    char du_changes[] = {DIRECTORY_UPDATE, 0x1};
+    char du_changes[] = {DIRECTORY_UPDATE, DIRECTORY_SNAPSHOT_CHANGED};
     sub(du_changes, sizeof(du_changes));
+    char du_delta[] = {DIRECTORY_UPDATE, DIRECTORY_DELTA};
+    sub(du_delta, sizeof(du_delta));
     sub(DISCONNECT);
     sub_connect(directory_);
 
@@ -113,66 +124,142 @@ bool Participant::do_poll(bool drain) {
     if (drain && socks.size() == 0) return false;
     working_ = false;
     for (auto sock : socks) {
-        // Retrieve the message to determine the type
-        ZMQMessage msg(sock);
-
-        size_t total_size = msg.size();
-
-        if (total_size < sizeof(msg_type_t)) throw std::runtime_error("Message too small");
-
-        // Read out the message type and data
-        const char *data = msg.data();
-
-        msg_type_t type = unpack_msg(data);
-
-        #ifdef DEBUG_VERBOSE
-        std::cerr << "[ElGA : Participant] got message: " << (int)type << std::endl;
-        #endif
-
-        switch (type) {
-            case SHUTDOWN: {
-                // If we receieve a shutdown, the system is going down
-                // Stop the server, no need for cleanup
-                keep_running = false;
-                break; }
-            case HEARTBEAT:
-                break;
-            case DIRECTORY_UPDATE: {
-                uint8_t changed;
-                unpack_single(data, changed);
-                directory_update(data, total_size-sizeof(msg_type_t)-sizeof(uint8_t));
-                if (changed != 0)
-                    handle_directory_update();
-                break; }
-            case DISCONNECT: {
-                throw std::runtime_error("Unimplemented");
-                break; }
-            default: {
-                working_ = true;
-                if (!handle_msg(sock, type, data, total_size-sizeof(msg_type_t)))
-                    throw std::runtime_error("Unknown message");
-                break; }
+        // Handle a run of messages from the pull socket if allowed, to
+        // avoid a poll per message
+        size_t batch = is_pull(sock) ? pull_batch() : 1;
+        for (size_t ctr = 0; ctr < batch && keep_running; ++ctr) {
+            // Retrieve the message to determine the type
+            ZMQMessage msg(sock, ctr == 0);
+            if (ctr > 0 && msg.size() == (size_t)-1) break;
+
+            size_t total_size = msg.size();
+
+            if (total_size < sizeof(msg_type_t)) throw std::runtime_error("Message too small");
+
+            // Read out the message type and data
+            const char *data = msg.data();
+
+            msg_type_t type = unpack_msg(data);
+
+            #ifdef DEBUG_VERBOSE
+            std::cerr << "[ElGA : Participant] got message: " << (int)type << std::endl;
+            #endif
+
+            switch (type) {
+                case SHUTDOWN: {
+                    // If we receieve a shutdown, the system is going down
+                    // Stop the server, no need for cleanup
+                    keep_running = false;
+                    break; }
+                case HEARTBEAT:
+                    break;
+                case DIRECTORY_UPDATE: {
+                    uint8_t flag;
+                    unpack_single(data, flag);
+                    if (directory_update(flag, data, total_size-sizeof(msg_type_t)-sizeof(uint8_t)))
+                        handle_directory_update();
+                    break; }
+                case DISCONNECT: {
+                    throw std::runtime_error("Unimplemented");
+                    break; }
+                default: {
+                    working_ = true;
+                    if (!handle_msg(sock, type, data, total_size-sizeof(msg_type_t)))
+                        throw std::runtime_error("Unknown message");
+                    break; }
+            }
         }
     }
     return keep_running;
 }
 
-void Participant::directory_update(const char *data, size_t size) {
+bool Participant::directory_update(uint8_t flag, const char *data, size_t size) {
     #ifdef DEBUG_VERBOSE
     std::cerr << "[ElGA : Participant] received directory of size " << size << std::endl;
     #endif
 
-    if (!ready_) {
+    uint64_t version;
+    if (size < sizeof(version)) throw std::runtime_error("Directory update too small");
+    unpack_single(data, version);
+    size -= sizeof(version);
+
+    if (flag == DIRECTORY_DELTA) {
+        // Deltas only apply on top of the previous version; if we are
+        // still waiting on a snapshot, it may have been lost
+        if (version <= dir_version_ && !need_snapshot_)
+            return false;
+        if (need_snapshot_ || version != dir_version_+1) {
+            if (!need_snapshot_)
+                std::cerr << "[ElGA : Participant] missed directory " << dir_version_+1 << ", got " << version << std::endl;
+            request_snapshot();
+            return false;
+        }
+        hold_current_ring();
+        directory_delta(data, size);
+        dir_version_ = version;
+        return true;
+    }
+
+    // Unchanged snapshots are only needed to (re)join
+    if (flag == DIRECTORY_SNAPSHOT && !need_snapshot_)
+        return false;
+
+    // Recovering from a gap means the missed updates were changes
+    bool changed = (flag != DIRECTORY_SNAPSHOT) || ready_;
+
+    if (need_snapshot_) {
         // Change our subscription to only get changed updates
-        char du_all[] = {DIRECTORY_UPDATE, 0x0};
+        char du_all[] = {DIRECTORY_UPDATE, DIRECTORY_SNAPSHOT};
         unsub(du_all, sizeof(du_all));
+        need_snapshot_ = false;
     }
 
-    num_agents_ = (size
-        #ifdef CONFIG_CS
-        - CountMinSketch::size()
-        #endif
-        )/sizeof(uint64_t) ;
+    if (changed) hold_current_ring();
+    directory_snapshot(data, size);
+    dir_version_ = version;
+
+    return changed;
+}
+
+void Participant::hold_current_ring() {
+    #ifdef CONFIG_LIVE_MIGRATION
+    if (serving_ch_ || !ready_ || !hold_ring()) return;
+    serving_agents_ = agents_;
+    serving_real_agents_ = real_agents_;
+    #ifdef CONFIG_HUB_LIST
+    serving_rm_.update(rm_.hubs());
+    #elif defined(CONFIG_COMPACT_SKETCH)
+    serving_rm_ = rm_;
+    #elif defined(CONFIG_CS)
+    serving_rm_.update(rm_.serialize());
+    #endif
+    serving_ch_ = std::make_unique<Placement>(serving_agents_, serving_rm_);
+    #endif
+}
+
+void Participant::request_snapshot() {
+    need_snapshot_ = true;
+    char du_all[] = {DIRECTORY_UPDATE, DIRECTORY_SNAPSHOT};
+    sub(du_all, sizeof(du_all));
+    ZMQRequester d_req(directory_, addr_, PULL);
+    d_req.send(NEED_DIRECTORY);
+}
+
+void Participant::directory_snapshot(const char *data, size_t size) {
+    #ifdef CONFIG_HUB_LIST
+    // The hub list ends the message, in place of the sketch
+    size_t cms_size = rm_.update(data, size);
+    note_rm(data+size-cms_size, cms_size);
+    #elif defined(CONFIG_COMPACT_SKETCH)
+    // The compressed sketch ends the message, with its size last
+    size_t cms_size = rm_.update(data, size);
+    note_rm(data+size-cms_size, cms_size);
+    #elif defined(CONFIG_CS)
+    size_t cms_size = CountMinSketch::size();
+    #else
+    size_t cms_size = 0;
+    #endif
+    num_agents_ = (size-cms_size)/sizeof(uint64_t);
     // Read the incoming directory and sketch
     std::vector<uint64_t> agents;
 
@@ -196,8 +283,10 @@ void Participant::directory_update(const char *data, size_t size) {
 
     ch_.update_agents(agents_);
 
-    #ifdef CONFIG_CS
+    #if defined(CONFIG_CS) && !defined(CONFIG_HUB_LIST) && !defined(CONFIG_COMPACT_SKETCH)
     // Next, replace the sketch
+    if (std::memcmp(rm_.serialize(), data+size-CountMinSketch::size(), CountMinSketch::size()) != 0)
+        ++rm_version_;
     rm_.update(data+size-CountMinSketch::size());
     #endif
 
@@ -208,6 +297,84 @@ void Participant::directory_update(const char *data, size_t size) {
     #endif
 }
 
+void Participant::directory_delta(const char *data, size_t size) {
+    const char *end = data+size;
+    uint64_t num_added, num_removed;
+    if (size < sizeof(num_added)+sizeof(num_removed)) throw std::runtime_error("Directory delta too small");
+    unpack_single(data, num_added);
+    unpack_single(data, num_removed);
+    if ((size_t)(end-data) < (num_added+num_removed)*sizeof(uint64_t))
+        throw std::runtime_error("Directory delta too small");
+
+    const uint64_t *added_agents = (const uint64_t*)data;
+    const uint64_t *removed_agents = added_agents+num_added;
+    data += (num_added+num_removed)*sizeof(uint64_t);
+
+    // Expand each changed agent into its virtual agents; removals go
+    // first, as an agent changing its virtual agents is in both lists
+    std::vector<uint64_t> added, removed;
+    for (uint64_t ctr = 0; ctr < num_removed; ++ctr) {
+        aid_t num_vagents;
+        uint64_t agent_serial;
+        unpack_agent(removed_agents[ctr], agent_serial, num_vagents);
+        real_agents_.erase(std::remove(real_agents_.begin(), real_agents_.end(), agent_serial), real_agents_.end());
+        for (aid_t va = 0; va < num_vagents; ++va)
+            removed.push_back(pack_agent(agent_serial, va));
+    }
+    for (uint64_t ctr = 0; ctr < num_added; ++ctr) {
+        aid_t num_vagents;
+        uint64_t agent_serial;
+        unpack_agent(added_agents[ctr], agent_serial, num_vagents);
+        real_agents_.push_back(agent_serial);
+        for (aid_t va = 0; va < num_vagents; ++va)
+            added.push_back(pack_agent(agent_serial, va));
+    }
+
+    if (removed.size() > 0) {
+        absl::flat_hash_set<uint64_t> removed_set(removed.begin(), removed.end());
+        agents_.erase(std::remove_if(agents_.begin(), agents_.end(),
+                    [&removed_set](uint64_t a) { return removed_set.count(a) > 0; }),
+                agents_.end());
+        ch_.remove_agents(removed);
+    }
+    if (added.size() > 0) {
+        agents_.insert(agents_.end(), added.begin(), added.end());
+        ch_.add_agents(added);
+    }
+
+    num_agents_ = real_agents_.size();
+    num_vagents_ = agents_.size();
+
+    #ifdef CONFIG_HUB_LIST
+    // Finally, the whole hub list
+    if (rm_.update(data, end-data) != (size_t)(end-data))
+        throw std::runtime_error("Directory delta has a malformed hub list");
+    note_rm(data, end-data);
+    #elif defined(CONFIG_COMPACT_SKETCH)
+    // Finally, the whole compressed sketch
+    if (rm_.update(data, end-data) != (size_t)(end-data))
+        throw std::runtime_error("Directory delta has a malformed sketch");
+    note_rm(data, end-data);
+    #elif defined(CONFIG_CS)
+    // Finally, the changed sketch cells
+    if (end > data) ++rm_version_;
+    rm_.apply_delta(data, end-data);
+    #endif
+
+    #ifdef DEBUG_VERBOSE
+    std::cerr << "[ElGA : Participant] applied directory delta to " << num_agents_ << " agents (" << num_vagents_ << " virtual)" << std::endl;
+    #endif
+}
+
+#if defined(CONFIG_HUB_LIST) || defined(CONFIG_COMPACT_SKETCH)
+void Participant::note_rm(const char *data, size_t size) {
+    if (rm_bytes_.size() == size && std::equal(rm_bytes_.begin(), rm_bytes_.end(), data))
+        return;
+    rm_bytes_.assign(data, data+size);
+    ++rm_version_;
+}
+#endif
+
 uint64_t Participant::find_agent(edge_t e, edge_type et, bool find_owner, uint64_t owner_check, bool &have_ownership, bool return_va) {
     #ifdef CONFIG_TIME_FIND_AGENTS
     find_agent_t.tick();
@@ -232,21 +399,16 @@ uint64_t Participant::find_agent(edge_t e, edge_type et, bool find_owner, uint64
     std::cerr << "[ElGA : Participant] searching for owner for " << u << " first " << (int)(et == IN) << ":" << e.src<<"->"<<e.dst << std::endl;
     #endif
 
+    Placement &ch = route_ch();
     uint64_t dest;
     if (!find_owner) {
         // We want to use a uniform random query to load balance
-        dest = ch_.find_one(u, owner_check, have_ownership);
+        dest = ch.find_one(u, owner_check, have_ownership);
     } else {
-        auto dests = ch_.find(u);
-        if (dests.size() == 1) {
-            dest = dests[0];
-        } else {
-            // Find its position in the second ring
-            NoReplication rm;
-            ConsistentHasher ch(dests, rm);
-            bool dummy;
-            dest = ch.find_one(v, 0, dummy);
-        }
+        // A replicated vertex's edges are split over its replicas by
+        // the other endpoint
+        auto dests = ch.find(u);
+        dest = (dests.size() == 1) ? dests[0] : rendezvous(dests, v);
         have_ownership = false;
     }
 
@@ -18,13 +18,24 @@
 #include "address.hpp"
 #include "chatterbox.hpp"
 #include "consistenthasher.hpp"
+#ifdef CONFIG_PLACEMENT_TABLE
+#include "placementtable.hpp"
+#endif
 
 #include <tuple>
 #include "absl/container/flat_hash_map.h"
 #include <list>
+#include <memory>
 
 namespace elga {
 
+    /** How vertices are placed on agents */
+    #ifdef CONFIG_PLACEMENT_TABLE
+    using Placement = PlacementTable;
+    #else
+    using Placement = ConsistentHasher;
+    #endif
+
     /**
      * A Participant is a node that will connect to the directory and
      * determine how to access the graph, using consistent hashing and
@@ -53,7 +64,11 @@ namespace elga {
             std::vector<uint64_t> agents_;
         protected:
             /** Keep track of replication */
-            #ifdef CONFIG_CS
+            #ifdef CONFIG_HUB_LIST
+            HHReplicationMap rm_;
+            #elif defined(CONFIG_COMPACT_SKETCH)
+            CompactReplicationMap rm_;
+            #elif defined(CONFIG_CS)
             CMSReplicationMap rm_;
             #else
             NoReplication rm_;
@@ -66,7 +81,7 @@ namespace elga {
             bool ready_;
 
             /** Support consistent hashing for identifying agents */
-            ConsistentHasher ch_;
+            Placement ch_;
 
             /** Keep an open connection to the directory */
             ZMQRequester d_req_;
@@ -75,6 +90,67 @@ namespace elga {
             size_t num_agents_;
             size_t num_vagents_;
 
+            #ifdef CONFIG_LIVE_MIGRATION
+            /** While a ring change is held, the ring as of when it
+             * arrived, which routes until release_ring() */
+            std::vector<uint64_t> serving_agents_;
+            std::vector<uint64_t> serving_real_agents_;
+            #ifdef CONFIG_HUB_LIST
+            HHReplicationMap serving_rm_;
+            #elif defined(CONFIG_COMPACT_SKETCH)
+            CompactReplicationMap serving_rm_;
+            #elif defined(CONFIG_CS)
+            CMSReplicationMap serving_rm_;
+            #else
+            NoReplication serving_rm_;
+            #endif
+            std::unique_ptr<Placement> serving_ch_;
+            /** Route by the newest ring even while one is held */
+            bool route_newest_;
+
+            /** Return whether ring changes should be held; the newest
+             * ring is still installed, but only routes when asked to */
+            virtual bool hold_ring() const { return false; }
+
+            /** Route by the newest ring from now on */
+            void release_ring() { serving_ch_.reset(); }
+
+            bool ring_held() const { return (bool)serving_ch_; }
+            #endif
+
+            /** Return the ring to route by */
+            Placement &route_ch() {
+                #ifdef CONFIG_LIVE_MIGRATION
+                if (serving_ch_ && !route_newest_) return *serving_ch_;
+                #endif
+                return ch_;
+            }
+
+            /** Return the real agents of the ring routed by */
+            const std::vector<uint64_t> &route_real_agents() const {
+                #ifdef CONFIG_LIVE_MIGRATION
+                if (serving_ch_ && !route_newest_) return serving_real_agents_;
+                #endif
+                return real_agents_;
+            }
+
+            /** The installed directory version, and whether a full
+             * snapshot is needed before deltas can be applied */
+            uint64_t dir_version_;
+            bool need_snapshot_;
+
+            #ifdef CONFIG_CS
+            /** Bumped whenever the replication map changes, so which
+             * vertices are replicated is only rechecked then */
+            uint64_t rm_version_;
+            #if defined(CONFIG_HUB_LIST) || defined(CONFIG_COMPACT_SKETCH)
+            /** The encoded replication map as last received */
+            std::vector<char> rm_bytes_;
+            /** Bump rm_version_ if the encoded map differs */
+            void note_rm(const char *data, size_t size);
+            #endif
+            #endif
+
             /** Keep track of whether we are doing actual work */
             bool working_;
 
@@ -98,12 +174,30 @@ namespace elga {
             /** Support custom actions after a directory update */
             virtual void handle_directory_update() { }
 
-            /** Handle a directory update */
-            void directory_update(const char *data, size_t size);
+            /** Handle a directory update, returning true if the
+             * directory changed */
+            bool directory_update(uint8_t flag, const char *data, size_t size);
+
+            /** Install a full directory snapshot */
+            void directory_snapshot(const char *data, size_t size);
+
+            /** Keep the installed ring to route by if a change must be
+             * held */
+            void hold_current_ring();
+
+            /** Apply a directory delta to the installed directory */
+            void directory_delta(const char *data, size_t size);
+
+            /** Ask the directory for a full snapshot */
+            void request_snapshot();
 
             /** Handle participant specific actions before a general poll */
             virtual void pre_poll() { }
 
+            /** The most messages to handle from the pull socket in one
+             * poll, before returning to pre_poll */
+            virtual size_t pull_batch() const { return 1; }
+
             /** Perform a poll loop, checking for participant messages.
              * If drain=true, then it will return false when there are no
              * more messages and will not block.
@@ -115,9 +209,12 @@ namespace elga {
             /** Perform a heartbeat */
             virtual bool heartbeat() { return true; }
 
+            /** Return the number of real agents in the installed directory */
+            size_t num_agents() const { return num_agents_; }
+
             /** Count the number of replicas for a vertex */
             int32_t count_agent_reps(vertex_t v) {
-                return ch_.count_reps(v)-1;
+                return route_ch().count_reps(v)-1;
             }
 
             /** Find the destination agent for a given edge
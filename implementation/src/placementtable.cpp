@@ -0,0 +1,347 @@
+/**
+ * ElGA placement table
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "placementtable.hpp"
+
+#include "pack.hpp"
+#include "timer.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <locale>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+const uint64_t agent_mask = (1llu<<49)-1;
+const uint32_t empty_slot = std::numeric_limits<uint32_t>::max();
+
+PlacementTable::PlacementTable(std::vector<uint64_t> &agents, ReplicationMap &rm,
+        size_t bits) :
+                rm_(rm), bits_(bits), groups_(), entries_(), num_placed_(0),
+                table_() {
+    if (bits_ < 1 || bits_ > 30)
+        throw std::runtime_error("Placement table bits must be between 1 and 30");
+
+    update_agents(agents);
+}
+
+void PlacementTable::rebuild() {
+    entries_.clear();
+    table_.clear();
+    num_placed_ = 0;
+    size_t n = groups_.size();
+    if (n == 0) return;
+
+    // Quotas follow the virtual agent counts, with the slots left over
+    // going to the largest remainders
+    uint64_t M = 1llu << bits_;
+    uint64_t W = 0;
+    for (auto & [agent, vagents] : groups_)
+        W += vagents.size();
+
+    std::vector<uint64_t> base(n), weight(n), quota(n), offset(n), skip(n);
+    std::vector<std::pair<uint64_t, size_t>> remainders;
+    uint64_t assigned = 0;
+    size_t idx = 0;
+    for (auto & [agent, vagents] : groups_) {
+        base[idx] = entries_.size();
+        entries_.insert(entries_.end(), vagents.begin(), vagents.end());
+        weight[idx] = vagents.size();
+        quota[idx] = M*weight[idx]/W;
+        assigned += quota[idx];
+        remainders.push_back({M*weight[idx]%W, idx});
+
+        // Each agent's own permutation of the slots; an odd skip visits
+        // every slot of a power of two table
+        offset[idx] = hashing::hash(agent) & (M-1);
+        skip[idx] = (hashing::hash(agent ^ 0x9e3779b97f4a7c15llu) | 1) & (M-1);
+        ++idx;
+    }
+    std::stable_sort(remainders.begin(), remainders.end(),
+            [](const auto &a, const auto &b) { return a.first > b.first; });
+    for (size_t r = 0; assigned < M; ++r, ++assigned)
+        ++quota[remainders[r].second];
+
+    // Agents take turns claiming their next free preferred slot
+    table_.assign(M, empty_slot);
+    std::vector<uint64_t> next(n, 0), filled(n, 0);
+    for (uint64_t total = 0; total < M;) {
+        for (idx = 0; idx < n; ++idx) {
+            if (filled[idx] == quota[idx]) continue;
+            uint64_t c;
+            do {
+                c = (offset[idx] + next[idx]*skip[idx]) & (M-1);
+                ++next[idx];
+            } while (table_[c] != empty_slot);
+            table_[c] = base[idx] + filled[idx] % weight[idx];
+            ++filled[idx];
+            ++total;
+        }
+    }
+
+    for (idx = 0; idx < n; ++idx)
+        if (quota[idx] > 0) ++num_placed_;
+}
+
+std::vector<uint64_t> PlacementTable::find(uint64_t key) {
+    std::vector<uint64_t> response;
+    if (table_.size() == 0) return response;
+
+    size_t replication = std::min<size_t>(rm_.query(key), num_placed_);
+    response.reserve(replication);
+
+    // Replicas go to the next slots held by other real agents
+    uint64_t mask = table_.size()-1;
+    uint64_t s = slot(key);
+    response.push_back(entries_[table_[s]]);
+    for (uint64_t j = 1; response.size() < replication; ++j) {
+        uint64_t e = entries_[table_[(s+j) & mask]];
+        bool seen = false;
+        for (uint64_t r : response) {
+            if ((r & agent_mask) == (e & agent_mask)) {
+                seen = true;
+                break;
+            }
+        }
+        if (!seen) response.push_back(e);
+    }
+
+    return response;
+}
+
+uint64_t PlacementTable::find_one(uint64_t key, uint64_t owner_check, bool &have_ownership) {
+    std::vector<uint64_t> containers = find(key);
+
+    have_ownership = false;
+
+    if (containers.size() == 0) return 0;
+
+    if (owner_check != 0) {
+        for (auto c : containers) {
+            if ((c & agent_mask) == owner_check) {
+                have_ownership = true;
+                break;
+            }
+        }
+    }
+
+    std::random_device rd;
+    std::mt19937 mt(rd());
+    std::uniform_int_distribution<size_t> dist(0, containers.size()-1);
+
+    return containers[dist(mt)];
+}
+
+std::vector<hash_range_t> PlacementTable::owned_ranges(uint64_t agent_ser) const {
+    // Slot s holds the hashes with s as their top bits
+    std::vector<hash_range_t> ranges;
+    size_t shift = 64-bits_;
+    for (uint64_t s = 0; s < table_.size(); ++s) {
+        if ((entries_[table_[s]] & agent_mask) != agent_ser) continue;
+
+        uint64_t lo = s << shift;
+        uint64_t hi = (s == table_.size()-1) ? std::numeric_limits<uint64_t>::max() : ((s+1) << shift)-1;
+        if (ranges.size() > 0 && ranges.back().second+1 == lo)
+            ranges.back().second = hi;
+        else
+            ranges.push_back({lo, hi});
+    }
+    return ranges;
+}
+
+void PlacementTable::update_agents(std::vector<uint64_t> &agents) {
+    groups_.clear();
+    for (uint64_t agent : agents)
+        groups_[agent & agent_mask].push_back(agent);
+    for (auto & [agent, vagents] : groups_)
+        std::sort(vagents.begin(), vagents.end());
+    rebuild();
+}
+
+void PlacementTable::add_agents(const std::vector<uint64_t> &agents) {
+    for (uint64_t agent : agents) {
+        auto &vagents = groups_[agent & agent_mask];
+        vagents.insert(std::upper_bound(vagents.begin(), vagents.end(), agent), agent);
+    }
+    rebuild();
+}
+
+void PlacementTable::remove_agents(const std::vector<uint64_t> &agents) {
+    for (uint64_t agent : agents) {
+        auto it = groups_.find(agent & agent_mask);
+        if (it == groups_.end()) continue;
+        auto &vagents = it->second;
+        vagents.erase(std::remove(vagents.begin(), vagents.end(), agent), vagents.end());
+        if (vagents.size() == 0) groups_.erase(it);
+    }
+    rebuild();
+}
+
+namespace elga::placement {
+
+    /** What is measured for each placement */
+    typedef struct result {
+        size_t entries;
+        double build_ms;
+        double lookup_ns;
+        /** Most keys on a real agent over the mean */
+        double imbalance;
+        /** Keys changing real agent when one joins, or one leaves */
+        double moved_join;
+        double moved_leave;
+    } result_t;
+
+    void print_usage() {
+        std::cout << "Usage: placement-bench [options]" << std::endl;
+    }
+
+    int print_help() {
+        std::cout << "\n"
+            "ElGA placement benchmark.\n"
+            "Compares the consistent hashing ring with the placement table\n"
+            "on lookup time, balance across real agents, and the keys that\n"
+            "move when an agent joins or leaves, printing JSON.\n"
+            "Options:\n"
+            "    help : display this help message\n"
+            "    +agents N : real agents (default 64)\n"
+            "    +vagents V : virtual agents each (default STARTING_VAGENTS)\n"
+            "    +keys K : keys to place (default 1000000)\n"
+            "    +bits B : placement table bits (default PLACEMENT_TABLE_BITS)\n"
+            << std::endl;
+        return 0;
+    }
+
+    /** The real agent owning each key */
+    template <class P>
+    std::vector<uint64_t> owners(P &p, uint64_t keys) {
+        std::vector<uint64_t> res(keys);
+        for (uint64_t k = 0; k < keys; ++k)
+            res[k] = p.find(k)[0] & agent_mask;
+        return res;
+    }
+
+    double moved(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b) {
+        size_t count = 0;
+        for (size_t k = 0; k < a.size(); ++k)
+            if (a[k] != b[k]) ++count;
+        return (double)count/a.size();
+    }
+
+    template <class P, class... Args>
+    result_t measure(std::vector<uint64_t> &agents, const std::vector<uint64_t> &joining,
+            const std::vector<uint64_t> &leaving, size_t num_agents, uint64_t keys,
+            Args... args) {
+        result_t r;
+        NoReplication rm;
+
+        timer::Timer build_t("build");
+        build_t.tick();
+        P p(agents, rm, args...);
+        build_t.tock();
+        r.build_ms = build_t.get_time().count()*1e3;
+        r.entries = p.size();
+
+        timer::Timer lookup_t("lookup");
+        uint64_t check = 0;
+        lookup_t.tick();
+        for (uint64_t k = 0; k < keys; ++k)
+            check += p.find(k)[0];
+        lookup_t.tock();
+        r.lookup_ns = lookup_t.get_time().count()*1e9/keys;
+        if (check == 0) r.lookup_ns = 0.;
+
+        std::vector<uint64_t> before = owners(p, keys);
+        absl::flat_hash_map<uint64_t, size_t> counts;
+        for (uint64_t o : before) ++counts[o];
+        size_t max_count = 0;
+        for (auto & [agent, count] : counts)
+            max_count = std::max(max_count, count);
+        r.imbalance = (double)max_count*num_agents/keys;
+
+        p.add_agents(joining);
+        r.moved_join = moved(before, owners(p, keys));
+        p.remove_agents(joining);
+        p.remove_agents(leaving);
+        r.moved_leave = moved(before, owners(p, keys));
+
+        return r;
+    }
+
+    void print_result(const std::string &name, const result_t &r, bool last) {
+        std::cout << "  \"" << name << "\": {\n"
+            << "    \"entries\": " << r.entries << ",\n"
+            << "    \"build_ms\": " << r.build_ms << ",\n"
+            << "    \"lookup_ns\": " << r.lookup_ns << ",\n"
+            << "    \"imbalance\": " << r.imbalance << ",\n"
+            << "    \"moved_join\": " << r.moved_join << ",\n"
+            << "    \"moved_leave\": " << r.moved_leave << "\n"
+            << "  }" << (last ? "" : ",") << "\n";
+    }
+
+    int main(int argc, const char **argv) {
+        size_t num_agents = 64;
+        size_t num_vagents = STARTING_VAGENTS;
+        uint64_t keys = 1000000;
+        size_t bits = PLACEMENT_TABLE_BITS;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "help") {
+                print_usage();
+                return print_help();
+            }
+            if (argc-i < 2)
+                throw std::runtime_error("Expecting arguments");
+            if (arg == "+agents") num_agents = std::stoull(argv[++i]);
+            else if (arg == "+vagents") num_vagents = std::stoull(argv[++i]);
+            else if (arg == "+keys") keys = std::stoull(argv[++i]);
+            else if (arg == "+bits") bits = std::stoull(argv[++i]);
+            else { print_usage(); return 1; }
+        }
+        if (num_agents < 2 || num_vagents == 0 || keys == 0) {
+            print_usage();
+            return 1;
+        }
+
+        // Agents as they would be serialized, with their virtual agents
+        auto vagents_of = [num_vagents](uint64_t agent_ser) {
+            std::vector<uint64_t> res;
+            for (aid_t va = 0; va < num_vagents; ++va)
+                res.push_back(elga::pack_agent(agent_ser, va));
+            return res;
+        };
+        std::vector<uint64_t> agents;
+        for (size_t a = 0; a < num_agents; ++a) {
+            auto v = vagents_of(hashing::hash(a+1) & agent_mask);
+            agents.insert(agents.end(), v.begin(), v.end());
+        }
+        std::vector<uint64_t> joining = vagents_of(hashing::hash(num_agents+1) & agent_mask);
+        std::vector<uint64_t> leaving = vagents_of(hashing::hash(1) & agent_mask);
+
+        result_t ring = measure<ConsistentHasher>(agents, joining, leaving, num_agents, keys);
+        result_t table = measure<PlacementTable>(agents, joining, leaving, num_agents, keys, bits);
+
+        std::cout.imbue(std::locale::classic());
+        std::cout << "{\n"
+            << "  \"agents\": " << num_agents << ",\n"
+            << "  \"vagents\": " << num_vagents << ",\n"
+            << "  \"keys\": " << keys << ",\n"
+            << "  \"ideal_moved_join\": " << 1./(num_agents+1) << ",\n"
+            << "  \"ideal_moved_leave\": " << 1./num_agents << ",\n";
+        print_result("ring", ring, false);
+        print_result("table", table, true);
+        std::cout << "}" << std::endl;
+        return 0;
+    }
+
+}
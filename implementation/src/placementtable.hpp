@@ -0,0 +1,85 @@
+/**
+ * ElGA placement table
+ *
+ * An alternative to the consistent hashing ring: vertices hash into one of
+ * 2^bits slots of a lookup table, each a contiguous range of hashes, and
+ * the table is filled as in Maglev hashing.  Each real agent walks its own
+ * permutation of the slots, taking the next free slot in turn until it has
+ * its quota, which is proportional to its number of virtual agents.  This
+ * balances to within a slot with one entry per slot rather than one ring
+ * entry per virtual agent, a lookup is a single table index, and as agents
+ * keep their permutations, most slots keep their owner when membership
+ * changes.
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#ifndef PLACEMENT_TABLE_HPP
+#define PLACEMENT_TABLE_HPP
+
+#include <map>
+#include <vector>
+
+#include "consistenthasher.hpp"
+#include "replicationmap.hpp"
+
+class PlacementTable {
+    private:
+        const ReplicationMap &rm_;
+        size_t bits_;
+        /** Each real agent's virtual agents, in order */
+        std::map<uint64_t, std::vector<uint64_t>> groups_;
+        /** The virtual agents, grouped by real agent, and the number of
+         * real agents holding slots */
+        std::vector<uint64_t> entries_;
+        size_t num_placed_;
+        /** The entry for each slot */
+        std::vector<uint32_t> table_;
+
+        /** Fill the table from the groups */
+        void rebuild();
+
+        uint64_t slot(uint64_t key) const { return hashing::hash(key) >> (64-bits_); }
+
+    public:
+        PlacementTable(std::vector<uint64_t> &agents, ReplicationMap &rm,
+                size_t bits=PLACEMENT_TABLE_BITS);
+
+        /** Return the number of replicas for a given key */
+        int32_t count_reps(uint64_t key) { return rm_.query(key); }
+
+        /** Retrieve the containers for a given key, on distinct real
+         * agents */
+        std::vector<uint64_t> find(uint64_t key);
+
+        /** Retrieve a single u.r. container */
+        uint64_t find_one(uint64_t key, uint64_t owner_check, bool &have_ownership);
+
+        /** Return, in order, the ranges of hashes whose first container
+         * is one of the given agent's virtual agents */
+        std::vector<hash_range_t> owned_ranges(uint64_t agent_ser) const;
+
+        /** Support replacing the agents */
+        void update_agents(std::vector<uint64_t> &agents);
+
+        /** Support adding and removing agents */
+        void add_agents(const std::vector<uint64_t> &agents);
+        void remove_agents(const std::vector<uint64_t> &agents);
+
+        size_t size() const { return table_.size(); }
+};
+
+namespace elga::placement {
+
+    /** Main entry point for the placement-bench command */
+    int main(int argc, const char **argv);
+
+}
+
+#endif
@@ -44,14 +44,23 @@ void PageRankAlgorithm::run(VertexStorage &v,
             replica_storage[cur_it].size() != v.replicas.size()) {
         // Read all neighbors
         if (cur_it > 0) {
-            for (const auto &e : in_neighbors) {
+            for (size_t idx = 0; idx < in_neighbors.size(); ++idx) {
+                const auto &e = in_neighbors[idx];
                 #ifdef RUNTIME_CHECKS
                 if (vn[cur_it].count(e) == 0) throw std::runtime_error("No neighbor: me=" + std::to_string(v.vertex) +  " ngh=" + std::to_string(e) + " it=" + std::to_string(cur_it));
                 #endif
+                #ifdef CONFIG_EDGE_WEIGHTS
+                new_pr += vn[cur_it][e].scaled_pr * v.in_weights[idx];
+                #else
                 new_pr += vn[cur_it][e].scaled_pr;
+                #endif
             }
         }
+        #ifdef CONFIG_EDGE_WEIGHTS
+        pr_ls->out_degree = std::accumulate(v.out_weights.begin(), v.out_weights.end(), (pr_degree_t)0);
+        #else
         pr_ls->out_degree = out_neighbors.size();
+        #endif
         // Set replica storage if necessary
         if (replica_storage[cur_it].size() != v.replicas.size()) {
             replica_storage[cur_it][v.self].pr = new_pr;
@@ -18,6 +18,13 @@
 
 typedef double pr_t;
 
+#ifdef CONFIG_EDGE_WEIGHTS
+/** With weights, PageRank splits along edges by weight, not by count */
+typedef weight_t pr_degree_t;
+#else
+typedef vertex_t pr_degree_t;
+#endif
+
 #include <iostream>
 #include <fstream>
 #include <cmath>
@@ -31,7 +38,7 @@ class PRLocalStorage {
     public:
         pr_t pr;
         it_t iteration;
-        vertex_t out_degree;
+        pr_degree_t out_degree;
         local_state state;
         vertex_t vertex_recv_needed;
         vertex_t neighbor_recv_needed;
@@ -43,7 +50,7 @@ class PRLocalStorage {
 class PRReplicaLocalStorage {
     public:
         pr_t pr;
-        vertex_t out_degree;
+        pr_degree_t out_degree;
         PRReplicaLocalStorage() : pr(0.0), out_degree(0) { }
 };
 
@@ -79,6 +86,16 @@ typedef struct VertexStorage {
     uint64_t self;
     std::vector<vertex_t> in_neighbors;
     std::vector<vertex_t> out_neighbors;
+    #ifdef CONFIG_EDGE_WEIGHTS
+    /** Edge weights, parallel to the neighbor lists */
+    std::vector<weight_t> in_weights;
+    std::vector<weight_t> out_weights;
+    #endif
+    #ifdef CONFIG_EDGE_TIMESTAMPS
+    /** Edge timestamps, parallel to the neighbor lists */
+    std::vector<timestamp_t> in_timestamps;
+    std::vector<timestamp_t> out_timestamps;
+    #endif
     std::unordered_map<it_t, std::unordered_map<uint64_t, ReplicaLocalStorage>> replica_storage;
     VertexStorage() : vertex(-1) { }
 } VertexStorage;
@@ -100,6 +117,7 @@ class PageRankAlgorithm {
         size_t const query_resp_size() { return sizeof(pr_t); }
         void const query(char* d, VertexStorage &v) { *(pr_t*)d = v.local.pr; }
         void const query(char* d) { *(pr_t*)d = INFINITY; }
+        double const query_value(const char* d) { return *(const pr_t*)d; }
 };
 
 using Algorithm = PageRankAlgorithm;
@@ -0,0 +1,59 @@
+/**
+ * ElGA Replication Map
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "replicationmap.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+void HHReplicationMap::update(const std::vector<hub_t> &hubs) {
+    hubs_ = hubs;
+    index_.clear();
+    for (size_t i = 0; i < hubs_.size(); ++i)
+        index_[hubs_[i].v] = i;
+}
+
+size_t HHReplicationMap::update(const char *data, size_t size) {
+    uint64_t num;
+    if (size < sizeof(num))
+        throw std::runtime_error("Hub list too small");
+    std::memcpy(&num, data+size-sizeof(num), sizeof(num));
+    size_t list_size = sizeof(num)+num*sizeof(hub_t);
+    if (size < list_size)
+        throw std::runtime_error("Hub list too small");
+
+    std::vector<hub_t> hubs(num);
+    std::memcpy(hubs.data(), data+size-list_size, num*sizeof(hub_t));
+    update(hubs);
+    return list_size;
+}
+
+void HHReplicationMap::encode(const std::vector<hub_t> &hubs, std::vector<char> &out) {
+    uint64_t num = hubs.size();
+    size_t start = out.size();
+    out.resize(start+num*sizeof(hub_t)+sizeof(num));
+    std::memcpy(out.data()+start, hubs.data(), num*sizeof(hub_t));
+    std::memcpy(out.data()+start+num*sizeof(hub_t), &num, sizeof(num));
+}
+
+std::vector<hub_t> HHReplicationMap::hub_list(const SpaceSaving &degrees) {
+    std::vector<hub_t> hubs;
+    for (auto &c : degrees.top()) {
+        hub_t h;
+        std::memset(&h, 0, sizeof(h));
+        h.v = c.key;
+        h.count = c.count;
+        h.reps = c.count / REP_THRESH + 1;
+        hubs.push_back(h);
+    }
+    return hubs;
+}
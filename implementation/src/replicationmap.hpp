@@ -14,11 +14,21 @@
 #define REPLICATION_MAP_HPP_
 
 #include "countminsketch.hpp"
+#include "compactsketch.hpp"
+#include "spacesaving.hpp"
 
 #include <algorithm>
+#include <vector>
 
 const uint64_t REP_THRESH = CONFIG_REP_THRESH;
 
+#if defined(CONFIG_HUB_LIST) && !defined(CONFIG_CS)
+#error "CONFIG_HUB_LIST requires USE_CMS"
+#endif
+#if defined(CONFIG_COMPACT_SKETCH) && (!defined(CONFIG_CS) || defined(CONFIG_HUB_LIST))
+#error "CONFIG_COMPACT_SKETCH requires USE_CMS without CONFIG_HUB_LIST"
+#endif
+
 class ReplicationMap{
     public:
         virtual int32_t query(uint64_t key) const = 0;
@@ -37,6 +47,55 @@ class CSReplicationMap : public ReplicationMap, public CountSketch {
         int32_t sk_query(uint64_t key) const { return CountSketch::query(key); }
 };
 
+class CompactReplicationMap : public CompactCountMinSketch, public ReplicationMap {
+    public:
+        int32_t query(uint64_t key) const { return CompactCountMinSketch::query(key) / REP_THRESH + 1; }
+        int32_t sk_query(uint64_t key) const { return CompactCountMinSketch::query(key); }
+};
+
+/** A hub vertex, with its degree estimate and number of replicas */
+typedef struct hub {
+    uint64_t v;
+    int64_t count;
+    int32_t reps;
+} hub_t;
+
+/**
+ * Replicates only the vertices of an explicit hub list, built from a
+ * Space-Saving summary of degrees.  Lookups are a single hash map probe,
+ * and the list names the hubs, unlike a sketch.
+ */
+class HHReplicationMap : public ReplicationMap {
+    private:
+        std::vector<hub_t> hubs_;
+        absl::flat_hash_map<uint64_t, size_t> index_;
+
+    public:
+        int32_t query(uint64_t key) const {
+            auto it = index_.find(key);
+            return (it == index_.end()) ? 1 : hubs_[it->second].reps;
+        }
+        int32_t sk_query(uint64_t key) const {
+            auto it = index_.find(key);
+            return (it == index_.end()) ? 0 : hubs_[it->second].count;
+        }
+
+        /** Replace the hubs */
+        void update(const std::vector<hub_t> &hubs);
+        /** Replace the hubs from a list ending data, as written by
+         * encode, returning the list's size in bytes */
+        size_t update(const char *data, size_t size);
+
+        /** The hubs, most frequent first */
+        const std::vector<hub_t> &hubs() const { return hubs_; }
+
+        /** Append hubs to out as [hub_t...][uint64 count] */
+        static void encode(const std::vector<hub_t> &hubs, std::vector<char> &out);
+
+        /** Build the hub list from a summary of degrees */
+        static std::vector<hub_t> hub_list(const SpaceSaving &degrees);
+};
+
 class NoReplication : public ReplicationMap {
     public:
         NoReplication() {}
@@ -0,0 +1,223 @@
+/**
+ * ElGA sketch benchmark
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "sketchbench.hpp"
+
+#include "countminsketch.hpp"
+#include "compactsketch.hpp"
+#include "timer.hpp"
+
+#include "absl/container/flat_hash_map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <locale>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace elga::sketchbench {
+
+    /** Errors over a stream's distinct keys are counted when at least
+     * this fraction of the stream, as in test_decision */
+    const double epsilon = 0.000075;
+
+    void print_usage() {
+        std::cout << "Usage: sketch-bench [options] [key files...]" << std::endl;
+    }
+
+    int print_help() {
+        std::cout << "\n"
+            "ElGA sketch benchmark.\n"
+            "Measures the count-min, count, and compact count-min sketches'\n"
+            "throughput and accuracy on each key file, with one key per\n"
+            "line, or on a generated Zipf stream without files, printing\n"
+            "JSON.\n"
+            "Options:\n"
+            "    help : display this help message\n"
+            "    +keys N : keys to generate (default 10000000)\n"
+            "    +universe U : distinct keys to draw from (default 1000000)\n"
+            "    +skew S : Zipf exponent (default 1.0)\n"
+            << std::endl;
+        return 0;
+    }
+
+    std::vector<uint64_t> read_keys(const std::string &filename) {
+        std::ifstream in(filename);
+        if (!in) throw std::runtime_error("Unable to open key file");
+        std::vector<uint64_t> keys;
+        uint64_t key;
+        while (in >> key)
+            keys.push_back(key);
+        return keys;
+    }
+
+    std::vector<uint64_t> zipf_keys(uint64_t num_keys, uint64_t universe, double skew) {
+        std::vector<double> cdf(universe);
+        double sum = 0.;
+        for (uint64_t r = 0; r < universe; ++r) {
+            sum += 1./std::pow(r+1, skew);
+            cdf[r] = sum;
+        }
+
+        std::mt19937_64 mt(1);
+        std::uniform_real_distribution<double> dist(0., sum);
+        std::vector<uint64_t> keys(num_keys);
+        for (auto &key : keys)
+            key = std::lower_bound(cdf.begin(), cdf.end(), dist(mt))-cdf.begin()+1;
+        return keys;
+    }
+
+    double mops(uint64_t ops, const timer::Timer &t) {
+        return ops/t.get_time().count()/1e6;
+    }
+
+    /** Accuracy over the distinct keys */
+    template <class Sketch>
+    void print_errors(const Sketch &sketch, const absl::flat_hash_map<uint64_t, int64_t> &truth,
+            uint64_t num_keys) {
+        double sum_err = 0.;
+        int64_t max_err = 0;
+        uint64_t over = 0;
+        for (auto & [key, count] : truth) {
+            int64_t err = std::abs((int64_t)sketch.query(key)-count);
+            sum_err += err;
+            max_err = std::max(max_err, err);
+            if (err >= num_keys*epsilon) ++over;
+        }
+        std::cout << "      \"mean_error\": " << sum_err/truth.size() << ",\n"
+            << "      \"max_error\": " << max_err << ",\n"
+            << "      \"over_epsilon\": " << (double)over/truth.size() << "\n";
+    }
+
+    void run(const std::string &name, const std::vector<uint64_t> &keys, bool last) {
+        absl::flat_hash_map<uint64_t, int64_t> truth;
+        for (uint64_t key : keys) ++truth[key];
+        std::vector<uint64_t> distinct;
+        for (auto & [key, count] : truth) distinct.push_back(key);
+
+        std::cout << "  \"" << name << "\": {\n"
+            << "    \"keys\": " << keys.size() << ",\n"
+            << "    \"distinct\": " << distinct.size() << ",\n";
+
+        CountMinSketch cms;
+        timer::Timer count_t("count");
+        count_t.tick();
+        for (uint64_t key : keys) cms.count(key);
+        count_t.tock();
+
+        CountMinSketch cms_qc;
+        timer::Timer query_count_t("query_count");
+        int64_t check = 0;
+        query_count_t.tick();
+        for (uint64_t key : keys) check += cms_qc.query_count(key);
+        query_count_t.tock();
+
+        timer::Timer query_t("query");
+        query_t.tick();
+        for (uint64_t key : distinct) check += cms.query(key);
+        query_t.tock();
+
+        timer::Timer merge_t("merge");
+        merge_t.tick();
+        cms_qc.merge(cms);
+        merge_t.tock();
+
+        std::cout << "    \"cms\": {\n"
+            << "      \"count_mops\": " << mops(keys.size(), count_t) << ",\n"
+            << "      \"query_count_mops\": " << mops(keys.size(), query_count_t) << ",\n"
+            << "      \"query_mops\": " << mops(distinct.size(), query_t) << ",\n"
+            << "      \"merge_ms\": " << merge_t.get_time().count()*1e3 << ",\n";
+        print_errors(cms, truth, keys.size());
+        std::cout << "    },\n";
+
+        CountSketch cs;
+        count_t.reset();
+        count_t.tick();
+        for (uint64_t key : keys) cs.count(key);
+        count_t.tock();
+        query_t.reset();
+        query_t.tick();
+        for (uint64_t key : distinct) check += cs.query(key);
+        query_t.tock();
+
+        std::cout << "    \"cs\": {\n"
+            << "      \"count_mops\": " << mops(keys.size(), count_t) << ",\n"
+            << "      \"query_mops\": " << mops(distinct.size(), query_t) << ",\n";
+        print_errors(cs, truth, keys.size());
+        std::cout << "    },\n";
+
+        CompactCountMinSketch compact;
+        count_t.reset();
+        count_t.tick();
+        for (uint64_t key : keys) compact.count(key);
+        count_t.tock();
+        query_t.reset();
+        query_t.tick();
+        for (uint64_t key : distinct) check += compact.query(key);
+        query_t.tock();
+        std::vector<char> compact_ser;
+        compact.serialize(compact_ser);
+
+        std::cout << "    \"compact\": {\n"
+            << "      \"count_mops\": " << mops(keys.size(), count_t) << ",\n"
+            << "      \"query_mops\": " << mops(distinct.size(), query_t) << ",\n"
+            << "      \"bytes\": " << CompactCountMinSketch::size() << ",\n"
+            << "      \"serialized_bytes\": " << compact_ser.size() << ",\n"
+            << "      \"overflow\": " << compact.overflow() << ",\n";
+        print_errors(compact, truth, keys.size());
+        std::cout << "    },\n"
+            << "    \"check\": " << (check != 0) << "\n"
+            << "  }" << (last ? "" : ",") << "\n";
+    }
+
+    int main(int argc, const char **argv) {
+        uint64_t num_keys = 10000000;
+        uint64_t universe = 1000000;
+        double skew = 1.;
+        std::vector<std::string> files;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            if (arg == "help") {
+                print_usage();
+                return print_help();
+            }
+            if (arg[0] != '+') {
+                files.push_back(arg);
+                continue;
+            }
+            if (argc-i < 2)
+                throw std::runtime_error("Expecting arguments");
+            if (arg == "+keys") num_keys = std::stoull(argv[++i]);
+            else if (arg == "+universe") universe = std::stoull(argv[++i]);
+            else if (arg == "+skew") skew = std::stod(argv[++i]);
+            else { print_usage(); return 1; }
+        }
+        if (num_keys == 0 || universe == 0) {
+            print_usage();
+            return 1;
+        }
+
+        std::cout.imbue(std::locale::classic());
+        std::cout << "{\n";
+        if (files.size() == 0)
+            run("zipf", zipf_keys(num_keys, universe, skew), true);
+        for (size_t f = 0; f < files.size(); ++f)
+            run(files[f], read_keys(files[f]), f+1 == files.size());
+        std::cout << "}" << std::endl;
+        return 0;
+    }
+
+}
@@ -0,0 +1,27 @@
+/**
+ * ElGA sketch benchmark
+ *
+ * Measures the count-min, count, and compact count-min sketches'
+ * throughput and accuracy on key streams, either files with one key per
+ * line, as used by test_decision, or generated Zipf streams.
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#ifndef SKETCHBENCH_HPP
+#define SKETCHBENCH_HPP
+
+namespace elga::sketchbench {
+
+    /** Main entry point for the sketch-bench command */
+    int main(int argc, const char **argv);
+
+}
+
+#endif
@@ -0,0 +1,172 @@
+/**
+ * ElGA Space-Saving heavy hitters
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "spacesaving.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+/** Most frequent first, then by key so results are deterministic */
+static bool more_frequent(const SpaceSaving::counter_t &a, const SpaceSaving::counter_t &b) {
+    if (a.count != b.count) return a.count > b.count;
+    return a.key < b.key;
+}
+
+SpaceSaving::SpaceSaving(size_t capacity) : capacity_(capacity), heap_(), index_() {
+    if (capacity_ == 0)
+        throw std::runtime_error("Space-Saving needs at least one counter");
+    heap_.reserve(capacity_);
+}
+
+SpaceSaving::SpaceSaving(const char *data, size_t size) : capacity_(0), heap_(), index_() {
+    uint64_t capacity, num;
+    if (size < sizeof(capacity)+sizeof(num))
+        throw std::runtime_error("Space-Saving summary too small");
+    std::memcpy(&capacity, data, sizeof(capacity));
+    std::memcpy(&num, data+sizeof(capacity), sizeof(num));
+    data += sizeof(capacity)+sizeof(num);
+    if (capacity == 0 || num > capacity || size != sizeof(capacity)+sizeof(num)+num*sizeof(counter_t))
+        throw std::runtime_error("Invalid Space-Saving summary");
+
+    capacity_ = capacity;
+    std::vector<counter_t> counters(num);
+    std::memcpy(counters.data(), data, num*sizeof(counter_t));
+    rebuild(counters);
+}
+
+void SpaceSaving::swap_counters(size_t a, size_t b) {
+    std::swap(heap_[a], heap_[b]);
+    index_[heap_[a].key] = a;
+    index_[heap_[b].key] = b;
+}
+
+void SpaceSaving::sift_up(size_t i) {
+    while (i > 0) {
+        size_t parent = (i-1)/2;
+        if (heap_[parent].count <= heap_[i].count) break;
+        swap_counters(i, parent);
+        i = parent;
+    }
+}
+
+void SpaceSaving::sift_down(size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        size_t l = 2*i+1, r = 2*i+2;
+        if (l < heap_.size() && heap_[l].count < heap_[smallest].count) smallest = l;
+        if (r < heap_.size() && heap_[r].count < heap_[smallest].count) smallest = r;
+        if (smallest == i) break;
+        swap_counters(i, smallest);
+        i = smallest;
+    }
+}
+
+void SpaceSaving::rebuild(std::vector<counter_t> &counters) {
+    if (counters.size() > capacity_) {
+        std::nth_element(counters.begin(), counters.begin()+capacity_, counters.end(), more_frequent);
+        counters.resize(capacity_);
+    }
+
+    heap_ = counters;
+    index_.clear();
+    for (size_t i = 0; i < heap_.size(); ++i)
+        index_[heap_[i].key] = i;
+    for (size_t i = heap_.size()/2; i-- > 0;)
+        sift_down(i);
+}
+
+int64_t SpaceSaving::count(uint64_t key, int64_t inc) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        size_t i = it->second;
+        heap_[i].count += inc;
+        sift_down(i);
+        return heap_[index_[key]].count;
+    }
+
+    if (heap_.size() < capacity_) {
+        heap_.push_back({key, inc, 0});
+        index_[key] = heap_.size()-1;
+        sift_up(heap_.size()-1);
+        return inc;
+    }
+
+    // Take over the smallest counter
+    counter_t &c = heap_[0];
+    index_.erase(c.key);
+    c.key = key;
+    c.error = c.count;
+    c.count += inc;
+    index_[key] = 0;
+    sift_down(0);
+    return heap_[index_[key]].count;
+}
+
+int64_t SpaceSaving::query(uint64_t key) const {
+    auto it = index_.find(key);
+    if (it == index_.end()) return 0;
+    return heap_[it->second].count;
+}
+
+int64_t SpaceSaving::min_count() const {
+    if (heap_.size() < capacity_) return 0;
+    return heap_[0].count;
+}
+
+void SpaceSaving::merge(const SpaceSaving &other) {
+    // A key missing from a full summary may have been counted up to its
+    // smallest count there
+    int64_t min_this = min_count();
+    int64_t min_other = other.min_count();
+
+    std::vector<counter_t> counters;
+    counters.reserve(heap_.size()+other.heap_.size());
+    for (const counter_t &c : heap_) {
+        auto it = other.index_.find(c.key);
+        if (it != other.index_.end()) {
+            const counter_t &o = other.heap_[it->second];
+            counters.push_back({c.key, c.count+o.count, c.error+o.error});
+        } else
+            counters.push_back({c.key, c.count+min_other, c.error+min_other});
+    }
+    for (const counter_t &o : other.heap_) {
+        if (index_.count(o.key) == 0)
+            counters.push_back({o.key, o.count+min_this, o.error+min_this});
+    }
+
+    capacity_ = std::max(capacity_, other.capacity_);
+    rebuild(counters);
+}
+
+std::vector<SpaceSaving::counter_t> SpaceSaving::top() const {
+    std::vector<counter_t> res = heap_;
+    std::sort(res.begin(), res.end(), more_frequent);
+    return res;
+}
+
+void SpaceSaving::clear() {
+    heap_.clear();
+    index_.clear();
+}
+
+std::vector<char> SpaceSaving::serialize() const {
+    uint64_t capacity = capacity_, num = heap_.size();
+    std::vector<char> out(sizeof(capacity)+sizeof(num)+num*sizeof(counter_t));
+    char *data = out.data();
+    std::memcpy(data, &capacity, sizeof(capacity));
+    data += sizeof(capacity);
+    std::memcpy(data, &num, sizeof(num));
+    data += sizeof(num);
+    std::memcpy(data, heap_.data(), num*sizeof(counter_t));
+    return out;
+}
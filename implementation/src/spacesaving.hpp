@@ -0,0 +1,80 @@
+/**
+ * ElGA Space-Saving heavy hitters
+ *
+ * Tracks the most frequent keys of a stream in a fixed number of
+ * counters.  A new key takes over the smallest counter, inheriting its
+ * count as error, so any key counted more than total/capacity times is
+ * tracked, and counts never underestimate.  Summaries merge as in
+ * Agarwal et al., so agents can summarize their own edges and the
+ * directory can combine them.
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#ifndef SPACESAVING_HPP
+#define SPACESAVING_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+class SpaceSaving {
+    public:
+        typedef struct counter {
+            uint64_t key;
+            int64_t count;
+            /** Most by which count may overestimate */
+            int64_t error;
+        } counter_t;
+
+    private:
+        size_t capacity_;
+        /** A min-heap of the counters by count */
+        std::vector<counter_t> heap_;
+        absl::flat_hash_map<uint64_t, size_t> index_;
+
+        void swap_counters(size_t a, size_t b);
+        void sift_up(size_t i);
+        void sift_down(size_t i);
+
+        /** Keep the largest capacity counters and re-form the heap */
+        void rebuild(std::vector<counter_t> &counters);
+
+    public:
+        SpaceSaving(size_t capacity=HUB_LIST_SIZE);
+        /** Deserialize a summary */
+        SpaceSaving(const char *data, size_t size);
+
+        /** Count key inc times, returning its new count */
+        int64_t count(uint64_t key, int64_t inc=1);
+
+        /** Return the count of key, or 0 if it is not tracked */
+        int64_t query(uint64_t key) const;
+
+        /** Return the smallest count, which bounds untracked keys, or 0
+         * if not all counters are in use */
+        int64_t min_count() const;
+
+        /** Merge other into this summary */
+        void merge(const SpaceSaving &other);
+
+        /** Return the tracked keys, most frequent first */
+        std::vector<counter_t> top() const;
+
+        void clear();
+
+        size_t size() const { return heap_.size(); }
+        size_t capacity() const { return capacity_; }
+
+        /** Serialize as [uint64 capacity][uint64 size][counter_t...] */
+        std::vector<char> serialize() const;
+};
+
+#endif
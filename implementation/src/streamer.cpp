@@ -26,6 +26,9 @@
 #include <random>
 #include <unordered_set>
 
+#include <cstdio>
+#include <unistd.h>
+
 using namespace elga;
 
 namespace elga::streamer {
@@ -44,6 +47,14 @@ namespace elga::streamer {
             "    rg N M r P : stream a random graph\n" <<
             "      with N vertices, M edges, P nodes\n" <<
             "      from rank r\n" <<
+            "    rmat S M r P seed : stream an R-MAT graph\n" <<
+            "      with 2^S vertices and M edges, P nodes\n" <<
+            "      from rank r\n" <<
+            "    chunglu N M g r P seed : stream a Chung-Lu graph\n" <<
+            "      with N vertices, M edges, power-law exponent g,\n" <<
+            "      P nodes from rank r\n" <<
+            "    +spill dir : when agents are out of credits, spill\n" <<
+            "      edges to files in dir instead of waiting\n" <<
             "    listen addr : listen on the given address" <<
             std::endl;
         return 0;
@@ -90,6 +101,37 @@ namespace elga::streamer {
                 std::cerr << "[ElGA : Streamer] Random graph: " << N << " " << M << " from " << r << "/" << P << std::endl;
 
                 s.rg(N, M, r, P);
+            } else if (fname == "rmat") {
+                if (argc-i < 6)
+                    throw std::runtime_error("Expecting arguments");
+
+                uint32_t S = std::stoul(std::string(argv[i+1]));
+                uint64_t M = std::stoull(std::string(argv[i+2]));
+                uint32_t r = std::stoul(std::string(argv[i+3]));
+                uint32_t P = std::stoul(std::string(argv[i+4]));
+                uint64_t seed = std::stoull(std::string(argv[i+5]));
+
+                i += 5;
+
+                std::cerr << "[ElGA : Streamer] R-MAT graph: " << S << " " << M << " from " << r << "/" << P << " seed " << seed << std::endl;
+
+                s.generate(generator::RMAT(S, seed), M, r, P);
+            } else if (fname == "chunglu") {
+                if (argc-i < 7)
+                    throw std::runtime_error("Expecting arguments");
+
+                uint64_t N = std::stoull(std::string(argv[i+1]));
+                uint64_t M = std::stoull(std::string(argv[i+2]));
+                double gamma = std::stod(std::string(argv[i+3]));
+                uint32_t r = std::stoul(std::string(argv[i+4]));
+                uint32_t P = std::stoul(std::string(argv[i+5]));
+                uint64_t seed = std::stoull(std::string(argv[i+6]));
+
+                i += 6;
+
+                std::cerr << "[ElGA : Streamer] Chung-Lu graph: " << N << " " << M << " " << gamma << " from " << r << "/" << P << " seed " << seed << std::endl;
+
+                s.generate(generator::ChungLu(N, gamma, seed), M, r, P);
             } else if (fname == "+el") {
                 el = true;
             } else if (fname == "+no+el") {
@@ -105,6 +147,15 @@ namespace elga::streamer {
                     throw std::runtime_error("Expecting arguments");
 
                 s.set_mb(std::stoull(std::string(argv[++i])));
+            } else if (fname == "+spill") {
+                if (argc-i < 2)
+                    throw std::runtime_error("Expecting arguments");
+
+                #ifdef CONFIG_FLOW_CONTROL
+                s.set_spill_dir(std::string(argv[++i]));
+                #else
+                throw std::runtime_error("Spilling requires CONFIG_FLOW_CONTROL");
+                #endif
             } else if (fname == "listen") {
                 if (argc-i < 2)
                     throw std::runtime_error("Expecting arguments");
@@ -130,13 +181,19 @@ namespace elga::streamer {
     std::tuple<edge_t, bool> parse_edge(std::fstream &instream, bool el) {
         std::tuple<edge_t, bool> res;
         int insert_delete = 0;
-        double ignore_weight;
-        uint64_t ignore_timestamp;
+        weight_t weight;
+        timestamp_t timestamp;
         if (el) {
             instream >> std::get<0>(res).src >> std::get<0>(res).dst;
             insert_delete = 1;
         } else {
-            instream >> insert_delete >> std::get<0>(res).src >> std::get<0>(res).dst >> ignore_weight >> ignore_timestamp;
+            instream >> insert_delete >> std::get<0>(res).src >> std::get<0>(res).dst >> weight >> timestamp;
+            #ifdef CONFIG_EDGE_WEIGHTS
+            std::get<0>(res).weight = weight;
+            #endif
+            #ifdef CONFIG_EDGE_TIMESTAMPS
+            std::get<0>(res).timestamp = timestamp;
+            #endif
         }
         if (instream.fail())
             throw std::runtime_error("Invalid parameter while parsing edge.");
@@ -226,12 +283,8 @@ void Streamer::parse_file(std::string fname, bool el) {
                 auto & [e, ins] = change;
                 if (!ins)
                     change_edge(e, ins);
-                else {
-                    bool dummy;
-                    uint64_t agent = find_agent(e, IN, true, 0, dummy);
-                    changes_[agent].push_back(e);
-                    ++batch_size_;
-                }
+                else
+                    add_edge(e);
             } else {
                 change_edge(std::get<0>(change), std::get<1>(change));
             }
@@ -266,6 +319,7 @@ void Streamer::parse_file(std::string fname, bool el) {
         send_timer.tick();
         // Finish sending the batch
         send_batch();
+        drain_spills();
         send_timer.tock();
         std::cerr << "[ElGA : Streamer] " << send_timer << " sent batch" << std::endl;
     }
@@ -319,6 +373,39 @@ void Streamer::rg(uint64_t N, uint64_t M, uint32_t r, uint32_t P) {
     }
 }
 
+template<typename Generator>
+void Streamer::generate(const Generator &gen, uint64_t M, uint32_t r, uint32_t P) {
+    auto [start, end] = generator::rank_range(M, r, P);
+
+    std::cerr << "[ElGA : Streamer] generating edges " << start << "-" << end << " of " << gen.num_vertices() << " vertices" << std::endl;
+
+    for (uint64_t idx = start; idx < end; ++idx) {
+        if (global_shutdown) {
+            std::cerr << "[ElGA : Streamer] shutting down" << std::endl;
+            return;
+        }
+
+        add_edge(gen.edge(idx));
+
+        if (batch_ && batch_size_ >= MID_BATCH_SIZE) {
+            send_batch();
+            batch_size_ = 0;
+        }
+
+        if ((idx-start) % 10000000 == 0)
+            std::cerr << "[ElGA : Streamer] " << idx-start << std::endl;
+    }
+
+    if (batch_) {
+        timer::Timer send_timer {"batch_send"};
+        send_timer.tick();
+        send_batch();
+        drain_spills();
+        send_timer.tock();
+        std::cerr << "[ElGA : Streamer] " << send_timer << " sent batch" << std::endl;
+    }
+}
+
 void Streamer::listen(std::string listen_addr) {
     zmq_socket_t receiver = socket_(ZMQ_PULL, 0, false);
     try {
@@ -338,6 +425,8 @@ void Streamer::listen(std::string listen_addr) {
 
             int ret = zmq_poll(polls, 1, poll_time);
             if (!(polls[0].revents & ZMQ_POLLIN) || (ret < 0 && errno == EINTR)) {
+                // Make progress on anything held back by flow control
+                drain_spills(false);
                 if (ctr > 0) {
                     // This means: we were processing, now we have nothing
                     // this is the end of a 'batch'
@@ -446,29 +535,148 @@ void Streamer::change_edge(edge_t e, bool insert) {
     #endif
 }
 
+void Streamer::add_edge(const edge_t &e) {
+    if (!batch_) {
+        change_edge(e, true);
+        return;
+    }
+    bool dummy;
+    uint64_t agent = find_agent(e, IN, true, 0, dummy);
+    changes_[agent].push_back(e);
+    ++batch_size_;
+}
+
+void Streamer::send_edges(uint64_t agent, const edge_t *edges, size_t count) {
+    ZMQRequester &agent_in_req = get_requester(agent);
+    size_t msg_size = sizeof(msg_type_t) + count*sizeof(update_t);
+    char *msg = new char[msg_size];
+
+    char *msg_ptr = msg;
+    pack_msg(msg_ptr, UPDATE_EDGES);
+    for (size_t idx = 0; idx < count; ++idx) {
+        update_t u;
+        u.e = edges[idx];
+        u.et = IN;
+        u.insert = true;
+        pack_single(msg_ptr, u);
+    }
+
+    agent_in_req.send(msg, msg_size);
+
+    delete [] msg;
+}
+
 void Streamer::send_batch() {
+    #ifdef CONFIG_FLOW_CONTROL
+    // Older, spilled edges go first
+    drain_spills(false);
+    #endif
     // Send them in bulk
     for (auto & [ag, el] : changes_) {
-        ZMQRequester &agent_in_req = get_requester(ag);
-        size_t msg_size = sizeof(msg_type_t) + el.size()*sizeof(update_t);
-        char *msg = new char[msg_size];
+        #ifdef CONFIG_FLOW_CONTROL
+        send_credited(ag, el.data(), el.size());
+        #else
+        send_edges(ag, el.data(), el.size());
+        #endif
+        el.clear();
+    }
+    changes_.clear();
+}
 
+#ifdef CONFIG_FLOW_CONTROL
+size_t Streamer::acquire_credits(uint64_t agent, size_t want, bool block) {
+    auto req_it = credit_reqs_.find(agent);
+    if (req_it == credit_reqs_.end())
+        req_it = credit_reqs_.try_emplace(agent, ZMQAddress(agent), addr_).first;
+    ZMQRequester &req = req_it->second;
+
+    int64_t backoff_us = 100;
+    timer::TimePoint start;
+    while (!global_shutdown) {
+        char msg[sizeof(msg_type_t)+sizeof(uint64_t)];
         char *msg_ptr = msg;
-        pack_msg(msg_ptr, UPDATE_EDGES);
-        for (const edge_t & e : el) {
-            update_t u;
-            u.e = e;
-            u.et = IN;
-            u.insert = true;
-            pack_single(msg_ptr, u);
-        }
+        pack_msg(msg_ptr, CREDIT);
+        pack_single(msg_ptr, (uint64_t)want);
+        req.send(msg, sizeof(msg));
+
+        ZMQMessage resp = req.read();
+        if (resp.size() != sizeof(uint64_t)) throw std::runtime_error("Invalid credit response");
+        uint64_t granted = *(const uint64_t*)resp.data();
+        if (granted > 0 || !block) return granted;
+        if (start.distance_us() >= FLOW_CONTROL_TIMEOUT*1000)
+            throw std::runtime_error("Timed out waiting for credits from an agent");
+
+        // The agent has no headroom; back off
+        std::this_thread::sleep_for(std::chrono::microseconds(backoff_us));
+        backoff_us = std::min<int64_t>(backoff_us*2, 100000);
+    }
+    return 0;
+}
 
-        agent_in_req.send(msg, msg_size);
+void Streamer::send_credited(uint64_t agent, const edge_t *edges, size_t count) {
+    size_t pos = 0;
+    bool blocking = spill_dir_.empty();
+    // Keep the agent's edges in order behind any that are spilled
+    if (spills_.count(agent) == 0) {
+        while (pos < count) {
+            size_t n = acquire_credits(agent, count-pos, blocking);
+            if (n == 0) break;
+            send_edges(agent, edges+pos, n);
+            pos += n;
+        }
+    }
+    if (pos < count && !blocking)
+        spill(agent, edges+pos, count-pos);
+}
 
-        delete [] msg;
-        el.clear();
+void Streamer::spill(uint64_t agent, const edge_t *edges, size_t count) {
+    auto sp_it = spills_.find(agent);
+    if (sp_it == spills_.end()) {
+        sp_it = spills_.try_emplace(agent).first;
+        spill_t &sp = sp_it->second;
+        std::ostringstream fname;
+        fname << spill_dir_ << "/elga.spill." << getpid() << "." << agent;
+        sp.fname = fname.str();
+        sp.file.open(sp.fname, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!sp.file.good()) throw std::runtime_error("Unable to open spill file " + sp.fname);
+        sp.read = 0;
+        sp.written = 0;
+        std::cerr << "[ElGA : Streamer] out of credits, spilling to " << sp.fname << std::endl;
     }
-    changes_.clear();
+    spill_t &sp = sp_it->second;
+    sp.file.seekp(sp.written*sizeof(edge_t));
+    sp.file.write((const char*)edges, count*sizeof(edge_t));
+    if (!sp.file.good()) throw std::runtime_error("Unable to write spill file " + sp.fname);
+    sp.written += count;
+}
+#endif
+
+void Streamer::drain_spills(bool block) {
+    #ifdef CONFIG_FLOW_CONTROL
+    const size_t max_read = 1<<20;
+    std::vector<edge_t> buf;
+    for (auto sp_it = spills_.begin(); sp_it != spills_.end(); ) {
+        uint64_t agent = sp_it->first;
+        spill_t &sp = sp_it->second;
+        while (sp.read < sp.written) {
+            size_t n = acquire_credits(agent, std::min(sp.written-sp.read, max_read), block);
+            if (n == 0) break;
+            buf.resize(n);
+            sp.file.seekg(sp.read*sizeof(edge_t));
+            sp.file.read((char*)buf.data(), n*sizeof(edge_t));
+            if (!sp.file.good()) throw std::runtime_error("Unable to read spill file " + sp.fname);
+            send_edges(agent, buf.data(), n);
+            sp.read += n;
+        }
+        if (sp.read < sp.written) {
+            ++sp_it;
+            continue;
+        }
+        sp.file.close();
+        std::remove(sp.fname.c_str());
+        sp_it = spills_.erase(sp_it);
+    }
+    #endif
 }
 
 bool Streamer::handle_msg(zmq_socket_t sock, msg_type_t t, const char *data, size_t size) {
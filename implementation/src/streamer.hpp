@@ -19,8 +19,10 @@
 #include <sstream>
 #include <vector>
 #include <tuple>
+#include <unordered_map>
 
 #include "participant.hpp"
+#include "generator.hpp"
 
 namespace elga {
 
@@ -48,6 +50,37 @@ namespace elga {
             bool batch_;
             bool wait_;
             size_t mb_;
+
+            /** Send count edges to the agent in a single message */
+            void send_edges(uint64_t agent, const edge_t *edges, size_t count);
+
+            #ifdef CONFIG_FLOW_CONTROL
+            /** Edges waiting on disk for credits from an agent */
+            typedef struct spill {
+                std::string fname;
+                std::fstream file;
+                size_t read;
+                size_t written;
+            } spill_t;
+            std::unordered_map<uint64_t, spill_t> spills_;
+            /** Where to spill; if empty, wait for credits instead */
+            std::string spill_dir_;
+
+            /** Credit requests to each agent */
+            std::unordered_map<uint64_t, ZMQRequester> credit_reqs_;
+
+            /** Obtain up to want credits from the agent, returning the
+             * number obtained; if block, wait until at least one, for
+             * at most FLOW_CONTROL_TIMEOUT */
+            size_t acquire_credits(uint64_t agent, size_t want, bool block);
+
+            /** Send edges as credits allow, spilling or waiting for the
+             * rest */
+            void send_credited(uint64_t agent, const edge_t *edges, size_t count);
+
+            /** Append edges to the agent's spill file */
+            void spill(uint64_t agent, const edge_t *edges, size_t count);
+            #endif
         public:
             /** Initialize the streamer pointed at the given dm */
             Streamer(const ZMQAddress &directory_master) :
@@ -62,12 +95,19 @@ namespace elga {
             /** Add or delete a new edge */
             void change_edge(edge_t e, bool insert);
 
+            /** Insert an edge, through the batch if batching */
+            void add_edge(const edge_t &e);
+
             /** Parse the given file and stream results */
             void parse_file(std::string fname, bool el);
 
             /** Generate a simple random graph from rank r/P */
             void rg(uint64_t N, uint64_t M, uint32_t r, uint32_t P);
 
+            /** Stream rank r/P's share of M edges from the given generator */
+            template<typename Generator>
+            void generate(const Generator &gen, uint64_t M, uint32_t r, uint32_t P);
+
             /** Listen for incoming edges at the given ZeroMQ address string */
             void listen(std::string listen_addr);
 
@@ -80,6 +120,16 @@ namespace elga {
             /** Send the full batch */
             void send_batch();
 
+            #ifdef CONFIG_FLOW_CONTROL
+            /** Spill to the given directory instead of waiting for
+             * credits */
+            void set_spill_dir(std::string dir) { spill_dir_ = dir; }
+            #endif
+
+            /** Send any edges held back by flow control; if block, wait
+             * until all are sent */
+            void drain_spills(bool block=true);
+
             /** Set whether to batch edges or not */
             void set_batch(bool val) { batch_ = val; }
 
@@ -64,11 +64,21 @@ typedef enum scale_direction {
 } scale_direction;
 #endif
 
+#if defined(CONFIG_EDGE_WEIGHTS) || defined(CONFIG_EDGE_TIMESTAMPS)
+#define CONFIG_EDGE_ATTRS
+#endif
+
+/** Edges optionally carry a timestamp and a weight; neither takes part in
+ * edge identity, so they do not affect equality or hashing */
 typedef struct edge {
     vertex_t src;
     vertex_t dst;
-    //timestamp_t timestamp;
-    //weight_t weight;
+    #ifdef CONFIG_EDGE_TIMESTAMPS
+    timestamp_t timestamp = 0;
+    #endif
+    #ifdef CONFIG_EDGE_WEIGHTS
+    weight_t weight = 1.0;
+    #endif
 
     bool operator==(const edge &other) const {
         return (src == other.src && dst == other.dst);
@@ -202,8 +212,43 @@ class arg_error : public ::std::runtime_error {
 #define AS_QUERY            0x24
 #define AS_SCALE            0x25
 #endif
+#ifdef CONFIG_FLOW_CONTROL
+#define CREDIT              0x26
+#endif
+#ifdef CONFIG_TREE_BARRIER
+#define TREE_SIZE           0x27
+#define READY_SYNC_TREE     0x28
+#define SYNC_TREE           0x29
+#endif
+#ifdef CONFIG_ASYNC
+#define VN_ACK              0x2a
+#endif
+#ifdef CONFIG_PIPELINE_BATCHES
+#define ACK_STAGED          0x2b
+#endif
+#define MULTI_QUERY         0x2c
+#define AGG_QUERY           0x2d
+#ifdef CONFIG_VA_BALANCE
+#define VA_LOAD             0x2e
+#endif
+#define AGG_PART            0x2f
+#ifdef CONFIG_VA_BALANCE
+#define VA_LOAD_INT         0x30
+#endif
 #define HEARTBEAT           0xff
 
+/** DIRECTORY_UPDATE flags, the byte after the type, which participants
+ * subscribe on */
+#define DIRECTORY_SNAPSHOT          0x0
+#define DIRECTORY_SNAPSHOT_CHANGED  0x1
+#define DIRECTORY_DELTA             0x2
+
+/** AGG_QUERY kinds, the byte after the type */
+#define AGG_TOP_K           0x0
+#define AGG_VALUE_HIST      0x1
+#define AGG_GROUP_SIZES     0x2
+#define AGG_DEGREE_HIST     0x3
+
 #define DO_ADD 0x40
 #define DO_START    (START+DO_ADD)
 #define DO_SAVE     (SAVE+DO_ADD)
@@ -0,0 +1,103 @@
+/**
+ * ElGA virtual agent balancing
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "vabalance.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace elga;
+
+VABalancer::VABalancer(double damping, double threshold, aid_t min_vagents,
+        aid_t max_vagents, double edge_weight) :
+        damping_(damping), threshold_(threshold), min_vagents_(min_vagents),
+        max_vagents_(max_vagents), edge_weight_(edge_weight),
+        imbalance_(1.), predicted_(1.) {
+    if (damping_ <= 0. || damping_ > 1. || threshold_ < 1. || min_vagents_ == 0 ||
+            max_vagents_ < min_vagents_ || edge_weight_ < 0. || edge_weight_ > 1.)
+        throw std::runtime_error("Invalid virtual agent balancing parameters");
+}
+
+bool VABalancer::plan(const std::vector<aid_t> &vagents,
+        const std::vector<va_load_t> &loads, std::vector<aid_t> &counts) {
+    counts = vagents;
+    imbalance_ = predicted_ = 1.;
+
+    size_t n = vagents.size();
+    if (n < 2 || loads.size() != n) return false;
+
+    // Each agent's share of the load, from its edges and busy time
+    double sum_e = 0., sum_b = 0.;
+    for (const va_load_t &l : loads) {
+        sum_e += l.nE;
+        sum_b += l.busy_time;
+    }
+    double we = (sum_e > 0.) ? edge_weight_ : 0.;
+    double wb = (sum_b > 0.) ? 1.-edge_weight_ : 0.;
+    if (we+wb <= 0.) return false;
+
+    std::vector<double> share(n);
+    double max_share = 0.;
+    for (size_t i = 0; i < n; ++i) {
+        double e = (sum_e > 0.) ? loads[i].nE/sum_e : 0.;
+        double b = (sum_b > 0.) ? loads[i].busy_time/sum_b : 0.;
+        share[i] = (we*e + wb*b)/(we+wb);
+        max_share = std::max(max_share, share[i]);
+    }
+    imbalance_ = predicted_ = n*max_share;
+    if (imbalance_ < threshold_) return false;
+
+    // Move each agent part of the way to the count giving it 1/n of the
+    // load, assuming its load follows its share of the ring
+    std::vector<double> want(n);
+    double total = 0., want_total = 0.;
+    for (size_t i = 0; i < n; ++i) {
+        double v = std::max<aid_t>(vagents[i], 1);
+        double ideal = (share[i] > 0.) ? v/(n*share[i]) : 2*v;
+        want[i] = std::clamp(v + damping_*(ideal-v), v/2, 2*v);
+        total += v;
+        want_total += want[i];
+    }
+
+    // Keep the ring about the same size
+    for (size_t i = 0; i < n; ++i) {
+        long c = std::lround(want[i]*total/want_total);
+        counts[i] = std::clamp<long>(c, min_vagents_, max_vagents_);
+    }
+
+    // Predict the loads under the plan before committing to it
+    double sum_p = 0., max_p = 0.;
+    for (size_t i = 0; i < n; ++i) {
+        double p = share[i]*counts[i]/std::max<aid_t>(vagents[i], 1);
+        sum_p += p;
+        max_p = std::max(max_p, p);
+    }
+    predicted_ = (sum_p > 0.) ? n*max_p/sum_p : imbalance_;
+
+    if (predicted_ >= imbalance_ || counts == vagents) {
+        counts = vagents;
+        predicted_ = imbalance_;
+        return false;
+    }
+    return true;
+}
+
+VABalancer elga::make_va_balancer() {
+    #ifdef VA_BALANCE_EDGE_WEIGHT
+    double edge_weight = VA_BALANCE_EDGE_WEIGHT;
+    #else
+    double edge_weight = 0.;
+    #endif
+    return VABalancer(VA_BALANCE_DAMPING, VA_BALANCE_THRESHOLD,
+            VA_BALANCE_MIN, VA_BALANCE_MAX, edge_weight);
+}
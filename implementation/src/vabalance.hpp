@@ -0,0 +1,82 @@
+/**
+ * ElGA virtual agent balancing
+ *
+ * An agent's share of the graph follows its share of the virtual agents on
+ * the ring.  Agents report their edges and the time they spent computing
+ * in their last batch to their directory, which periodically plans new
+ * virtual agent counts so each agent's load moves towards the mean, in
+ * both directions.  Moves are damped and limited per round to avoid
+ * oscillation, and a plan is only committed if its predicted imbalance is
+ * lower than the current one.
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#ifndef VABALANCE_HPP
+#define VABALANCE_HPP
+
+#include "types.hpp"
+
+#include <vector>
+
+namespace elga {
+
+    /** What an agent reports each heartbeat */
+    typedef struct va_load {
+        uint64_t nE;
+        /** Time spent computing, outside of barriers, in the last batch,
+         * in seconds */
+        double busy_time;
+        /** Batches completed */
+        batch_t batch;
+    } va_load_t;
+
+    /** Plans virtual agent counts from the agents' loads */
+    class VABalancer {
+        private:
+            double damping_;
+            double threshold_;
+            aid_t min_vagents_;
+            aid_t max_vagents_;
+            double edge_weight_;
+
+            double imbalance_;
+            double predicted_;
+
+        public:
+            /** Move each agent damping of the way to its ideal count,
+             * at most doubling or halving it, within [min_vagents,
+             * max_vagents], once the most loaded agent is threshold
+             * times the mean; load weighs edges by edge_weight and busy
+             * time by the rest */
+            VABalancer(double damping, double threshold, aid_t min_vagents,
+                    aid_t max_vagents, double edge_weight);
+
+            /**
+             * Plan new counts for agents with the given current counts and
+             * loads.  Returns whether the plan should be committed, with
+             * the new counts in counts; otherwise counts is left as the
+             * current counts.
+             */
+            bool plan(const std::vector<aid_t> &vagents,
+                    const std::vector<va_load_t> &loads,
+                    std::vector<aid_t> &counts);
+
+            /** The most loaded agent's load over the mean, before and
+             * predicted after the last plan */
+            double imbalance() const { return imbalance_; }
+            double predicted() const { return predicted_; }
+    };
+
+    /** Build a balancer configured from the build */
+    VABalancer make_va_balancer();
+
+}
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * ElGA vertex result cache
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "vertexcache.hpp"
+
+#include <cstring>
+
+using namespace elga;
+
+VertexCache::VertexCache(size_t capacity, size_t value_size) :
+        capacity_(capacity), value_size_(value_size), batch_(0), slots_(),
+        values_(), index_(), hand_(0), hits_(0), misses_(0) {
+    if (capacity_ == 0) throw std::runtime_error("Cache capacity must be positive");
+    slots_.reserve(capacity_);
+    values_.reserve(capacity_*value_size_);
+    index_.reserve(capacity_);
+}
+
+const char *VertexCache::find(vertex_t v) {
+    auto it = index_.find(v);
+    if (it == index_.end() || slots_[it->second].batch != batch_) {
+        ++misses_;
+        return nullptr;
+    }
+    ++hits_;
+    slots_[it->second].referenced = true;
+    return &values_[it->second*value_size_];
+}
+
+size_t VertexCache::evict() {
+    // Stale entries go first; otherwise referenced entries get a second
+    // chance
+    while (true) {
+        slot_t &s = slots_[hand_];
+        size_t victim = hand_;
+        hand_ = (hand_+1) % slots_.size();
+        if (s.batch != batch_ || !s.referenced)
+            return victim;
+        s.referenced = false;
+    }
+}
+
+void VertexCache::insert(vertex_t v, const char *value, batch_t batch) {
+    if (batch != batch_) return;
+
+    size_t pos;
+    auto it = index_.find(v);
+    if (it != index_.end()) {
+        pos = it->second;
+    } else if (slots_.size() < capacity_) {
+        pos = slots_.size();
+        slots_.push_back({});
+        values_.resize(values_.size()+value_size_);
+        index_[v] = pos;
+    } else {
+        pos = evict();
+        index_.erase(slots_[pos].v);
+        index_[v] = pos;
+    }
+
+    slots_[pos] = {v, batch, false};
+    std::memcpy(&values_[pos*value_size_], value, value_size_);
+}
@@ -0,0 +1,78 @@
+/**
+ * ElGA vertex result cache
+ *
+ * Caches query results by vertex, each tagged with the batch it was
+ * answered in.  A completed batch invalidates every entry at once by
+ * advancing the current batch; stale entries are then misses and are the
+ * first to be replaced.  Replacement otherwise follows the CLOCK policy,
+ * which keeps popular vertices under skewed workloads.
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#ifndef VERTEX_CACHE_HPP
+#define VERTEX_CACHE_HPP
+
+#include "types.hpp"
+
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+namespace elga {
+
+    class VertexCache {
+        private:
+            typedef struct slot {
+                vertex_t v;
+                batch_t batch;
+                bool referenced;
+            } slot_t;
+
+            size_t capacity_;
+            size_t value_size_;
+            /** The batch whose results are current */
+            batch_t batch_;
+            std::vector<slot_t> slots_;
+            /** Values, value_size_ bytes per slot */
+            std::vector<char> values_;
+            absl::flat_hash_map<vertex_t, size_t> index_;
+            /** The CLOCK hand */
+            size_t hand_;
+            size_t hits_;
+            size_t misses_;
+
+            /** Choose a slot to replace */
+            size_t evict();
+
+        public:
+            VertexCache(size_t capacity, size_t value_size);
+
+            /** Return the current batch, to tag answers requested now */
+            batch_t batch() const { return batch_; }
+
+            /** Return v's value from the current batch, or nullptr */
+            const char *find(vertex_t v);
+
+            /** Cache v's value, answered as of the given batch; answers
+             * from before an invalidation are dropped */
+            void insert(vertex_t v, const char *value, batch_t batch);
+
+            /** A batch completed, so invalidate every entry */
+            void invalidate() { ++batch_; }
+
+            size_t size() const { return index_.size(); }
+            size_t value_size() const { return value_size_; }
+            size_t hits() const { return hits_; }
+            size_t misses() const { return misses_; }
+    };
+
+}
+
+#endif
@@ -88,6 +88,15 @@ int test_address_pullstr() {
     return 0;
 }
 
+int test_address_querystr() {
+    ZMQAddress a("99.99.99.98", 99);
+
+    ASSERTEQ(std::string(a.get_remote_query_str()), "tcp://99.99.99.98:17599");
+    ASSERTEQ(std::string(a.get_local_query_str()), "inproc://399");
+
+    return 0;
+}
+
 int test_zero() {
     ZMQAddress a("4.3.5.4", 0);
     ZMQAddress z{};
@@ -118,6 +127,7 @@ int main(int argc, char **argv) {
     RUN_TEST(test_address_remlocal)
     RUN_TEST(test_address_pubstr)
     RUN_TEST(test_address_pullstr)
+    RUN_TEST(test_address_querystr)
     RUN_TEST(test_zero)
     RUN_TEST(test_emptyzero);
 
@@ -0,0 +1,157 @@
+/**
+ * Test the aggregate query merging
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "tests.hpp"
+
+#include "aggregate.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using namespace elga;
+using namespace elga::aggregate;
+
+int top_k_merge() {
+    // Two agents' partial results, merged as the directory does
+    TopK a(3), b(3);
+    for (vertex_t v = 0; v < 100; ++v) {
+        if (v % 2 == 0) a.push(v, (double)v);
+        else b.push(v, (double)v);
+    }
+    auto ra = a.sorted();
+    auto rb = b.sorted();
+    ASSERTEQ(ra.size(), 3);
+    ASSERTEQ(ra[0].v, 98);
+    ASSERTEQ(rb[2].v, 95);
+
+    TopK merged(3);
+    merged.push(ra.data(), ra.size());
+    merged.push(rb.data(), rb.size());
+    auto res = merged.sorted();
+    ASSERTEQ(res.size(), 3);
+    ASSERTEQ(res[0].v, 99);
+    ASSERTEQ(res[1].v, 98);
+    ASSERTEQ(res[2].v, 97);
+
+    // Ties are broken by the smaller vertex
+    TopK ties(2);
+    ties.push(7, 1.);
+    ties.push(3, 1.);
+    ties.push(5, 1.);
+    res = ties.sorted();
+    ASSERTEQ(res[0].v, 3);
+    ASSERTEQ(res[1].v, 5);
+
+    // Fewer vertices than k
+    TopK few(10);
+    few.push(1, 0.5);
+    ASSERTEQ(few.sorted().size(), 1);
+    TopK none(0);
+    none.push(1, 0.5);
+    ASSERTEQ(none.sorted().size(), 0);
+
+    return 0;
+}
+
+int histograms() {
+    // Component labels counted on two agents
+    counts_t a, b;
+    a[0.] = 3; a[10.] = 1;
+    b[0.] = 2; b[20.] = 1; b[30.] = 5;
+
+    counts_t merged;
+    auto ba = buckets(a);
+    auto bb = buckets(b);
+    ASSERTEQ(ba.size(), 2);
+    ASSERTEQ(ba[0].key, 0.);
+    merge(merged, ba.data(), ba.size());
+    merge(merged, bb.data(), bb.size());
+
+    auto values = buckets(merged);
+    ASSERTEQ(values.size(), 4);
+    ASSERTEQ(values[0].key, 0.);
+    ASSERTEQ(values[0].count, 5);
+    ASSERTEQ(values[3].key, 30.);
+
+    return 0;
+}
+
+int groups_exact() {
+    // Labels past 2^53 that a double would merge
+    const uint64_t big = (1ULL << 53);
+    group_counts_t a, b;
+    a[big] = 3; a[big+1] = 1;
+    b[big] = 2; b[big+2] = 1; b[7] = 5;
+
+    group_counts_t merged;
+    auto ga = groups(a);
+    auto gb = groups(b);
+    ASSERTEQ(ga.size(), 2);
+    merge(merged, ga.data(), ga.size());
+    merge(merged, gb.data(), gb.size());
+    ASSERTEQ(merged.size(), 4);
+    ASSERTEQ(merged[big], 5);
+
+    // Sizes 5, 1, 1, 5: two of each
+    auto sizes = buckets(group_sizes(merged));
+    ASSERTEQ(sizes.size(), 2);
+    ASSERTEQ(sizes[0].key, 1.);
+    ASSERTEQ(sizes[0].count, 2);
+    ASSERTEQ(sizes[1].key, 5.);
+    ASSERTEQ(sizes[1].count, 2);
+
+    return 0;
+}
+
+int merge_replies() {
+    // The directory merges whole records, and rejects anything else
+    group_counts_t a;
+    a[10] = 2; a[20] = 3;
+    auto ga = groups(a);
+
+    Merge m(AGG_GROUP_SIZES, 0);
+    m.add((const char*)ga.data(), ga.size()*sizeof(group_t));
+    m.add(nullptr, 0);
+    bool threw = false;
+    try {
+        m.add((const char*)ga.data(), sizeof(group_t)-1);
+    } catch (std::runtime_error &e) {
+        threw = true;
+    }
+    ASSERTEQ(threw, true);
+
+    auto resp = m.result();
+    ASSERTEQ(resp.size(), 2*sizeof(bucket_t));
+    std::vector<bucket_t> sizes(2);
+    std::memcpy(sizes.data(), resp.data(), resp.size());
+    ASSERTEQ(sizes[0].key, 2.);
+    ASSERTEQ(sizes[1].key, 3.);
+
+    ranked_t r { 5, 1. };
+    Merge top(AGG_TOP_K, 1);
+    top.add((const char*)&r, sizeof(r));
+    ASSERTEQ(top.result().size(), sizeof(ranked_t));
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int ret = 0;
+
+    RUN_TEST(top_k_merge)
+    RUN_TEST(histograms)
+    RUN_TEST(groups_exact)
+    RUN_TEST(merge_replies)
+
+    return ret;
+}
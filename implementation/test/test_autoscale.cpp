@@ -0,0 +1,187 @@
+/**
+ * Test the autoscaling policies
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "tests.hpp"
+
+#include "autoscale.hpp"
+
+using namespace elga;
+
+/** Cluster metrics for a completed batch */
+cluster_metrics_t batch_done(batch_t batch, uint64_t agents, uint64_t nE, double T, uint64_t bytes=0) {
+    cluster_metrics_t m = {};
+    m.agents = agents;
+    m.max_agents = 1024;
+    m.batch = batch;
+    m.batch_time = T;
+    m.batch_bytes = bytes;
+    m.nE = nE;
+    return m;
+}
+
+int combine_and_trace() {
+    agent_metrics_t a = {10., 0.5, 2.0, 100, 1000, 50, 5, 3};
+    agent_metrics_t b = {20., 0.25, 3.0, 200, 3000, 70, 1, 3};
+
+    cluster_metrics_t m = {};
+    add_metrics(m, a, true);
+    add_metrics(m, b, false);
+    ASSERTEQ(m.agents, 2);
+    ASSERTEQ(m.query_rate, 30.);
+    ASSERTEQ(m.superstep_time, 0.5);
+    ASSERTEQ(m.batch, 3);
+    ASSERTEQ(m.batch_time, 3.0);
+    ASSERTEQ(m.batch_bytes, 300);
+    ASSERTEQ(m.rss, 4000);
+    ASSERTEQ(m.rss_max, 3000);
+    ASSERTEQ(m.nE, 120);
+    ASSERTEQ(m.pending, 6);
+
+    // An agent behind on batches means there is no batch sample
+    agent_metrics_t c = b;
+    c.batch = 2;
+    add_metrics(m, c, false);
+    ASSERTEQ(m.batch, 2);
+    ASSERTEQ(m.batch_time, 0.);
+    add_metrics(m, b, false);
+    ASSERTEQ(m.batch_time, 0.);
+
+    m.time = 1234;
+    m.max_agents = 8;
+    cluster_metrics_t r;
+    ASSERTEQ(parse_metrics(format_metrics(m), r), true);
+    ASSERTEQ(r.time, 1234);
+    ASSERTEQ(r.agents, 4);
+    ASSERTEQ(r.max_agents, 8);
+    ASSERTEQ(r.query_rate, m.query_rate);
+    ASSERTEQ(r.superstep_time, m.superstep_time);
+    ASSERTEQ(r.batch, m.batch);
+    ASSERTEQ(r.rss, m.rss);
+    ASSERTEQ(r.nE, m.nE);
+    ASSERTEQ(r.pending, m.pending);
+
+    ASSERTEQ(parse_metrics("T,1,2,3", r), false);
+    ASSERTEQ(parse_metrics("M,1,2,x,4,5,6,7,8,9,10,11,12", r), false);
+
+    return 0;
+}
+
+int query_rate() {
+    QueryRatePolicy p(150);
+    cluster_metrics_t m = {};
+    m.max_agents = 100;
+    m.query_rate = 1500;
+    ASSERTEQ(p.target(m), 11);
+    m.query_rate = 0;
+    ASSERTEQ(p.target(m), 1);
+    m.query_rate = 1e6;
+    ASSERTEQ(p.target(m), 100);
+
+    return 0;
+}
+
+int cost_model() {
+    CostModelPolicy p(0.2, 1e9, 0, 1e9, 16);
+
+    // No batches yet, so keep the agents running
+    cluster_metrics_t m = batch_done(0, 4, 1000000, 0.);
+    ASSERTEQ(p.target(m), 4);
+    ASSERTEQ((p.predict(m, 4) < 0.), true);
+
+    // Batches following T = 1e-6 W/n + 0.05
+    p.target(batch_done(1, 4, 1000000, 0.3));
+    p.target(batch_done(2, 4, 2000000, 0.55));
+    // Repeats of a batch are not new samples
+    p.target(batch_done(2, 4, 2000000, 0.55));
+    ASSERTEQ(p.num_samples(), 2);
+
+    m = batch_done(2, 4, 2000000, 0.55);
+    ASSERTCLOSE(p.predict(m, 10), 0.25, 1e-9);
+    // 2/n + 0.05 <= 0.2 first holds with 14 agents
+    ASSERTEQ(p.target(m), 14);
+
+    // Pending updates are work for the next batch
+    m.pending = 1100000;
+    ASSERTEQ(p.target(m), 21);
+    m.pending = 0;
+
+    // Too few agents available gives the fastest possible
+    m.max_agents = 8;
+    ASSERTEQ(p.target(m), 8);
+    m.max_agents = 1024;
+
+    // Scaling in when the graph shrinks
+    m.nE = 200000;
+    ASSERTEQ(p.target(m), 2);
+
+    // Samples count pending edges as predictions do
+    CostModelPolicy q(0.2, 1e9, 0, 1e9, 16);
+    m = batch_done(1, 4, 600000, 0.3);
+    m.pending = 400000;
+    q.target(m);
+    m = batch_done(2, 4, 1500000, 0.55);
+    m.pending = 500000;
+    q.target(m);
+    ASSERTCLOSE(q.predict(m, 10), 0.25, 1e-9);
+
+    return 0;
+}
+
+int cost_model_limits() {
+    // Memory and queries set the fewest agents, even when batches are fast
+    CostModelPolicy p(10., 1e9, 1000, 100, 16);
+    p.target(batch_done(1, 4, 1000, 0.01));
+    p.target(batch_done(2, 4, 2000, 0.02));
+
+    cluster_metrics_t m = batch_done(2, 4, 2000, 0.02);
+    ASSERTEQ(p.target(m), 1);
+    m.rss = 20500;
+    ASSERTEQ(p.target(m), 21);
+    m.query_rate = 5000;
+    ASSERTEQ(p.target(m), 51);
+
+    return 0;
+}
+
+int cost_model_network() {
+    // 8 bytes per crossing edge at 1e6 bytes/s, with T = 1e-6 W/n + 0.1
+    // plus the network time
+    double bw = 1e6;
+    CostModelPolicy p(1e9, bw, 0, 1e9, 16);
+    auto T = [&](double n, double W) {
+        return 1e-6*W/n + 0.1 + 8*W*(n-1)/(n*n)/bw;
+    };
+    auto bytes = [](double n, double W) {
+        return (uint64_t)(8*W*(n-1)/n);
+    };
+    p.target(batch_done(1, 4, 100000, T(4, 100000), bytes(4, 100000)));
+    p.target(batch_done(2, 8, 100000, T(8, 100000), bytes(8, 100000)));
+    p.target(batch_done(3, 8, 300000, T(8, 300000), bytes(8, 300000)));
+
+    cluster_metrics_t m = batch_done(3, 8, 300000, T(8, 300000));
+    ASSERTCLOSE(p.predict(m, 2), T(2, 300000), 1e-6);
+    ASSERTCLOSE(p.predict(m, 32), T(32, 300000), 1e-6);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int ret = 0;
+
+    RUN_TEST(combine_and_trace)
+    RUN_TEST(query_rate)
+    RUN_TEST(cost_model)
+    RUN_TEST(cost_model_limits)
+    RUN_TEST(cost_model_network)
+
+    return ret;
+}
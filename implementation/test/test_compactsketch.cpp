@@ -0,0 +1,125 @@
+/**
+ * Test the compact count-min sketch
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "tests.hpp"
+
+#include "compactsketch.hpp"
+#include "countminsketch.hpp"
+
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+/** Return the number of distinct counters the keys fall on */
+static size_t num_cells(const std::vector<uint64_t> &keys) {
+    std::set<uint64_t> cells;
+    for (uint64_t key : keys) {
+        uint64_t idx[TABLE_DEPTH];
+        CountSketch::cells(key, idx);
+        cells.insert(idx, idx+TABLE_DEPTH);
+    }
+    return cells.size();
+}
+
+int test_conservative() {
+    // Conservative update never undercounts, and is never above the
+    // plain count-min sketch
+    CompactCountMinSketch compact;
+    CountMinSketch cms;
+    for (uint64_t k = 0; k < 50000; ++k) {
+        for (uint64_t i = 0; i <= k % 10; ++i) {
+            compact.count(k);
+            cms.count(k);
+        }
+    }
+    for (uint64_t k = 0; k < 50000; ++k) {
+        ASSERTEQ((compact.query(k) >= (int32_t)(k % 10)+1), true);
+        ASSERTEQ((compact.query(k) <= cms.query(k)), true);
+    }
+    ASSERTEQ(compact.query(7), 8);
+
+    return 0;
+}
+
+int test_saturate() {
+    // Counts past 16 bits move to the side table
+    CompactCountMinSketch compact;
+    for (int32_t i = 1; i <= 100000; ++i)
+        ASSERTEQ(compact.query_count(42), i);
+    ASSERTEQ(compact.query(42), 100000);
+    ASSERTEQ(compact.overflow(), num_cells({42}));
+
+    // Merging sums, escalating counters that no longer fit
+    CompactCountMinSketch other;
+    for (int32_t i = 0; i < 40000; ++i) {
+        other.count(7);
+        other.count(42);
+    }
+    ASSERTEQ(other.overflow(), 0);
+    other.merge(other);
+    ASSERTEQ(other.query(7), 80000);
+    ASSERTEQ(other.overflow(), (num_cells({7, 42})));
+    compact.merge(other);
+    ASSERTEQ(compact.query(42), 180000);
+
+    compact.clear();
+    ASSERTEQ(compact.query(42), 0);
+    ASSERTEQ(compact.overflow(), 0);
+
+    return 0;
+}
+
+int test_serialize() {
+    CompactCountMinSketch compact;
+    for (uint64_t i = 0; i < 10000; ++i)
+        compact.count(i % 300);
+    for (int32_t i = 0; i < 70000; ++i)
+        compact.count(5);
+
+    // Round trip behind other data, as in a directory update
+    std::vector<char> msg(24, 'x');
+    compact.serialize(msg);
+    ASSERTEQ((msg.size() < CompactCountMinSketch::size()/100), true);
+
+    CompactCountMinSketch other;
+    ASSERTEQ(other.update(msg.data(), msg.size()), msg.size()-24);
+    ASSERTEQ((other == compact), true);
+    ASSERTEQ(other.query(5), 70034);
+
+    // An empty sketch is only its size
+    CompactCountMinSketch empty;
+    std::vector<char> empty_ser;
+    empty.serialize(empty_ser);
+    ASSERTEQ(empty_ser.size(), sizeof(uint64_t));
+    ASSERTEQ(other.update(empty_ser.data(), empty_ser.size()), sizeof(uint64_t));
+    ASSERTEQ((other == empty), true);
+
+    bool threw = false;
+    try {
+        CompactCountMinSketch bad(msg.data()+24, msg.size()-25);
+    } catch (std::runtime_error &e) {
+        threw = true;
+    }
+    ASSERTEQ(threw, true);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int ret = 0;
+
+    RUN_TEST(test_conservative)
+    RUN_TEST(test_saturate)
+    RUN_TEST(test_serialize)
+
+    return ret;
+}
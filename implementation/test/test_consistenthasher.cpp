@@ -161,6 +161,108 @@ int test_findone_ignorehigh(){
     return ret;
 }
 
+int test_incremental(){
+    int ret = 0;
+    NoReplication rm {};
+
+    std::vector<uint64_t> agents = {1, 2, 3, 4, 5, 6, 7, 8};
+    ConsistentHasher ch(agents, rm);
+
+    // Change the ring incrementally and compare against a rebuild
+    ch.remove_agents({2, 7});
+    ch.add_agents({11, 12, 13});
+    std::vector<uint64_t> final_agents = {1, 3, 4, 5, 6, 8, 11, 12, 13};
+    ConsistentHasher rebuilt(final_agents, rm);
+
+    for (uint64_t key = 0; key < 1000; ++key)
+        ASSERTEQ(ch.find(key)[0], rebuilt.find(key)[0])
+
+    return ret;
+}
+
+/** Whether h is in one of the ranges */
+bool in_ranges(const std::vector<hash_range_t> &ranges, uint64_t h) {
+    for (auto [lo, hi] : ranges)
+        if (lo <= h && h <= hi) return true;
+    return false;
+}
+
+int test_owned_ranges(){
+    int ret = 0;
+    NoReplication rm {};
+
+    std::vector<uint64_t> agents = {1, 2, 3, 4, 5, 6, 7, 8};
+    ConsistentHasher ch(agents, rm);
+
+    // Every key is in exactly its owner's ranges
+    for (uint64_t key = 0; key < 2000; ++key) {
+        uint64_t owner = ch.find(key)[0];
+        for (uint64_t a : agents)
+            ASSERTEQ(in_ranges(ch.owned_ranges(a), hashing::hash(key)), (a == owner))
+    }
+
+    // A joining agent takes keys only from the ranges others lose
+    auto before = ch.owned_ranges(3);
+    ch.add_agents({11, 12});
+    auto lost = subtract_ranges(before, ch.owned_ranges(3));
+    for (uint64_t key = 0; key < 2000; ++key) {
+        bool was_mine = in_ranges(before, hashing::hash(key));
+        bool moved = was_mine && ch.find(key)[0] != 3;
+        ASSERTEQ(in_ranges(lost, hashing::hash(key)), moved)
+    }
+
+    return ret;
+}
+
+int test_subtract_ranges(){
+    int ret = 0;
+
+    std::vector<hash_range_t> a = {{0, 10}, {20, 30}, {50, 60}};
+    std::vector<hash_range_t> b = {{5, 6}, {25, 40}, {50, 60}};
+    auto res = subtract_ranges(a, b);
+    ASSERTEQ(res.size(), 3)
+    ASSERTEQ(res[0].first, 0)
+    ASSERTEQ(res[0].second, 4)
+    ASSERTEQ(res[1].first, 7)
+    ASSERTEQ(res[1].second, 10)
+    ASSERTEQ(res[2].first, 20)
+    ASSERTEQ(res[2].second, 24)
+
+    ASSERTEQ(subtract_ranges(a, {}).size(), 3)
+    ASSERTEQ(subtract_ranges({}, b).size(), 0)
+
+    return ret;
+}
+
+int test_rendezvous(){
+    int ret = 0;
+
+    std::vector<uint64_t> containers = {11, 22, 33, 44};
+    absl::flat_hash_map<uint64_t, size_t> counts;
+    for (uint64_t key = 0; key < 40000; ++key) {
+        uint64_t c = rendezvous(containers, key);
+        ASSERTEQ(c, rendezvous(containers, key))
+        ++counts[c];
+    }
+    // Every container takes about a quarter of the keys
+    ASSERTEQ(counts.size(), 4)
+    for (auto & [c, count] : counts)
+        ASSERTEQ((count > 9000 && count < 11000), true)
+
+    // The order does not matter, and removing a container moves only
+    // its keys
+    std::vector<uint64_t> reordered = {44, 22, 11, 33};
+    std::vector<uint64_t> fewer = {11, 33, 44};
+    for (uint64_t key = 0; key < 40000; ++key) {
+        uint64_t c = rendezvous(containers, key);
+        ASSERTEQ(rendezvous(reordered, key), c)
+        if (c != 22)
+            ASSERTEQ(rendezvous(fewer, key), c)
+    }
+
+    return ret;
+}
+
 int main(int argc, char **argv) {
     int ret = 0;
 
@@ -169,6 +271,10 @@ int main(int argc, char **argv) {
     RUN_TEST(test_find)
     RUN_TEST(test_findone)
     RUN_TEST(test_findone_ignorehigh)
+    RUN_TEST(test_incremental)
+    RUN_TEST(test_owned_ranges)
+    RUN_TEST(test_subtract_ranges)
+    RUN_TEST(test_rendezvous)
 
     return ret;
 }
@@ -48,11 +48,87 @@ int test_seriliaze_deserialize(){
     return 0;
 }
 
+int test_delta(){
+    CountMinSketch base;
+    for(uint64_t i = 0; i < 100; i++)
+        base.count(i);
+
+    CountMinSketch cm(base.serialize());
+    for(uint64_t i = 50; i < 60; i++)
+        cm.count(i);
+    cm.count(1000);
+
+    std::vector<char> delta;
+    cm.encode_delta(base, delta);
+    // Only the changed cells are sent
+    if (delta.size() >= CountMinSketch::size() / 100) return 1;
+
+    CountMinSketch other(base.serialize());
+    other.apply_delta(delta.data(), delta.size());
+    bool is_same = cm == other;
+    ASSERTEQ(is_same, 1)
+
+    // No changes encode to nothing
+    delta.clear();
+    cm.encode_delta(other, delta);
+    ASSERTEQ(delta.size(), 0)
+
+    return 0;
+}
+
+int test_cells(){
+    CountMinSketch cm;
+    for (uint64_t key = 0; key < 10000; key++) {
+        uint64_t idx[TABLE_DEPTH];
+        cm.cells(key, idx);
+        #ifdef CONFIG_BLOCKED_SKETCH
+        // Counters in one cache line
+        for (size_t i = 0; i < TABLE_DEPTH; i++)
+            ASSERTEQ(idx[i]*sizeof(int32_t)/64, idx[0]*sizeof(int32_t)/64)
+        #else
+        // One counter in each row
+        for (size_t i = 0; i < TABLE_DEPTH; i++)
+            ASSERTEQ(idx[i]/TABLE_WIDTH, i)
+        #endif
+    }
+    return 0;
+}
+
+int test_merge(){
+    CountMinSketch a, b, both;
+    for (uint64_t i = 0; i < 1000; i++) {
+        a.count(i);
+        b.count(i % 10);
+        both.count(i);
+        both.count(i % 10);
+    }
+
+    a.merge(b);
+    ASSERTEQ((a == both), true)
+
+    // Disjoint merges keep the larger counters
+    CountMinSketch c, d;
+    for (uint64_t i = 0; i < 30; i++)
+        c.count(1);
+    for (uint64_t i = 0; i < 20; i++) {
+        d.count(1);
+        d.count(2);
+    }
+    c.disjoint_merge(d);
+    ASSERTEQ(c.query(1), 30)
+    ASSERTEQ(c.query(2), 20)
+
+    return 0;
+}
+
 int main(int argc, char **argv) {
     int ret = 0;
 
     RUN_TEST(test_insert_same_and_check)
     RUN_TEST(test_seriliaze_deserialize)
+    RUN_TEST(test_delta)
+    RUN_TEST(test_cells)
+    RUN_TEST(test_merge)
 
     return ret;
 }
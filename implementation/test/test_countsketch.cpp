@@ -15,6 +15,7 @@
 
 #include <fstream>
 #include <unordered_map>
+#include <algorithm>
 #include <cmath>
 
 int test_insert_same_and_check(){
@@ -75,12 +76,31 @@ int test_update(){
 }
 
 
+int test_median(){
+    // The sorting network agrees with sorting
+    CountSketch cm;
+    uint64_t x = 1;
+    for (size_t t = 0; t < 1000; t++) {
+        int32_t res[TABLE_DEPTH], sorted[TABLE_DEPTH];
+        for (size_t i = 0; i < TABLE_DEPTH; i++) {
+            x = hashing::hash(x);
+            res[i] = sorted[i] = (int32_t)(x % 21) - 10;
+        }
+        std::sort(sorted, sorted + TABLE_DEPTH);
+        uint32_t expected = (TABLE_DEPTH & 1) ? sorted[TABLE_DEPTH/2]
+            : (sorted[TABLE_DEPTH/2-1] + sorted[TABLE_DEPTH/2]) >> 1;
+        ASSERTEQ(cm.median(res), expected)
+    }
+    return 0;
+}
+
 int main(int argc, char **argv) {
     int ret = 0;
 
     RUN_TEST(test_insert_same_and_check)
     RUN_TEST(test_seriliaze_deserialize)
     RUN_TEST(test_update)
+    RUN_TEST(test_median)
 
     return ret;
 }
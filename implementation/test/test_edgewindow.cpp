@@ -0,0 +1,159 @@
+/**
+ * Test the time-window expiry index
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "tests.hpp"
+
+#include "edgewindow.hpp"
+
+#include <vector>
+
+using namespace elga;
+
+int expire_in_order() {
+    ExpiryIndex idx(10, 64);
+
+    for (timestamp_t t = 100; t < 200; ++t)
+        idx.insert(t, t+1, t);
+    ASSERTEQ(idx.size(), 100);
+    ASSERTEQ(idx.num_buckets(), 10);
+
+    // Expire a partial bucket
+    std::vector<timestamp_t> seen;
+    size_t n = idx.expire(125, [&](const ExpiryIndex::entry_t &e) {
+            seen.push_back(e.timestamp);
+        });
+    ASSERTEQ(n, 25);
+    ASSERTEQ(seen.size(), 25);
+    for (timestamp_t t : seen) {
+        if (t >= 125) return 1;
+    }
+    ASSERTEQ(idx.size(), 75);
+    ASSERTEQ(idx.num_buckets(), 8);
+
+    // Nothing further to expire at the same cutoff
+    n = idx.expire(125, [&](const ExpiryIndex::entry_t &) { });
+    ASSERTEQ(n, 0);
+
+    // Expire everything
+    bool bad = false;
+    n = idx.expire(1000, [&](const ExpiryIndex::entry_t &e) {
+            if (e.dst != e.src+1) bad = true;
+        });
+    ASSERTEQ(n, 75);
+    ASSERTEQ(bad, false);
+    ASSERTEQ(idx.size(), 0);
+    ASSERTEQ(idx.num_buckets(), 0);
+
+    return 0;
+}
+
+int expire_out_of_order() {
+    ExpiryIndex idx(4, 64);
+
+    idx.insert(1, 2, 50);
+    idx.insert(1, 3, 41);
+    idx.insert(1, 4, 58);
+    // Older than the front bucket
+    idx.insert(1, 5, 3);
+
+    bool bad = false;
+    size_t n = idx.expire(44, [&](const ExpiryIndex::entry_t &e) {
+            if (e.timestamp >= 44) bad = true;
+        });
+    ASSERTEQ(n, 2);
+    ASSERTEQ(bad, false);
+    ASSERTEQ(idx.size(), 2);
+
+    // A large gap after emptying rebases the ring
+    idx.expire(100, [&](const ExpiryIndex::entry_t &) { });
+    idx.insert(1, 6, 1000000);
+    ASSERTEQ(idx.num_buckets(), 1);
+
+    return 0;
+}
+
+int erase_entries() {
+    ExpiryIndex idx(10, 64);
+
+    idx.insert(1, 2, 100);
+    idx.insert(1, 2, 100);
+    idx.insert(1, 3, 105);
+    idx.insert(4, 5, 150);
+    ASSERTEQ(idx.size(), 4);
+    ASSERTEQ(idx.num_buckets(), 6);
+
+    // Copies of a multi-edge are erased one at a time
+    ASSERTEQ(idx.erase(1, 2, 100), true);
+    ASSERTEQ(idx.size(), 3);
+    ASSERTEQ(idx.erase(1, 2, 101), false);
+    ASSERTEQ(idx.erase(9, 9, 1000), false);
+
+    // Erasing the newest edge shrinks the ring
+    ASSERTEQ(idx.erase(4, 5, 150), true);
+    ASSERTEQ(idx.num_buckets(), 1);
+
+    // Erased edges are not expired, and erasing while expiring is safe
+    size_t n = idx.expire(200, [&](const ExpiryIndex::entry_t &e) {
+            idx.erase(e.src, e.dst, e.timestamp);
+        });
+    ASSERTEQ(n, 2);
+    ASSERTEQ(idx.size(), 0);
+
+    return 0;
+}
+
+int expire_far_future() {
+    ExpiryIndex idx(10, 5);
+
+    idx.insert(1, 2, 100);
+    idx.insert(1, 3, 125);
+    // Far past the ring, as with a timestamp in the wrong unit
+    idx.insert(1, 4, 100000000000000);
+    ASSERTEQ(idx.size(), 3);
+    ASSERTEQ(idx.num_buckets(), 5);
+
+    // Edges further ahead than the ring are kept when their bucket
+    // expires
+    std::vector<timestamp_t> seen;
+    size_t n = idx.expire(1000, [&](const ExpiryIndex::entry_t &e) {
+            seen.push_back(e.timestamp);
+        });
+    ASSERTEQ(n, 2);
+    ASSERTEQ(seen.size(), 2);
+    ASSERTEQ(idx.size(), 1);
+    ASSERTEQ(idx.num_buckets(), 1);
+
+    idx.insert(1, 5, 200000000000000);
+    ASSERTEQ((idx.num_buckets() <= 5), true);
+    n = idx.expire(100000000000001, [&](const ExpiryIndex::entry_t &e) {
+            seen.push_back(e.timestamp);
+        });
+    ASSERTEQ(n, 1);
+    ASSERTEQ(seen.back(), 100000000000000);
+
+    // They can still be erased
+    ASSERTEQ(idx.erase(1, 5, 200000000000000), true);
+    ASSERTEQ(idx.size(), 0);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int ret = 0;
+
+    RUN_TEST(expire_in_order)
+    RUN_TEST(expire_out_of_order)
+    RUN_TEST(erase_entries)
+    RUN_TEST(expire_far_future)
+
+    return ret;
+}
@@ -0,0 +1,80 @@
+/**
+ * Test the synthetic graph generators
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "tests.hpp"
+
+#include "generator.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace elga;
+using namespace elga::generator;
+
+int ranks_partition() {
+    uint64_t M = 1001;
+    uint64_t next = 0;
+    for (uint32_t r = 0; r < 7; ++r) {
+        auto [start, end] = rank_range(M, r, 7);
+        ASSERTEQ(start, next);
+        next = end;
+    }
+    ASSERTEQ(next, M);
+
+    return 0;
+}
+
+template<typename Generator>
+int check_generator(const Generator &a, const Generator &b, const Generator &c) {
+    const uint64_t M = 200000;
+    std::vector<uint64_t> deg(a.num_vertices());
+    bool differs = false;
+    for (uint64_t idx = 0; idx < M; ++idx) {
+        edge_t e = a.edge(idx);
+        // Reproducible from the seed alone
+        ASSERTEQNP(e, b.edge(idx));
+        if (!(e == c.edge(idx))) differs = true;
+        ASSERTNEQNP(e.src, e.dst);
+        if (e.src >= a.num_vertices() || e.dst >= a.num_vertices()) return 1;
+        ++deg[e.src];
+        ++deg[e.dst];
+    }
+    ASSERTEQ(differs, true);
+
+    // The graph must be skewed: the largest degree is far above average
+    uint64_t max_deg = *std::max_element(deg.begin(), deg.end());
+    double avg_deg = 2.0*M/a.num_vertices();
+    if (max_deg < 20*avg_deg) {
+        std::cerr << "max degree " << max_deg << " average " << avg_deg << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+int rmat() {
+    return check_generator(RMAT(14, 5), RMAT(14, 5), RMAT(14, 6));
+}
+
+int chung_lu() {
+    return check_generator(ChungLu(16384, 2.1, 5), ChungLu(16384, 2.1, 5), ChungLu(16384, 2.1, 6));
+}
+
+int main(int argc, char **argv) {
+    int ret = 0;
+
+    RUN_TEST(ranks_partition)
+    RUN_TEST(rmat)
+    RUN_TEST(chung_lu)
+
+    return ret;
+}
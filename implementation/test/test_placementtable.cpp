@@ -0,0 +1,225 @@
+/**
+ * Test the placement table
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "tests.hpp"
+
+#include "placementtable.hpp"
+#include "pack.hpp"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+const uint64_t agent_mask = (1llu<<49)-1;
+
+std::vector<uint64_t> vagents_of(uint64_t agent_ser, aid_t count) {
+    std::vector<uint64_t> res;
+    for (aid_t va = 0; va < count; ++va)
+        res.push_back(elga::pack_agent(agent_ser, va));
+    return res;
+}
+
+std::vector<uint64_t> make_agents(size_t num_agents, aid_t count) {
+    std::vector<uint64_t> agents;
+    for (uint64_t a = 1; a <= num_agents; ++a) {
+        auto v = vagents_of(a, count);
+        agents.insert(agents.end(), v.begin(), v.end());
+    }
+    return agents;
+}
+
+/** The slots of a table of 2^10 held by each of agents 1..n */
+absl::flat_hash_map<uint64_t, size_t> slot_counts(PlacementTable &pt, size_t n) {
+    absl::flat_hash_map<uint64_t, size_t> counts;
+    for (uint64_t a = 1; a <= n; ++a)
+        for (auto &r : pt.owned_ranges(a))
+            counts[a] += (r.second >> 54) - (r.first >> 54) + 1;
+    return counts;
+}
+
+int test_empty() {
+    std::vector<uint64_t> agents {};
+    NoReplication rm {};
+    PlacementTable pt(agents, rm, 10);
+
+    ASSERTEQ(pt.find(1).size(), 0);
+    bool have_ownership = true;
+    ASSERTEQ(pt.find_one(10, 3, have_ownership), 0);
+    ASSERTEQ(have_ownership, false);
+    ASSERTEQ(pt.owned_ranges(1).size(), 0);
+
+    bool threw = false;
+    try {
+        PlacementTable bad(agents, rm, 0);
+    } catch (std::runtime_error &e) {
+        threw = true;
+    }
+    ASSERTEQ(threw, true);
+
+    return 0;
+}
+
+int test_balance() {
+    // 1024 slots over 8 equal agents is exactly 128 each
+    std::vector<uint64_t> agents = make_agents(8, 4);
+    NoReplication rm {};
+    PlacementTable pt(agents, rm, 10);
+    ASSERTEQ(pt.size(), 1024);
+
+    auto counts = slot_counts(pt, 8);
+    for (uint64_t a = 1; a <= 8; ++a)
+        ASSERTEQ(counts[a], 128);
+
+    // Every virtual agent is used
+    absl::flat_hash_set<uint64_t> seen;
+    for (uint64_t k = 0; k < 100000; ++k)
+        seen.insert(pt.find(k)[0]);
+    ASSERTEQ(seen.size(), 32);
+
+    return 0;
+}
+
+int test_weights() {
+    // Slots follow the virtual agent counts, to within one
+    std::vector<uint64_t> agents = vagents_of(1, 1);
+    auto more = vagents_of(2, 2);
+    agents.insert(agents.end(), more.begin(), more.end());
+    more = vagents_of(3, 4);
+    agents.insert(agents.end(), more.begin(), more.end());
+    NoReplication rm {};
+    PlacementTable pt(agents, rm, 10);
+
+    auto counts = slot_counts(pt, 3);
+    ASSERTEQ((counts[1] >= 146 && counts[1] <= 147), true);
+    ASSERTEQ((counts[2] >= 292 && counts[2] <= 293), true);
+    ASSERTEQ((counts[3] >= 585 && counts[3] <= 586), true);
+    ASSERTEQ((counts[1]+counts[2]+counts[3]), 1024);
+
+    return 0;
+}
+
+/** Replicate every key a fixed number of times */
+class FixedReplication : public ReplicationMap {
+    public:
+        int32_t query(uint64_t key) const { return 3; }
+        int32_t sk_query(uint64_t key) const { return 0; }
+};
+
+int test_replicas() {
+    FixedReplication cs {};
+    size_t reps = 3;
+
+    std::vector<uint64_t> agents = make_agents(16, 4);
+    PlacementTable pt(agents, cs, 10);
+
+    auto found = pt.find(10);
+    ASSERTEQ(found.size(), reps);
+    absl::flat_hash_set<uint64_t> real;
+    for (uint64_t f : found)
+        real.insert(f & agent_mask);
+    ASSERTEQ(real.size(), reps);
+
+    // Never more replicas than real agents
+    std::vector<uint64_t> two = make_agents(2, 4);
+    PlacementTable small(two, cs, 10);
+    ASSERTEQ(small.find(10).size(), 2);
+
+    bool have_ownership = false;
+    pt.find_one(10, found[0] & agent_mask, have_ownership);
+    ASSERTEQ(have_ownership, true);
+
+    return 0;
+}
+
+int test_owned_ranges() {
+    std::vector<uint64_t> agents = make_agents(5, 3);
+    NoReplication rm {};
+    PlacementTable pt(agents, rm, 10);
+
+    // Each key's owner holds the range of its hash
+    for (uint64_t k = 0; k < 10000; ++k) {
+        uint64_t owner = pt.find(k)[0] & agent_mask;
+        uint64_t h = hashing::hash(k);
+        bool found = false;
+        for (auto &r : pt.owned_ranges(owner))
+            if (h >= r.first && h <= r.second) found = true;
+        ASSERTEQ(found, true);
+    }
+
+    // The ranges cover the hash space exactly once
+    std::vector<hash_range_t> all;
+    for (uint64_t a = 1; a <= 5; ++a) {
+        auto r = pt.owned_ranges(a);
+        all.insert(all.end(), r.begin(), r.end());
+    }
+    std::sort(all.begin(), all.end());
+    ASSERTEQ(all.front().first, 0);
+    ASSERTEQ(all.back().second, std::numeric_limits<uint64_t>::max());
+    for (size_t i = 1; i < all.size(); ++i)
+        ASSERTEQ(all[i].first, all[i-1].second+1);
+
+    return 0;
+}
+
+int test_movement() {
+    std::vector<uint64_t> agents = make_agents(16, 4);
+    NoReplication rm {};
+    PlacementTable pt(agents, rm, 12);
+
+    const uint64_t keys = 50000;
+    std::vector<uint64_t> before(keys);
+    for (uint64_t k = 0; k < keys; ++k)
+        before[k] = pt.find(k)[0] & agent_mask;
+
+    // A joining agent takes about 1/17 of the keys, mostly from others
+    // directly
+    auto joining = vagents_of(17, 4);
+    pt.add_agents(joining);
+    size_t moved = 0, gained = 0;
+    for (uint64_t k = 0; k < keys; ++k) {
+        uint64_t owner = pt.find(k)[0] & agent_mask;
+        if (owner != before[k]) ++moved;
+        if (owner == 17) ++gained;
+    }
+    ASSERTEQ((gained > keys/20), true);
+    ASSERTEQ((moved < 2*keys/17), true);
+
+    // Leaving returns the table to how it was
+    pt.remove_agents(joining);
+    for (uint64_t k = 0; k < keys; ++k)
+        ASSERTEQ((pt.find(k)[0] & agent_mask), before[k]);
+
+    // A leaving agent's keys move, and few others
+    pt.remove_agents(vagents_of(1, 4));
+    moved = 0;
+    for (uint64_t k = 0; k < keys; ++k)
+        if ((pt.find(k)[0] & agent_mask) != before[k]) ++moved;
+    ASSERTEQ((moved < 2*keys/16), true);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int ret = 0;
+
+    RUN_TEST(test_empty)
+    RUN_TEST(test_balance)
+    RUN_TEST(test_weights)
+    RUN_TEST(test_replicas)
+    RUN_TEST(test_owned_ranges)
+    RUN_TEST(test_movement)
+
+    return ret;
+}
@@ -0,0 +1,174 @@
+/**
+ * Test the Space-Saving heavy hitters and the hub list
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "tests.hpp"
+
+#include "spacesaving.hpp"
+#include "replicationmap.hpp"
+
+#include <stdexcept>
+
+int test_exact() {
+    // Below capacity, counts are exact
+    SpaceSaving ss(8);
+    for (uint64_t k = 1; k <= 5; ++k)
+        for (uint64_t i = 0; i < k; ++i)
+            ss.count(k);
+
+    ASSERTEQ(ss.size(), 5);
+    ASSERTEQ(ss.min_count(), 0);
+    for (uint64_t k = 1; k <= 5; ++k)
+        ASSERTEQ(ss.query(k), k);
+    ASSERTEQ(ss.query(6), 0);
+
+    auto top = ss.top();
+    ASSERTEQ(top[0].key, 5);
+    ASSERTEQ(top[4].key, 1);
+    ASSERTEQ(top[0].error, 0);
+
+    return 0;
+}
+
+int test_heavy() {
+    // Heavy keys among many light ones are tracked and never undercounted
+    SpaceSaving ss(16);
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < 20000; ++i) {
+        ss.count(1000000+i);
+        ++total;
+        if (i % 4 == 0) { ss.count(1); ++total; }
+        if (i % 10 == 0) { ss.count(2); ++total; }
+    }
+
+    ASSERTEQ(ss.size(), 16);
+    ASSERTEQ((ss.query(1) >= 5000), true);
+    ASSERTEQ((ss.query(1) <= 5000+(int64_t)(total/16)), true);
+    ASSERTEQ((ss.query(2) >= 2000), true);
+
+    auto top = ss.top();
+    ASSERTEQ(top[0].key, 1);
+    ASSERTEQ(top[1].key, 2);
+    ASSERTEQ((top[0].count-top[0].error <= 5000), true);
+
+    bool threw = false;
+    try {
+        SpaceSaving bad(0);
+    } catch (std::runtime_error &e) {
+        threw = true;
+    }
+    ASSERTEQ(threw, true);
+
+    return 0;
+}
+
+int test_merge() {
+    SpaceSaving a(4), b(4);
+    for (size_t i = 0; i < 100; ++i) {
+        a.count(1);
+        b.count(1);
+    }
+    for (size_t i = 0; i < 50; ++i)
+        b.count(2);
+    a.count(3, 10);
+
+    a.merge(b);
+    ASSERTEQ(a.query(1), 200);
+    ASSERTEQ(a.query(2), 50);
+    ASSERTEQ(a.query(3), 10);
+
+    // Keys missing from a full summary take its smallest count, as
+    // error; ties keep the smaller key
+    SpaceSaving c(2), d(2);
+    c.count(1, 100);
+    c.count(2, 10);
+    d.count(1, 100);
+    d.count(3, 45);
+    c.merge(d);
+    ASSERTEQ(c.size(), 2);
+    ASSERTEQ(c.query(1), 200);
+    ASSERTEQ(c.query(2), 55);
+    ASSERTEQ(c.query(3), 0);
+    ASSERTEQ(c.top()[1].error, 45);
+
+    return 0;
+}
+
+int test_serialize() {
+    SpaceSaving ss(32);
+    for (uint64_t i = 0; i < 1000; ++i)
+        ss.count(i % 50, i % 7);
+
+    auto data = ss.serialize();
+    SpaceSaving other(data.data(), data.size());
+    ASSERTEQ(other.capacity(), 32);
+    ASSERTEQ(other.size(), ss.size());
+    auto a = ss.top(), b = other.top();
+    for (size_t i = 0; i < a.size(); ++i) {
+        ASSERTEQ(a[i].key, b[i].key);
+        ASSERTEQ(a[i].count, b[i].count);
+        ASSERTEQ(a[i].error, b[i].error);
+    }
+
+    bool threw = false;
+    try {
+        SpaceSaving bad(data.data(), data.size()-1);
+    } catch (std::runtime_error &e) {
+        threw = true;
+    }
+    ASSERTEQ(threw, true);
+
+    return 0;
+}
+
+int test_hub_list() {
+    SpaceSaving ss(8);
+    ss.count(7, 3*REP_THRESH);
+    ss.count(8, 10);
+
+    auto hubs = HHReplicationMap::hub_list(ss);
+    ASSERTEQ(hubs.size(), 2);
+    ASSERTEQ(hubs[0].v, 7);
+    ASSERTEQ(hubs[0].reps, 4);
+    ASSERTEQ(hubs[1].reps, 1);
+
+    // Round trip behind other data, as in a directory update
+    std::vector<char> msg(24, 'x');
+    HHReplicationMap::encode(hubs, msg);
+    HHReplicationMap rm;
+    ASSERTEQ(rm.update(msg.data(), msg.size()), msg.size()-24);
+    ASSERTEQ(rm.query(7), 4);
+    ASSERTEQ(rm.query(8), 1);
+    ASSERTEQ(rm.sk_query(8), 10);
+    ASSERTEQ(rm.query(9), 1);
+    ASSERTEQ(rm.sk_query(9), 0);
+    ASSERTEQ(rm.hubs().size(), 2);
+
+    // An empty list clears the hubs
+    std::vector<char> empty;
+    HHReplicationMap::encode({}, empty);
+    ASSERTEQ(rm.update(empty.data(), empty.size()), sizeof(uint64_t));
+    ASSERTEQ(rm.query(7), 1);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int ret = 0;
+
+    RUN_TEST(test_exact)
+    RUN_TEST(test_heavy)
+    RUN_TEST(test_merge)
+    RUN_TEST(test_serialize)
+    RUN_TEST(test_hub_list)
+
+    return ret;
+}
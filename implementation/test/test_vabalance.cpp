@@ -0,0 +1,138 @@
+/**
+ * Test the virtual agent balancing
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "tests.hpp"
+
+#include "vabalance.hpp"
+
+#include <stdexcept>
+
+using namespace elga;
+
+int balanced() {
+    VABalancer b(0.5, 1.2, 1, 1000, 1.);
+    std::vector<aid_t> vagents = {100, 100, 100};
+    std::vector<va_load_t> loads = {{100, 0., 1}, {110, 0., 1}, {90, 0., 1}};
+    std::vector<aid_t> counts;
+
+    ASSERTEQ(b.plan(vagents, loads, counts), false);
+    ASSERTEQ((counts == vagents), true);
+    ASSERTCLOSE(b.imbalance(), 1.1, 1e-9);
+
+    // Nothing to measure
+    loads = {{0, 0., 1}, {0, 0., 1}, {0, 0., 1}};
+    ASSERTEQ(b.plan(vagents, loads, counts), false);
+
+    return 0;
+}
+
+int both_directions() {
+    VABalancer b(0.5, 1.2, 1, 1000, 1.);
+    std::vector<aid_t> vagents = {100, 100, 100, 100};
+    std::vector<va_load_t> loads = {{400, 0., 1}, {100, 0., 1}, {100, 0., 1}, {100, 0., 1}};
+    std::vector<aid_t> counts;
+
+    ASSERTEQ(b.plan(vagents, loads, counts), true);
+    ASSERTCLOSE(b.imbalance(), 16./7, 1e-9);
+    // Halfway to 43.75 and 175, scaled back to 400 virtual agents
+    ASSERTEQ(counts[0], 59);
+    ASSERTEQ(counts[1], 114);
+    ASSERTEQ(counts[3], 114);
+    ASSERTEQ((b.predicted() < b.imbalance()), true);
+
+    // A light agent at most doubles, before scaling back
+    loads = {{100, 0., 1}, {100, 0., 1}, {100, 0., 1}, {10, 0., 1}};
+    ASSERTEQ(b.plan(vagents, loads, counts), true);
+    ASSERTEQ(counts[0], 76);
+    ASSERTEQ(counts[3], 172);
+
+    return 0;
+}
+
+int busy_time() {
+    // Equal edges, but one agent computes for three times as long
+    std::vector<aid_t> vagents = {100, 100};
+    std::vector<va_load_t> loads = {{100, 3., 1}, {100, 1., 1}};
+    std::vector<aid_t> counts;
+
+    VABalancer edges(0.5, 1.2, 1, 1000, 1.);
+    ASSERTEQ(edges.plan(vagents, loads, counts), false);
+
+    VABalancer busy(0.5, 1.2, 1, 1000, 0.);
+    ASSERTEQ(busy.plan(vagents, loads, counts), true);
+    ASSERTEQ((counts[0] < 100), true);
+    ASSERTEQ((counts[1] > 100), true);
+
+    VABalancer both(0.5, 1.2, 1, 1000, 0.5);
+    ASSERTEQ(both.plan(vagents, loads, counts), true);
+    ASSERTCLOSE(both.imbalance(), 1.25, 1e-9);
+
+    return 0;
+}
+
+int limits() {
+    VABalancer b(1., 1.2, 90, 110, 1.);
+    std::vector<aid_t> vagents = {100, 100, 100, 100};
+    std::vector<va_load_t> loads = {{400, 0., 1}, {100, 0., 1}, {100, 0., 1}, {100, 0., 1}};
+    std::vector<aid_t> counts;
+
+    ASSERTEQ(b.plan(vagents, loads, counts), true);
+    ASSERTEQ(counts[0], 90);
+    ASSERTEQ(counts[1], 110);
+
+    bool threw = false;
+    try {
+        VABalancer bad(0., 1.2, 1, 1000, 1.);
+    } catch (std::runtime_error &e) {
+        threw = true;
+    }
+    ASSERTEQ(threw, true);
+
+    return 0;
+}
+
+int converges() {
+    // Agents whose ring share has uneven density, e.g. from skew, settle
+    // below the threshold without oscillating
+    VABalancer b(0.5, 1.1, 1, 10000, 1.);
+    std::vector<double> density = {4., 1., 1., 2., 0.5, 1.};
+    std::vector<aid_t> vagents(density.size(), 100);
+    std::vector<aid_t> counts;
+
+    double last = 1e9;
+    size_t rounds = 0;
+    for (; rounds < 20; ++rounds) {
+        std::vector<va_load_t> loads;
+        for (size_t i = 0; i < vagents.size(); ++i)
+            loads.push_back({(uint64_t)(density[i]*vagents[i]), 0., 1});
+        if (!b.plan(vagents, loads, counts)) break;
+        ASSERTEQ((b.imbalance() < last), true);
+        last = b.imbalance();
+        vagents = counts;
+    }
+    ASSERTEQ((rounds < 20), true);
+    ASSERTEQ((b.imbalance() < 1.1), true);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int ret = 0;
+
+    RUN_TEST(balanced)
+    RUN_TEST(both_directions)
+    RUN_TEST(busy_time)
+    RUN_TEST(limits)
+    RUN_TEST(converges)
+
+    return ret;
+}
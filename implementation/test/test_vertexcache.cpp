@@ -0,0 +1,95 @@
+/**
+ * Test the vertex result cache
+ *
+ * Author: Kasimir Gabert
+ *
+ * Copyright 2021 National Technology & Engineering Solutions of Sandia, LLC
+ * (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ * Government retains certain rights in this software.
+ *
+ * Please see the LICENSE.md file for license information.
+ */
+
+#include "tests.hpp"
+
+#include "vertexcache.hpp"
+
+using namespace elga;
+
+/** Read a cached value as a vertex */
+vertex_t value_of(const char *value) {
+    return value ? *(const vertex_t*)value : (vertex_t)-1;
+}
+
+int hits_and_invalidation() {
+    VertexCache c(4, sizeof(vertex_t));
+
+    ASSERTEQ(c.find(1), nullptr);
+    vertex_t val = 10;
+    c.insert(1, (const char*)&val, c.batch());
+    ASSERTEQ(value_of(c.find(1)), 10);
+    ASSERTEQ(c.hits(), 1);
+    ASSERTEQ(c.misses(), 1);
+
+    // Overwrite in place
+    val = 11;
+    c.insert(1, (const char*)&val, c.batch());
+    ASSERTEQ(value_of(c.find(1)), 11);
+    ASSERTEQ(c.size(), 1);
+
+    // A completed batch invalidates everything
+    batch_t before = c.batch();
+    c.invalidate();
+    ASSERTEQ(c.find(1), nullptr);
+
+    // An answer requested before the batch completed is dropped
+    c.insert(1, (const char*)&val, before);
+    ASSERTEQ(c.find(1), nullptr);
+
+    val = 12;
+    c.insert(1, (const char*)&val, c.batch());
+    ASSERTEQ(value_of(c.find(1)), 12);
+
+    return 0;
+}
+
+int clock_replacement() {
+    VertexCache c(3, sizeof(vertex_t));
+
+    for (vertex_t v = 0; v < 3; ++v)
+        c.insert(v, (const char*)&v, c.batch());
+    ASSERTEQ(c.size(), 3);
+
+    // A popular vertex survives replacement
+    c.find(0);
+    vertex_t v = 3;
+    c.insert(v, (const char*)&v, c.batch());
+    ASSERTEQ(c.size(), 3);
+    ASSERTEQ(value_of(c.find(0)), 0);
+    ASSERTEQ(value_of(c.find(3)), 3);
+    ASSERTEQ(c.find(1), nullptr);
+
+    // Stale entries are replaced before current ones
+    c.invalidate();
+    v = 4;
+    c.insert(v, (const char*)&v, c.batch());
+    v = 5;
+    c.insert(v, (const char*)&v, c.batch());
+    v = 6;
+    c.insert(v, (const char*)&v, c.batch());
+    ASSERTEQ(value_of(c.find(4)), 4);
+    ASSERTEQ(value_of(c.find(5)), 5);
+    ASSERTEQ(value_of(c.find(6)), 6);
+    ASSERTEQ(c.size(), 3);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int ret = 0;
+
+    RUN_TEST(hits_and_invalidation)
+    RUN_TEST(clock_replacement)
+
+    return ret;
+}